@@ -0,0 +1,281 @@
+/**
+ * @file FrameSetTestUtility/FrameSetTestUtility.cc
+ *
+ * Checks when FrameSetListener delivers a frame set: once complete,
+ * once too old (see flush()), or to make room for a newer one.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <LibMultiSense/details/frameset.hh>
+#include <LibMultiSense/details/utility/TimeStamp.hh>
+
+using namespace crl::multisense;
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+const DataSource SOURCES = Source_Luma_Left | Source_Disparity;
+const double     TIMEOUT = 0.2;   // seconds
+const uint32_t   QUEUE   = 8;
+const double     WAIT    = 2.0;   // seconds, for a set that is due
+const uint32_t   QUIET   = 50000; // microseconds, for one that is not
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+//
+// The sets delivered
+
+class Delivered {
+public:
+    Delivered(int64_t f, DataSource s, uint32_t i) : frameId(f), sources(s), images(i) {};
+
+    int64_t    frameId;
+    DataSource sources;
+    uint32_t   images;
+};
+
+utility::Mutex         deliveredLock;
+std::vector<Delivered> delivered;
+
+void setCallback(const image::FrameSet& set,
+                 void                  *userDataP)
+{
+    utility::ScopedLock lock(deliveredLock);
+    delivered.push_back(Delivered(set.frameId, set.sources, set.images.size()));
+}
+
+uint32_t deliveredCount()
+{
+    utility::ScopedLock lock(deliveredLock);
+    return delivered.size();
+}
+
+//
+// Wait for [count] sets in all to have been delivered. Sets are
+// delivered on the listener's dispatch thread.
+
+bool waitFor(uint32_t count)
+{
+    const double start = utility::TimeStamp::getMonotonicTime();
+
+    while(deliveredCount() < count)
+        if (utility::TimeStamp::getMonotonicTime() - start > WAIT)
+            return false;
+        else
+            usleep(1000);
+
+    usleep(QUIET);
+
+    return deliveredCount() == count;
+}
+
+bool last(int64_t    frameId,
+          DataSource sources,
+          uint32_t   images=0)
+{
+    utility::ScopedLock lock(deliveredLock);
+
+    return (false == delivered.empty() &&
+            frameId == delivered.back().frameId &&
+            sources == delivered.back().sources &&
+            (0 == images || images == delivered.back().images));
+}
+
+double now()
+{
+    return utility::TimeStamp::getMonotonicTime();
+}
+
+//
+// Feeds a listener images, each with a little buffer of its own
+
+class Feeder {
+public:
+
+    Feeder() :
+        m_converter(),
+        m_listener(setCallback, SOURCES, NULL, QUEUE, 0, TIMEOUT, &m_converter)
+    {
+        utility::ScopedLock lock(deliveredLock);
+        delivered.clear();
+    };
+
+    void image(DataSource source,
+               int64_t    frameId) {
+
+        utility::BufferStream buffer(16);
+        image::Header         header;
+
+        header.source       = source;
+        header.frameId      = frameId;
+        header.bitsPerPixel = 8;
+        header.width        = 4;
+        header.height       = 4;
+        header.imageLength  = 16;
+        header.imageDataP   = buffer.data();
+
+        m_listener.dispatch(buffer, header);
+    };
+
+    FrameSetListener& listener() { return m_listener; };
+
+private:
+
+    Converter<image::Header> m_converter;
+    FrameSetListener         m_listener;
+};
+
+//
+// A set is delivered as soon as it holds every streaming source
+
+void testComplete()
+{
+    Feeder f;
+
+    f.listener().flush(now(), SOURCES);
+
+    f.image(Source_Luma_Left, 1);
+    CHECK(waitFor(0));
+
+    f.image(Source_Disparity, 1);
+    CHECK(waitFor(1) && last(1, SOURCES));
+
+    //
+    // Images of another source, or repeated, are left out
+
+    f.image(Source_Luma_Right, 2);
+    f.image(Source_Disparity,  2);
+    f.image(Source_Disparity,  2);
+    f.image(Source_Luma_Left,  2);
+
+    CHECK(waitFor(2) && last(2, SOURCES, 2));
+}
+
+//
+// flush() delivers a set once it is older than the timeout
+
+void testTimeout()
+{
+    Feeder f;
+
+    f.listener().flush(now(), SOURCES);
+
+    f.image(Source_Luma_Left, 1);
+
+    f.listener().flush(now(), SOURCES);
+    CHECK(waitFor(0));
+
+    f.listener().flush(now() + 2 * TIMEOUT, SOURCES);
+    CHECK(waitFor(1) && last(1, Source_Luma_Left));
+
+    //
+    // Nothing is left to flush
+
+    f.listener().flush(now() + 2 * TIMEOUT, SOURCES);
+    CHECK(waitFor(1));
+}
+
+//
+// flush() delivers a set once the sources it lacks stop streaming
+
+void testStreaming()
+{
+    Feeder f;
+
+    //
+    // Every source is taken to have just arrived when the listener
+    // is created, so let that pass
+
+    usleep(static_cast<uint32_t>(1.5e6 * TIMEOUT));
+
+    //
+    // Disparity is neither enabled nor arriving, so not waited for
+
+    f.listener().flush(now(), Source_Luma_Left);
+
+    f.image(Source_Luma_Left, 1);
+    CHECK(waitFor(1) && last(1, Source_Luma_Left));
+
+    //
+    // Until it is enabled, then stops again
+
+    f.listener().flush(now(), SOURCES);
+
+    f.image(Source_Luma_Left, 2);
+    CHECK(waitFor(1));
+
+    f.listener().flush(now(), Source_Luma_Left);
+    CHECK(waitFor(2) && last(2, Source_Luma_Left));
+}
+
+//
+// A set is delivered early to make room for a newer one
+
+void testRoom()
+{
+    Feeder f;
+
+    f.listener().flush(now(), SOURCES);
+
+    for(int64_t frameId=10; frameId<14; frameId++)
+        f.image(Source_Luma_Left, frameId);
+
+    CHECK(waitFor(0));
+
+    f.image(Source_Luma_Left, 14);
+    CHECK(waitFor(1) && last(10, Source_Luma_Left));
+
+    //
+    // The others still complete
+
+    f.image(Source_Disparity, 12);
+    CHECK(waitFor(2) && last(12, SOURCES));
+
+    f.listener().flush(now() + 2 * TIMEOUT, SOURCES);
+    CHECK(waitFor(5));
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    testComplete();
+    testTimeout();
+    testStreaming();
+    testRoom();
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
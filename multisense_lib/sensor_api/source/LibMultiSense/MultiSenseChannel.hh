@@ -47,6 +47,22 @@ public:
 
     static Channel* Create(const std::string& sensorAddress);
 
+    //
+    // Create an instance, selecting how sensor data is received
+    //
+    // RxBackend_Socket (the default) reads a UDP socket.
+    //
+    // RxBackend_PacketRing receives through a memory-mapped AF_PACKET
+    // ring (TPACKET_V3), filtered in the kernel to datagrams from the
+    // sensor to our UDP port. Datagrams are handed over a block at a
+    // time, without a system call per datagram, and the ring is much
+    // larger than a socket buffer. This requires CAP_NET_RAW, and the
+    // sensor's datagrams must not be IP-fragmented (the sensor MTU must
+    // not exceed the host interface MTU.)
+
+    static Channel* Create(const std::string& sensorAddress,
+                           RxBackend          backend);
+
     //
     // Destroy an instance
 
@@ -58,24 +74,64 @@ public:
 
     static const char *statusString(Status status);
 
+    //
+    // Unpack a disparity image delivered with Callback_PackedDisparity,
+    // to 1/16th pixel integers or to pixels.
+    //
+    // Only rows [firstRow, firstRow + rowCount) are unpacked (rowCount 0
+    // for the rest of the image), taking every 'decimation'th row and
+    // column of those. 'dataP' receives ceil(rowCount / decimation) rows
+    // of ceil(width / decimation) pixels.
+    //
+    // May be called from any thread, while the image data is valid.
+
+    static Status unpackDisparity(const image::Header& header,
+                                  uint16_t            *dataP,
+                                  uint32_t             firstRow=0,
+                                  uint32_t             rowCount=0,
+                                  uint32_t             decimation=1);
+    static Status unpackDisparity(const image::Header& header,
+                                  float               *dataP,
+                                  uint32_t             firstRow=0,
+                                  uint32_t             rowCount=0,
+                                  uint32_t             decimation=1);
+
+    //
+    // Run the callbacks added from now on, on every Channel in this
+    // process, on a shared pool of 'threads' internal threads instead
+    // of a thread each. A callback is still invoked for one datum at
+    // a time, in order. Idle threads take work queued for busy ones.
+    //
+    // 0 (the default) returns to a thread per callback. The pool can
+    // only be changed while no callbacks are using it; Status_Failed
+    // is returned otherwise.
+    //
+    // The pool's threads are scheduled according to 'policy' (see
+    // setThreadPolicy() below, which does not apply to them.)
+
+    static Status setCallbackThreads(uint32_t            threads,
+                                     const ThreadPolicy& policy=ThreadPolicy());
+
     //
     // Callback registration
     //
     // Each call will create a unique internal thread dedicated 
-    // to the callback.
+    // to the callback (see setCallbackThreads() above for sharing
+    // a pool of threads instead.)
     //
     // Pointers to sensor data in the callback are no longer
     // valid after returning from the callback. Image and lidar data
     // can be reserved by the user (see reserveCallbackBuffer() below.)
     //
     // Sensor data are queued per-callback, however, the queue
-    // depth is limited, and the oldest data will be silently dropped 
-    // if the callback falls behind.
+    // depth is limited, and by default the oldest data will be dropped 
+    // if the callback falls behind (see the CallbackQueue overloads
+    // below, and getCallbackDrops().)
     //
-    // Image max per-callback queue depth: 5
-    // Laser max per-callback queue depth: 20
-    // PPS   max per-callback queue depth: 2
-    // IMU   max per-callback queue depth: 50
+    // Image default per-callback queue depth: 5
+    // Laser default per-callback queue depth: 20
+    // PPS   default per-callback queue depth: 2
+    // IMU   default per-callback queue depth: 50
     //
     // Adding multiple callbacks of the same data type is allowed. For 
     // images and lidar, the same instance of sensor data will be presented 
@@ -102,6 +158,20 @@ public:
                                        DataSource      imageSourceMask,
                                        void           *userDataP=NULL) = 0;
 
+    //
+    // As above, with options for how images are delivered:
+    //
+    //    Callback_PackedDisparity: disparity images are delivered as
+    //    received from the sensor, 12 bits per pixel (bitsPerPixel is
+    //    12.) Otherwise they are unpacked to 16 bits per pixel, once
+    //    per image, by the first such callback to run; the others
+    //    share that copy. See unpackDisparity() below.
+
+    virtual Status addIsolatedCallback(image::Callback callback, 
+                                       DataSource      imageSourceMask,
+                                       void           *userDataP,
+                                       CallbackFlags   flags) = 0;
+
     virtual Status addIsolatedCallback(lidar::Callback callback,
                                        void           *userDataP=NULL) = 0;
 
@@ -111,6 +181,56 @@ public:
     virtual Status addIsolatedCallback(imu::Callback   callback,
                                        void           *userDataP=NULL) = 0;
 
+    //
+    // As above, with the depth of the callback's queue and what is
+    // done when it is full (see CallbackQueue.) For example:
+    //
+    //    Queue_KeepLatest: only the newest datum waits, for consumers
+    //    such as displays. Older data (and their receive buffers) are
+    //    released as soon as newer data arrive.
+    //
+    //    Queue_Block: for consumers that must not lose data. Note that
+    //    the receive thread, and so every other callback, waits while
+    //    the queue is full.
+
+    virtual Status addIsolatedCallback(image::Callback      callback, 
+                                       DataSource           imageSourceMask,
+                                       void                *userDataP,
+                                       CallbackFlags        flags,
+                                       const CallbackQueue& queue) = 0;
+
+    virtual Status addIsolatedCallback(lidar::Callback      callback,
+                                       void                *userDataP,
+                                       const CallbackQueue& queue) = 0;
+
+    virtual Status addIsolatedCallback(pps::Callback        callback,
+                                       void                *userDataP,
+                                       const CallbackQueue& queue) = 0;
+
+    virtual Status addIsolatedCallback(imu::Callback        callback,
+                                       void                *userDataP,
+                                       const CallbackQueue& queue) = 0;
+
+    //
+    // Images of several sources, delivered together in one callback
+    // per frameId. A set is delivered once it holds an image from
+    // every source in 'sourceMask' that is streaming: enabled with
+    // startStreams(), or delivered within the last 'timeout' seconds.
+    // An incomplete set is delivered once 'timeout' seconds have
+    // passed since its first image arrived; FrameSet::sources says
+    // which images it holds. After stopStreams(), sets waiting on the
+    // stopped sources are delivered without waiting for the timeout.
+    //
+    // The image data are valid until the callback returns.
+    // reserveCallbackBuffer() is not available in this callback. The
+    // flags are as for image callbacks above.
+
+    virtual Status addIsolatedCallback(image::FrameSetCallback callback,
+                                       DataSource              sourceMask,
+                                       void                   *userDataP=NULL,
+                                       double                  timeout=0.1,
+                                       CallbackFlags           flags=Callback_Default) = 0;
+
     //
     // Callback deregistration
 
@@ -118,6 +238,17 @@ public:
     virtual Status removeIsolatedCallback(lidar::Callback callback) = 0;
     virtual Status removeIsolatedCallback(pps::Callback   callback) = 0;
     virtual Status removeIsolatedCallback(imu::Callback   callback) = 0;
+    virtual Status removeIsolatedCallback(image::FrameSetCallback callback) = 0;
+
+    //
+    // The number of data dropped from a callback's queue since it
+    // was added
+
+    virtual Status getCallbackDrops(image::Callback callback, uint64_t& drops) = 0;
+    virtual Status getCallbackDrops(lidar::Callback callback, uint64_t& drops) = 0;
+    virtual Status getCallbackDrops(pps::Callback   callback, uint64_t& drops) = 0;
+    virtual Status getCallbackDrops(imu::Callback   callback, uint64_t& drops) = 0;
+    virtual Status getCallbackDrops(image::FrameSetCallback callback, uint64_t& drops) = 0;
 
     //
     // Callback buffer reservation.
@@ -152,8 +283,43 @@ public:
     // sensor's clock, which is free-running from 0 seconds on power up.
     //
     // The network-based time synchronization is enabled by default.
+    //
+    // The offset is fit, together with the drift of the sensor's clock,
+    // to a window of probes of the sensor's clock, favoring the probes
+    // with the shortest round trips. setNetworkTimeSyncRate() sets how
+    // often the sensor is probed, in Hz (default 1, at most 100.) A higher
+    // rate converges faster after connecting, at the cost of a small
+    // request per probe.
 
     virtual Status networkTimeSynchronization(bool enabled) = 0;
+    virtual Status setNetworkTimeSyncRate   (double hz)     = 0;
+
+    //
+    // PPS-disciplined time synchronization.
+    //
+    // When the sensor's PPS (OPTO-TX) line and a PPS input of this host
+    // are driven by the same pulse (e.g., from a GPS receiver), each of
+    // the sensor's PPS events may be paired with the host's time of the
+    // same edge. Sensor timestamps are then mapped by a fit to the last
+    // 16 pairs instead of to network probes, which removes the network's
+    // latency and jitter from the mapping.
+    //
+    // The host's edge times come either from a Linux PPS device
+    // (setHostPpsDevice(), e.g., "/dev/pps0", which must capture assert
+    // edges; an empty name closes it) or from the caller (addHostPpsEdge(),
+    // in seconds of the local system clock, once per edge.)
+    //
+    // Edges are paired using the network mapping, which must therefore
+    // be accurate to better than 0.5 seconds. Mapping falls back to
+    // network synchronization when no edges have been paired for 3
+    // seconds.
+    //
+    // getTimeSyncStatus() reports the source of the current mapping, its
+    // parameters, and the RMS residual of the samples it was fit to.
+
+    virtual Status setHostPpsDevice (const std::string& device)         = 0;
+    virtual Status addHostPpsEdge   (double seconds)                    = 0;
+    virtual Status getTimeSyncStatus(system::TimeSyncStatus& status)    = 0;
 
     //
     // Primary stream control. All streams will come to the requestor (i.e., the 
@@ -166,10 +332,16 @@ public:
     //
     // Stop streams may be called to selectively disable streams at any time.
     //  (use stopStreams(0xffffffff) to disable all streaming.)
+    //
+    // getSubscribedSources() returns the sources that at least one callback
+    // is registered for. Enabled streams outside of it are received and
+    // discarded, and may be stopped with:
+    //  stopStreams(enabled & ~subscribed)
 
-    virtual Status startStreams     (DataSource mask)  = 0;
-    virtual Status stopStreams      (DataSource mask)  = 0;
-    virtual Status getEnabledStreams(DataSource& mask) = 0;
+    virtual Status startStreams        (DataSource mask)  = 0;
+    virtual Status stopStreams         (DataSource mask)  = 0;
+    virtual Status getEnabledStreams   (DataSource& mask) = 0;
+    virtual Status getSubscribedSources(DataSource& mask) = 0;
 
     //
     // NOTE: Directed streams are currently only supported by CRL's
@@ -230,6 +402,31 @@ public:
     virtual Status getImageHistogram   (int64_t frameId,  // from last 20 images, left only
                                         image::Histogram& histogram)        = 0;
 
+    //
+    // Asynchronous control/query
+    //
+    // These queue the command and return immediately. Queued commands
+    // are sent one at a time, in order, by an internal thread, with
+    // the same retries and timeouts as the blocking calls above. The
+    // callback (which may be NULL for the setters) is then invoked
+    // from that thread with the result, and should not block.
+    //
+    // Commands still queued when the channel is destroyed are not
+    // sent. Their callbacks are invoked with Status_Error from the
+    // destroying thread instead.
+
+    virtual Status getLightingConfigAsync(lighting::ConfigCallback callback,
+                                          void                    *userDataP=NULL) = 0;
+    virtual Status setLightingConfigAsync(const lighting::Config&  c,
+                                          CompletionCallback       callback=NULL,
+                                          void                    *userDataP=NULL) = 0;
+
+    virtual Status getImageConfigAsync   (image::ConfigCallback    callback,
+                                          void                    *userDataP=NULL) = 0;
+    virtual Status setImageConfigAsync   (const image::Config&     c,
+                                          CompletionCallback       callback=NULL,
+                                          void                    *userDataP=NULL) = 0;
+
     //
     // System configuration 
 
@@ -309,6 +506,80 @@ public:
     // Retrieve the system-assigned local UDP port
 
     virtual Status getLocalUdpPort(uint16_t& port) = 0;
+
+    //
+    // Retrieve a snapshot of the channel's internal statistics
+    //
+    // See system::ChannelStatistics for the meaning of each counter.
+
+    virtual Status getChannelStatistics(system::ChannelStatistics& s) = 0;
+
+    //
+    // Select how the internal receive thread waits for datagrams,
+    // trading CPU time for wakeup latency.
+    //
+    // RxPoll_Blocking sleeps in the kernel until data arrives. This is
+    // the default, and uses no CPU while idle.
+    //
+    // RxPoll_Adaptive keeps polling without sleeping for
+    // 'spinMicroseconds' after the last datagram was received, so the
+    // remaining datagrams of a frame are picked up without a wakeup,
+    // then falls back to sleeping.
+    //
+    // RxPoll_BusyPoll never sleeps, and additionally asks the kernel to
+    // busy-poll the NIC receive queue for up to 'spinMicroseconds' per
+    // read (SO_BUSY_POLL). This dedicates one core to the channel.
+    // Raising the busy-poll time above the system default (sysctl
+    // net.core.busy_read) requires CAP_NET_ADMIN; without it the thread
+    // still spins, without the kernel-side polling. With
+    // RxBackend_PacketRing the thread spins on the shared ring, and
+    // there is no kernel-side polling either.
+
+    virtual Status setRxPollMode(RxPollMode mode,
+                                 uint32_t   spinMicroseconds) = 0;
+    virtual Status getRxPollMode(RxPollMode& mode,
+                                 uint32_t&   spinMicroseconds) = 0;
+
+    //
+    // Schedule the internal threads of a role, for example to pin the
+    // receive thread to an isolated core and run it SCHED_FIFO, and
+    // keep the callback threads on other cores:
+    //
+    //    ThreadPolicy rx(SCHED_FIFO, 80);
+    //    rx.cpus.push_back(3);
+    //    channelP->setThreadPolicy(Thread_Rx, rx);
+    //
+    // Thread_Dispatch applies to the threads of the callbacks added to
+    // this channel, including those added later. Real-time scheduling
+    // needs CAP_SYS_NICE (or RLIMIT_RTPRIO); Status_Exception is
+    // returned if the policy cannot be applied.
+    //
+    // Internal threads are named "ms-<role>", as shown by top -H,
+    // perf, etc.
+
+    virtual Status setThreadPolicy(ThreadRole          role,
+                                   const ThreadPolicy& policy) = 0;
+
+    //
+    // Select how the library allocates its large RX buffers (the ones
+    // sized for images.) Each size class is carved from a single block
+    // of memory placed according to 'flags':
+    //
+    // RxArena_HugePages backs the buffers with 2 MB pages, from the
+    // reserved hugepage pool (vm.nr_hugepages) if available, otherwise
+    // by requesting transparent hugepages.
+    //
+    // RxArena_Locked pins the buffers in RAM. This is subject to
+    // RLIMIT_MEMLOCK.
+    //
+    // RxArena_NumaLocal binds the buffers to the NUMA node the
+    // internal receive thread is running on.
+    //
+    // Placement is best-effort; see system::BufferPoolStatistics for
+    // what was achieved. The buffers are reallocated immediately.
+    // This has no effect on buffers supplied with setLargeBuffers().
+
+    virtual Status setRxBufferArena(RxArenaFlags flags) = 0;
 };
 
 
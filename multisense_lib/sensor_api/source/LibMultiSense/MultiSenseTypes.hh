@@ -110,6 +110,114 @@ typedef uint32_t TriggerSource;
 static const TriggerSource Trigger_Internal    = 0; // default, image::config.setFps()
 static const TriggerSource Trigger_External    = 1; // OPTO_RX input
 
+//
+// Receive thread polling modes
+
+typedef uint32_t RxPollMode;
+
+static const RxPollMode RxPoll_Blocking = 0; // default, sleep until data arrives
+static const RxPollMode RxPoll_Adaptive = 1; // spin for a while after data, then sleep
+static const RxPollMode RxPoll_BusyPoll = 2; // spin continuously (SO_BUSY_POLL)
+
+//
+// Receive backends
+
+typedef uint32_t RxBackend;
+
+static const RxBackend RxBackend_Socket     = 0; // default, a UDP socket
+static const RxBackend RxBackend_PacketRing = 1; // AF_PACKET TPACKET_V3 ring
+
+//
+// Internal threads, by what they do
+
+typedef uint32_t ThreadRole;
+
+static const ThreadRole Thread_Rx       = 0; // receives all sensor data
+static const ThreadRole Thread_Dispatch = 1; // one per callback, invokes it
+static const ThreadRole Thread_Control  = 2; // status polling, asynchronous commands
+
+//
+// Scheduling of internal threads
+//
+// A scheduler of -1 leaves the scheduling class and priority as they
+// are, otherwise it is one of SCHED_OTHER, SCHED_FIFO or SCHED_RR
+// (see sched_setscheduler(2)), with 'priority' for the latter two.
+// An empty CPU list leaves the affinity as it is.
+
+class ThreadPolicy {
+public:
+
+    int32_t              scheduler;
+    int32_t              priority;
+    std::vector<int32_t> cpus;
+
+    ThreadPolicy(int32_t s=-1,
+                 int32_t p=0) :
+        scheduler(s),
+        priority(p),
+        cpus() {};
+};
+
+//
+// Receive buffer memory placement
+
+typedef uint32_t RxArenaFlags;
+
+static const RxArenaFlags RxArena_Default   = 0;
+static const RxArenaFlags RxArena_HugePages = (1<<0); // 2 MB pages
+static const RxArenaFlags RxArena_Locked    = (1<<1); // mlock()'d, never paged out
+static const RxArenaFlags RxArena_NumaLocal = (1<<2); // on the RX thread's NUMA node
+
+//
+// Callback options
+
+typedef uint32_t CallbackFlags;
+
+static const CallbackFlags Callback_Default         = 0;
+static const CallbackFlags Callback_PackedDisparity = (1<<0); // 12-bit, see Channel::unpackDisparity()
+
+//
+// What a callback's queue does when the callback falls behind
+
+typedef uint32_t QueuePolicy;
+
+static const QueuePolicy Queue_DropOldest = 0; // default
+static const QueuePolicy Queue_KeepLatest = 1; // depth of 1, only the newest datum waits
+static const QueuePolicy Queue_DropNewest = 2;
+static const QueuePolicy Queue_Block      = 3; // the receive thread waits for room, see below
+
+//
+// Queue options for a callback
+//
+// A depth of 0 selects the default depth for the data type (see
+// Channel::addIsolatedCallback()).
+//
+// With Queue_Block, all reception stalls while the receive thread
+// waits, for at most 'timeout' seconds, for room in a full queue. The
+// datum is dropped if none is made.
+
+class CallbackQueue {
+public:
+
+    QueuePolicy policy;
+    uint32_t    depth;
+    double      timeout;
+
+    CallbackQueue(QueuePolicy p=Queue_DropOldest,
+                  uint32_t    d=0,
+                  double      t=0.1) :
+        policy(p),
+        depth(d),
+        timeout(t) {};
+};
+
+//
+// Function pointer for the completion of an asynchronous command
+// (e.g., Channel::setImageConfigAsync())
+
+typedef void (*CompletionCallback)(Status status,
+                                   void  *userDataP);
+
 //
 // Base class for callbacks
 
@@ -142,8 +250,22 @@ public:
     uint32_t    imageLength;
     const void *imageDataP;
 
+    //
+    // When the first and last datagrams of the image were received,
+    // timestamped by the kernel in the local system clock (0 if the
+    // kernel did not timestamp them)
+
+    uint32_t    rxFirstSeconds;
+    uint32_t    rxFirstMicroSeconds;
+    uint32_t    rxLastSeconds;
+    uint32_t    rxLastMicroSeconds;
+
     Header() 
-        : source(Source_Unknown) {};
+        : source(Source_Unknown),
+          rxFirstSeconds(0),
+          rxFirstMicroSeconds(0),
+          rxLastSeconds(0),
+          rxLastMicroSeconds(0) {};
 
     virtual bool inMask(DataSource mask) { return (mask & source);};
 };
@@ -155,6 +277,33 @@ public:
 typedef void (*Callback)(const Header& header,
                          void         *userDataP);
 
+//
+// Images from several sources with the same frameId, see the
+// FrameSetCallback overload of Channel::addIsolatedCallback()
+
+class FrameSet {
+public:
+
+    int64_t             frameId;
+    DataSource          sources; // of the images in the set
+    std::vector<Header> images;
+
+    //
+    // The image from 'source', or NULL if it is not in the set
+
+    const Header *image(DataSource source) const {
+        for(uint32_t i=0; i<images.size(); i++)
+            if (images[i].source == source)
+                return &images[i];
+        return NULL;
+    };
+
+    FrameSet() : frameId(-1), sources(Source_Unknown) {};
+};
+
+typedef void (*FrameSetCallback)(const FrameSet& set,
+                                 void           *userDataP);
+
 //
 // For query/setting camera configuration
 
@@ -257,6 +406,14 @@ protected:
     float    m_roll, m_pitch, m_yaw;
 };
 
+//
+// Function pointer for the completion of Channel::getImageConfigAsync().
+// The configuration is only valid if status is Status_Ok.
+
+typedef void (*ConfigCallback)(Status        status,
+                               const Config& config,
+                               void         *userDataP);
+
 //
 // For querying/setting camera calibration.
 //
@@ -305,7 +462,11 @@ class Header : public HeaderBase {
 public:
 
     Header()
-        : pointCount(0) {};
+        : pointCount(0),
+          rxFirstSeconds(0),
+          rxFirstMicroSeconds(0),
+          rxLastSeconds(0),
+          rxLastMicroSeconds(0) {};
     
     uint32_t scanId;
     uint32_t timeStartSeconds;
@@ -320,6 +481,15 @@ public:
 
     const RangeType     *rangesP;       // millimeters
     const IntensityType *intensitiesP;  // device units
+
+    //
+    // Receive times of the scan's first and last datagrams, as for
+    // image::Header
+
+    uint32_t rxFirstSeconds;
+    uint32_t rxFirstMicroSeconds;
+    uint32_t rxLastSeconds;
+    uint32_t rxLastMicroSeconds;
 };
 
 //
@@ -396,6 +566,14 @@ private:
     std::vector<float> m_dutyCycle;
 };    
 
+//
+// Function pointer for the completion of Channel::getLightingConfigAsync().
+// The configuration is only valid if status is Status_Ok.
+
+typedef void (*ConfigCallback)(Status        status,
+                               const Config& config,
+                               void         *userDataP);
+
 }; // namespace lighting
 
 namespace pps {
@@ -457,8 +635,25 @@ public:
 class Header : public HeaderBase {
 public:
 
+    Header()
+        : sequence(0),
+          samples(),
+          rxFirstSeconds(0),
+          rxFirstMicroSeconds(0),
+          rxLastSeconds(0),
+          rxLastMicroSeconds(0) {};
+
     uint32_t            sequence;
     std::vector<Sample> samples;
+
+    //
+    // Receive times of the message's first and last datagrams, as for
+    // image::Header
+
+    uint32_t            rxFirstSeconds;
+    uint32_t            rxFirstMicroSeconds;
+    uint32_t            rxLastSeconds;
+    uint32_t            rxLastMicroSeconds;
 };
 
 //
@@ -640,6 +835,119 @@ public:
         ipv4Netmask(n) {};
 };
 
+//
+// Channel statistics, for diagnosing host-side performance.
+//
+// Counters are cumulative from channel creation.
+
+class BufferPoolStatistics {
+public:
+
+    uint32_t bufferSize;      // bytes
+    uint32_t bufferCount;
+    uint32_t buffersInUse;    // by reassembly or by consumers
+    uint32_t highWaterMark;   // most buffers ever in use at once
+    uint64_t exhaustedEvents; // times a buffer was wanted but none was free
+    uint32_t arenaFlags;      // RxArena_* placement actually achieved
+
+    BufferPoolStatistics() :
+        bufferSize(0),
+        bufferCount(0),
+        buffersInUse(0),
+        highWaterMark(0),
+        exhaustedEvents(0),
+        arenaFlags(RxArena_Default) {};
+};
+
+class ChannelStatistics {
+public:
+
+    //
+    // Datagram reception. 'rxBatchHistogram[n]' is the number of
+    // receive system calls that returned 'n' datagrams.
+
+    uint64_t              rxSystemCalls;
+    uint64_t              rxDatagrams;
+    std::vector<uint64_t> rxBatchHistogram;
+
+    //
+    // Zero-copy reception. Datagrams whose payload was received
+    // directly into the reassembly buffer, and datagrams that were
+    // expected to be but had to be copied after all.
+
+    uint64_t              rxZeroCopyDatagrams;
+    uint64_t              rxZeroCopyMisses;
+
+    //
+    // Out-of-order reception. Datagrams that arrived before the first
+    // datagram of their message and had to be held back, and repeated
+    // datagrams that were ignored.
+
+    uint64_t              rxDeferredDatagrams;
+    uint64_t              rxDuplicateDatagrams;
+
+    //
+    // RX buffer pools, smallest buffers first. Pools are sized from
+    // the imager resolution and enabled streams; messages that no
+    // pool is sized for are given a one-off allocation.
+
+    std::vector<BufferPoolStatistics> rxBufferPools;
+    uint64_t                          rxOneOffAllocations;
+
+    //
+    // RxBackend_PacketRing only: datagrams passed to us through the
+    // ring, and those the kernel dropped because the ring was full.
+
+    uint64_t                          rxRingPackets;
+    uint64_t                          rxRingDrops;
+
+    ChannelStatistics() :
+        rxSystemCalls(0),
+        rxDatagrams(0),
+        rxBatchHistogram(),
+        rxZeroCopyDatagrams(0),
+        rxZeroCopyMisses(0),
+        rxDeferredDatagrams(0),
+        rxDuplicateDatagrams(0),
+        rxBufferPools(),
+        rxOneOffAllocations(0),
+        rxRingPackets(0),
+        rxRingDrops(0) {};
+};
+
+//
+// What sensor timestamps are currently mapped to local time from
+
+typedef uint32_t TimeSyncSource;
+
+static const TimeSyncSource TimeSync_None    = 0; // not mapped, in the sensor's clock
+static const TimeSyncSource TimeSync_Network = 1; // status request round trips
+static const TimeSyncSource TimeSync_Pps     = 2; // paired sensor and host PPS edges
+
+//
+// The current mapping, local = sensor + offset + skew * (sensor - center),
+// and how well it fits the probes (or PPS edge pairs) it was fit to.
+// 'residual' is the RMS of their distances from the fit.
+
+class TimeSyncStatus {
+public:
+
+    TimeSyncSource source;
+    double         offset;   // seconds
+    double         skew;     // seconds per second
+    double         center;   // sensor seconds
+    double         residual; // seconds
+    uint32_t       samples;  // fit to
+
+    TimeSyncStatus() :
+        source(TimeSync_None),
+        offset(0.0),
+        skew(0.0),
+        center(0.0),
+        residual(0.0),
+        samples(0) {};
+};
+
 
 }; // namespace system
 }; // namespace multisense
@@ -33,13 +33,25 @@
 #include "details/wire/StatusRequestMessage.h"
 #include "details/wire/StatusResponseMessage.h"
 #include "details/wire/VersionRequestMessage.h"
+#include "details/wire/CamGetConfigMessage.h"
+#include "details/wire/CamConfigMessage.h"
 #include "details/wire/SysDeviceInfoMessage.h"
 
-#include "details/utility/Functional.hh"
+#include "details/utility/Unpack.hh"
 
 #include <netdb.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <linux/pps.h>
+#include <sys/ioctl.h>
+#include <math.h>
+
+#include <algorithm>
 
 namespace crl {
 namespace multisense {
@@ -48,37 +60,88 @@ namespace details {
 //
 // Implementation constructor
 
-impl::impl(const std::string& address) :
+impl::impl(const std::string& address,
+           RxBackend          backend) :
     m_serverSocket(-1),
     m_serverSocketPort(0),
+    m_rxBackend(backend),
+    m_ringSocket(-1),
+    m_ringP(NULL),
+    m_ringBlockIndex(0),
+    m_ringPackets(0),
+    m_ringDrops(0),
     m_sensorAddress(),
     m_sensorMtu(MAX_MTU_SIZE),
-    m_incomingBuffer(MAX_MTU_SIZE),
+    m_incomingBuffer(MAX_MTU_SIZE * RX_BATCH_DEPTH),
+    m_rxIovecs(RX_BATCH_DEPTH * RX_SLOT_IOVECS),
+    m_rxControl(RX_BATCH_DEPTH * RX_CONTROL_SIZE),
+    m_rxMessages(RX_BATCH_DEPTH),
+    m_rxPredictionValid(false),
+    m_rxPredictedSequence(0),
+    m_rxPredictedWireSequence(0),
+    m_rxPredictedOffset(0),
+    m_rxPredictedStride(0),
+    m_rxPredictedLength(0),
+    m_rxPredictedStream(),
+    m_statisticsLock(),
+    m_rxSystemCalls(0),
+    m_rxDatagrams(0),
+    m_rxBatchHistogram(RX_BATCH_DEPTH + 1, 0),
+    m_rxZeroCopyDatagrams(0),
+    m_rxZeroCopyMisses(0),
+    m_rxDeferredDatagrams(0),
+    m_rxDuplicateDatagrams(0),
     m_txSeqId(0),
     m_lastRxSeqId(-1),
     m_unWrappedRxSeqId(0),
-    m_udpTrackerCache(UDP_TRACKER_CACHE_DEPTH, 0),
-    m_rxLargeBufferPool(),
+    m_udpTrackerCache(UDP_TRACKER_CACHE_DEPTH),
     m_rxSmallBufferPool(),
-    m_imageMetaCache(IMAGE_META_CACHE_DEPTH, 0),
+    m_rxLargeBufferPools(),
+    m_rxPoolAutoTune(true),
+    m_rxArenaFlags(RxArena_Default),
+    m_rxNumaNode(-1),
+    m_rxImageWidth(0),
+    m_rxImageHeight(0),
+    m_rxOneOffAllocations(0),
+    m_imageMetaCache(IMAGE_META_CACHE_DEPTH),
     m_udpAssemblerMap(),
     m_dispatchLock(),
     m_streamLock(),
     m_threadsRunning(false),
     m_rxThreadP(NULL),
     m_rxLock(),
+    m_rxEpollFd(-1),
+    m_rxPollMode(RxPoll_Blocking),
+    m_rxSpinMicroseconds(DEFAULT_RX_SPIN_US),
     m_statusThreadP(NULL),
+    m_commandThreadP(NULL),
+    m_asyncCommands(),
+    m_asyncLock(),
+    m_imageConverter(),
     m_imageListeners(),
     m_lidarListeners(),
     m_ppsListeners(),
     m_imuListeners(),
-    m_watch(),
+    m_frameSetListeners(),
+    m_dispatchPolicy(),
+    m_watch(DEFAULT_ACK_TIMEOUT * DEFAULT_ACK_ATTEMPTS),
+    m_commandLock(),
     m_messages(),
     m_streamsEnabled(0),
     m_timeLock(),
-    m_timeOffsetInit(false),
-    m_timeOffset(0),
+    m_clockModel(TIME_SYNC_WINDOW),
+    m_timeMapping(),
     m_networkTimeSyncEnabled(true),
+    m_timeSyncRate(DEFAULT_TIME_SYNC_RATE),
+    m_ppsModel(TIME_SYNC_PPS_WINDOW),
+    m_timeSyncSource(system::TimeSync_None),
+    m_ppsDevice(-1),
+    m_ppsSequence(0),
+    m_ppsSensorEdge(-1.0),
+    m_ppsHostEdge(-1.0),
+    m_ppsLastPaired(0.0),
+    m_statusArrival(0.0),
+    m_imuTimes(),
     m_sensorVersion()
 {
     //
@@ -102,28 +165,44 @@ impl::impl(const std::string& address) :
     m_sensorAddress.sin_addr   = addr;
 
     //
-    // Create a pool of RX buffers
+    // Point each batched receive descriptor at its own MTU-sized slot,
+    // and its own ancillary data
 
-    for(uint32_t i=0; i<RX_POOL_LARGE_BUFFER_COUNT; i++)
-        m_rxLargeBufferPool.push_back(new utility::BufferStreamWriter(RX_POOL_LARGE_BUFFER_SIZE));
-    for(uint32_t i=0; i<RX_POOL_SMALL_BUFFER_COUNT; i++)
-        m_rxSmallBufferPool.push_back(new utility::BufferStreamWriter(RX_POOL_SMALL_BUFFER_SIZE));
+    for(uint32_t i=0; i<RX_BATCH_DEPTH; i++) {
 
-    //
-    // Bind to the port
+        struct iovec *iovP = &(m_rxIovecs[i * RX_SLOT_IOVECS]);
 
-    bind();
+        iovP->iov_base = &(m_incomingBuffer[i * MAX_MTU_SIZE]);
+        iovP->iov_len  = MAX_MTU_SIZE;
+
+        memset(&(m_rxMessages[i]), 0, sizeof(struct mmsghdr));
+        m_rxMessages[i].msg_hdr.msg_iov        = iovP;
+        m_rxMessages[i].msg_hdr.msg_iovlen     = 1;
+        m_rxMessages[i].msg_hdr.msg_control    = &(m_rxControl[i * RX_CONTROL_SIZE]);
+        m_rxMessages[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+    }
 
     //
-    // Register any special UDP reassemblers
+    // Create a pool of RX buffers, and bind to the port (which may
+    // fail part way, for example without CAP_NET_RAW for the ring)
 
-    m_udpAssemblerMap[MSG_ID(wire::Disparity::ID)] = wire::Disparity::assembler;
+    try {
+
+        m_rxSmallBufferPool.create(RX_POOL_SMALL_BUFFER_COUNT, RX_POOL_SMALL_BUFFER_SIZE);
+
+        bind();
+
+    } catch (...) {
+        cleanup();
+        throw;
+    }
 
     //
     // Create UDP reception thread
 
     m_threadsRunning = true;
     m_rxThreadP      = new utility::Thread(rxThread, this);
+    m_rxThreadP->setName("ms-rx");
 
     //
     // Request the current operating MTU of the device
@@ -144,9 +223,24 @@ impl::impl(const std::string& address) :
     }
 
     //
-    // Request version info from the device
-    
-    status = waitData(wire::VersionRequest(), m_sensorVersion);
+    // Request version info and the imager configuration together. The
+    // latter sizes the large RX buffer pools for the current resolution.
+
+    wire::CamConfig camConfig;
+    Status          configStatus;
+
+    try {
+        Pending versionQuery(*this, wire::VersionRequest(), m_sensorVersion);
+        Pending configQuery (*this, wire::CamGetConfig(),   camConfig);
+
+        status       = versionQuery.wait();
+        configStatus = configQuery.wait();
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        status = configStatus = Status_Exception;
+    }
+
     if (Status_Ok != status) {
         cleanup();
         CRL_EXCEPTION("failed to request version info from sensor at \"%s\"",
@@ -154,9 +248,32 @@ impl::impl(const std::string& address) :
     }
 
     //
-    // Create status thread
+    // The RX thread is running, so nothing may escape from here on
+    // without stopping it.
+
+    try {
+
+        if (Status_Ok == configStatus)
+            setImageResolution(camConfig.width, camConfig.height);
+        else
+            CRL_DEBUG("unable to query image configuration, RX buffers will be sized on demand\n");
+
+        //
+        // Create status thread
+
+        m_statusThreadP = new utility::Thread(statusThread, this);
+        m_statusThreadP->setName("ms-status");
 
-    m_statusThreadP = new utility::Thread(statusThread, this);
+        //
+        // Create asynchronous command thread
+
+        m_commandThreadP = new utility::Thread(commandThread, this);
+        m_commandThreadP->setName("ms-command");
+
+    } catch (...) {
+        cleanup();
+        throw;
+    }
 }
 
 //
@@ -164,46 +281,65 @@ impl::impl(const std::string& address) :
 
 void impl::cleanup()
 {
-    m_threadsRunning = false;
+    {
+        utility::ScopedLock lock(m_asyncLock);
+        m_threadsRunning = false;
+    }
+
+    //
+    // Let any command in progress finish first, it needs the RX thread
+
+    if (m_commandThreadP) {
+        m_asyncCommands.kick();
+        delete m_commandThreadP;
+    }
+
+    //
+    // Nothing can be queued now; complete whatever was left
+
+    AsyncCommand *commandP;
+    while(m_asyncCommands.size() > 0 && m_asyncCommands.wait(commandP)) {
+
+        try {
+            commandP->cancel();
+        } catch (const std::exception& e) {
+            CRL_DEBUG("exception: %s\n", e.what());
+        } catch (...) {
+            CRL_DEBUG("unknown exception\n");
+        }
+
+        delete commandP;
+    }
 
     if (m_rxThreadP)
         delete m_rxThreadP;
     if (m_statusThreadP)
         delete m_statusThreadP;
 
-    std::list<ImageListener*>::const_iterator iti;
-    for(iti  = m_imageListeners.begin();
-        iti != m_imageListeners.end();
-        iti ++)
-        delete *iti;
-    std::list<LidarListener*>::const_iterator itl;
-    for(itl  = m_lidarListeners.begin();
-        itl != m_lidarListeners.end();
-        itl ++)
-        delete *itl;
-    std::list<PpsListener*>::const_iterator itp;
-    for(itp  = m_ppsListeners.begin();
-        itp != m_ppsListeners.end();
-        itp ++)
-        delete *itp;
-    std::list<ImuListener*>::const_iterator itm;
-    for(itm  = m_imuListeners.begin();
-        itm != m_imuListeners.end();
-        itm ++)
-        delete *itm;
-
-    BufferPool::const_iterator it;
-    for(it  = m_rxLargeBufferPool.begin();
-        it != m_rxLargeBufferPool.end();
-        ++it)
-        delete *it;
-    for(it  = m_rxSmallBufferPool.begin();
-        it != m_rxSmallBufferPool.end();
-        ++it)
-        delete *it;
+    m_imageListeners.clear();
+    m_lidarListeners.clear();
+    m_ppsListeners.clear();
+    m_imuListeners.clear();
+    m_frameSetListeners.clear();
+
+    resetPrediction();
+
+    m_rxSmallBufferPool.clear();
+
+    for(uint32_t i=0; i<m_rxLargeBufferPools.size(); i++)
+        delete m_rxLargeBufferPools[i];
+    m_rxLargeBufferPools.clear();
 
+    if (m_rxEpollFd >= 0)
+        close(m_rxEpollFd);
+    if (m_ringP)
+        munmap(m_ringP, RX_RING_BLOCK_SIZE * RX_RING_BLOCK_COUNT);
+    if (m_ringSocket >= 0)
+        close(m_ringSocket);
     if (m_serverSocket > 0)
         close(m_serverSocket);
+    if (m_ppsDevice >= 0)
+        close(m_ppsDevice);
 }
 
 //
@@ -259,6 +395,17 @@ void impl::bind()
         CRL_EXCEPTION("failed to adjust socket buffer sizes (%d bytes): %s",
                       bufferSize, strerror(errno));
 
+    //
+    // Have the kernel timestamp each datagram as it is received. Data
+    // headers then report zero arrival times if it can not.
+
+    int timestamps = 1;
+
+    if (0 != setsockopt(m_serverSocket, SOL_SOCKET, SO_TIMESTAMPNS, (void*) &timestamps,
+                        sizeof(timestamps)))
+        CRL_DEBUG("failed to enable receive timestamps: %s\n",
+                  strerror(errno));
+
     //
     // Bind the connection to the port.
 
@@ -279,12 +426,143 @@ void impl::bind()
     if (0 != getsockname(m_serverSocket, (struct sockaddr*) &address, &len))
         CRL_EXCEPTION("getsockname() failed: %s", strerror(errno));
     m_serverSocketPort = htons(address.sin_port);
+
+    //
+    // Optionally receive through a packet ring instead
+
+    if (RxBackend_PacketRing == m_rxBackend)
+        bindRing();
+
+    const int32_t rxSocket = (RxBackend_PacketRing == m_rxBackend) ? m_ringSocket : m_serverSocket;
+
+    //
+    // The reception thread waits on the socket through epoll
+
+    m_rxEpollFd = epoll_create(1);
+    if (m_rxEpollFd < 0)
+        CRL_EXCEPTION("epoll_create() failed: %s", strerror(errno));
+
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events  = EPOLLIN;
+    event.data.fd = rxSocket;
+
+    if (0 != epoll_ctl(m_rxEpollFd, EPOLL_CTL_ADD, rxSocket, &event))
+        CRL_EXCEPTION("epoll_ctl() failed: %s", strerror(errno));
 }
 
 //
-// Publish a stream to the sensor
+// Set up an AF_PACKET TPACKET_V3 ring that receives the sensor's
+// datagrams to our UDP port, then silence the UDP socket.
 
-void impl::publish(const utility::BufferStreamWriter& stream)
+void impl::bindRing()
+{
+    //
+    // Open the packet socket without a protocol, so that nothing is
+    // received until the filter and ring are in place.
+
+    m_ringSocket = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (m_ringSocket < 0)
+        CRL_EXCEPTION("failed to create the packet socket (CAP_NET_RAW required): %s",
+                      strerror(errno));
+
+    //
+    // Accept unfragmented UDP from the sensor to our port. A SOCK_DGRAM
+    // packet socket sees packets from the IP header on.
+
+    const uint32_t sensorAddress = ntohl(m_sensorAddress.sin_addr.s_addr);
+
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 9),                           // ip protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 8),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, 12),                          // ip source
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   sensorAddress, 0, 6),
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 6),                           // ip fragment
+        BPF_JUMP(BPF_JMP | BPF_JSET| BPF_K,   0x3fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 0),                           // ip header length
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 2),                           // udp destination
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   m_serverSocketPort, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K,             0x40000),                     // accept
+        BPF_STMT(BPF_RET | BPF_K,             0),                           // drop
+    };
+    struct sock_fprog filter = { sizeof(code) / sizeof(code[0]), code };
+
+    if (0 != setsockopt(m_ringSocket, SOL_SOCKET, SO_ATTACH_FILTER, 
+                        &filter, sizeof(filter)))
+        CRL_EXCEPTION("failed to attach the packet filter: %s", strerror(errno));
+
+    //
+    // Create and map the ring. Blocks are handed to us when full, or
+    // after RX_RING_BLOCK_TIMEOUT_MS so that sparse traffic is not held.
+
+    int version = TPACKET_V3;
+
+    if (0 != setsockopt(m_ringSocket, SOL_PACKET, PACKET_VERSION, 
+                        &version, sizeof(version)))
+        CRL_EXCEPTION("failed to select TPACKET_V3: %s", strerror(errno));
+
+    struct tpacket_req3 request;
+
+    memset(&request, 0, sizeof(request));
+    request.tp_block_size     = RX_RING_BLOCK_SIZE;
+    request.tp_block_nr       = RX_RING_BLOCK_COUNT;
+    request.tp_frame_size     = RX_RING_FRAME_SIZE;
+    request.tp_frame_nr       = (RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE) * RX_RING_BLOCK_COUNT;
+    request.tp_retire_blk_tov = RX_RING_BLOCK_TIMEOUT_MS;
+
+    if (0 != setsockopt(m_ringSocket, SOL_PACKET, PACKET_RX_RING,
+                        &request, sizeof(request)))
+        CRL_EXCEPTION("failed to create a %d byte packet ring: %s",
+                      RX_RING_BLOCK_SIZE * RX_RING_BLOCK_COUNT, strerror(errno));
+
+    void *ringP = mmap(NULL, RX_RING_BLOCK_SIZE * RX_RING_BLOCK_COUNT,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+                       m_ringSocket, 0);
+    if (MAP_FAILED == ringP)
+        ringP = mmap(NULL, RX_RING_BLOCK_SIZE * RX_RING_BLOCK_COUNT,
+                     PROT_READ | PROT_WRITE, MAP_SHARED,
+                     m_ringSocket, 0);
+    if (MAP_FAILED == ringP)
+        CRL_EXCEPTION("failed to map the packet ring: %s", strerror(errno));
+
+    m_ringP          = reinterpret_cast<uint8_t*>(ringP);
+    m_ringBlockIndex = 0;
+
+#ifdef PACKET_IGNORE_OUTGOING
+    int ignoreOutgoing = 1;
+    setsockopt(m_ringSocket, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+               &ignoreOutgoing, sizeof(ignoreOutgoing));
+#endif
+
+    //
+    // Start receiving IP on all interfaces
+
+    struct sockaddr_ll link;
+
+    memset(&link, 0, sizeof(link));
+    link.sll_family   = AF_PACKET;
+    link.sll_protocol = htons(ETH_P_IP);
+    link.sll_ifindex  = 0;
+
+    if (0 != ::bind(m_ringSocket, (struct sockaddr*) &link, sizeof(link)))
+        CRL_EXCEPTION("failed to bind the packet socket: %s", strerror(errno));
+
+    //
+    // The UDP socket would otherwise queue a second copy of everything
+
+    struct sock_filter dropAll[] = { BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct sock_fprog  none      = { 1, dropAll };
+
+    if (0 != setsockopt(m_serverSocket, SOL_SOCKET, SO_ATTACH_FILTER, 
+                        &none, sizeof(none)))
+        CRL_EXCEPTION("failed to silence the UDP socket: %s", strerror(errno));
+}
+
+//
+// Publish a stream to the sensor, returning its sequence ID
+
+uint16_t impl::publish(const utility::BufferStreamWriter& stream)
 {
     //
     // Install the header 
@@ -309,6 +587,86 @@ void impl::publish(const utility::BufferStreamWriter& stream)
     if (static_cast<size_t>(ret) != stream.tell())
         CRL_EXCEPTION("error sending data to sensor, %d/%d bytes written: %s", 
                       ret, stream.tell(), strerror(errno));
+
+    return header.sequenceIdentifier;
+}
+
+//
+// (Re)send a command. The watches are armed and the command sent with
+// m_commandLock held, so commands reach the sensor in the same order
+// as their watches are queued.
+
+void impl::Pending::send()
+{
+    utility::ScopedLock lock(m_channel.m_commandLock);
+
+    m_response.arm();
+    if (m_data)
+        m_command.arm();
+
+    m_response.sent();
+    m_channel.publish(m_stream);
+}
+
+//
+// Wait for the response to a command, re-sending if necessary. The
+// first attempt was sent on construction. While another command
+// waits behind this one for the same response, a timed-out attempt
+// just waits again.
+
+Status impl::Pending::wait(const double& timeout,
+                           int32_t       attempts)
+{
+    Status status = Status_TimedOut;
+
+    for(int32_t i=0; i<attempts; i++) {
+
+        if (i > 0 && false == m_response.queuedBehind() &&
+            (false == m_data || false == m_command.queuedBehind()))
+            send();
+
+        if (m_response.wait(status, timeout))
+            break;
+
+        status = Status_TimedOut;
+    }
+
+    if (false == m_data)
+        return status;
+
+    //
+    // Also check the response to the command. Do not block, as any
+    // response would be registered by this time.
+
+    Status commandStatus;
+    if (false == m_command.wait(commandStatus, 0.0))
+        commandStatus = Status_TimedOut;
+
+    //
+    // If we did not receive the data message, return the response from
+    // the command code instead, unless the command ack'd OK.
+
+    if (Status_Ok != status && Status_Ok != commandStatus)
+        return commandStatus;
+
+    return status;
+}
+
+//
+// Queue an asynchronous command, taking ownership of it
+
+Status impl::queueCommand(AsyncCommand *commandP)
+{
+    utility::ScopedLock lock(m_asyncLock);
+
+    if (false == m_threadsRunning) {
+        delete commandP;
+        return Status_Error;
+    }
+
+    m_asyncCommands.post(commandP);
+
+    return Status_Ok;
 }
 
 //
@@ -361,6 +719,28 @@ DataSource impl::sourceWireToApi(wire::SourceType mask)
     return api_mask;
 };
 
+uint32_t impl::arenaApiToUtility(RxArenaFlags f)
+{
+    uint32_t u = 0;
+
+    if (f & RxArena_HugePages) u |= utility::Arena::FLAG_HUGE_PAGES;
+    if (f & RxArena_Locked)    u |= utility::Arena::FLAG_LOCKED;
+    if (f & RxArena_NumaLocal) u |= utility::Arena::FLAG_NUMA_LOCAL;
+
+    return u;
+}
+
+RxArenaFlags impl::arenaUtilityToApi(uint32_t u)
+{
+    RxArenaFlags f = RxArena_Default;
+
+    if (u & utility::Arena::FLAG_HUGE_PAGES) f |= RxArena_HugePages;
+    if (u & utility::Arena::FLAG_LOCKED)     f |= RxArena_Locked;
+    if (u & utility::Arena::FLAG_NUMA_LOCAL) f |= RxArena_NumaLocal;
+
+    return f;
+}
+
 uint32_t impl::hardwareApiToWire(uint32_t a) 
 {
     switch(a) {
@@ -417,21 +797,107 @@ uint32_t impl::imagerWireToApi(uint32_t w)
 }
 
 //
-// Apply a time offset correction
+// Add a probe of the sensor clock to the network model
+
+void impl::addTimeSample(double sensorTime,
+                         double localTime,
+                         double roundTrip)
+{
+    utility::ScopedLock lock(m_timeLock);
+
+    m_clockModel.add(sensorTime, localTime, roundTrip);
+    publishTimeMapping();
+}
+
+//
+// Publish the fit of the PPS model while edges are being paired,
+// otherwise that of the network model. The PPS model is not used
+// until it has seen enough edges to fit the skew. Call with
+// m_timeLock held.
+
+void impl::publishTimeMapping()
+{
+    const double sincePaired = (utility::TimeStamp::getMonotonicTime() -
+                                m_ppsLastPaired);
+
+    if (m_ppsModel.valid() && sincePaired > TIME_SYNC_PPS_TIMEOUT) {
+        CRL_DEBUG("no PPS edges paired for %.1f seconds, using network time sync\n",
+                  sincePaired);
+        m_ppsModel.reset();
+    }
+
+    if (m_ppsModel.fitted() >= TIME_SYNC_PPS_MIN_EDGES) {
+        m_timeSyncSource = system::TimeSync_Pps;
+        m_timeMapping.store(m_ppsModel.mapping());
+    } else if (m_clockModel.valid()) {
+        m_timeSyncSource = system::TimeSync_Network;
+        m_timeMapping.store(m_clockModel.mapping());
+    }
+}
+
+//
+// The sensor's PPS event, in the RX thread. The host's edge of the
+// same pulse has already been timestamped by the kernel, if it
+// comes from a PPS device.
 
-void impl::applySensorTimeOffset(const double& offset)
+void impl::addSensorPpsEdge(int64_t nanoSeconds)
 {
     utility::ScopedLock lock(m_timeLock);
 
-    if (false == m_timeOffsetInit) {
-        m_timeOffset     = offset; // seed
-        m_timeOffsetInit = true;
+    m_ppsSensorEdge = static_cast<double>(nanoSeconds) / 1e9;
+
+    fetchHostPpsEdge();
+    pairPpsEdges();
+}
+
+//
+// Read the latest assert edge from the host's PPS device, without
+// waiting. Call with m_timeLock held.
+
+void impl::fetchHostPpsEdge()
+{
+    if (m_ppsDevice < 0)
+        return;
+
+    struct pps_fdata fetch;
+
+    memset(&fetch, 0, sizeof(fetch));
+
+    if (0 != ioctl(m_ppsDevice, PPS_FETCH, &fetch)) {
+        CRL_DEBUG("PPS_FETCH failed: %s\n", strerror(errno));
         return;
     }
-    
-    const double samples = static_cast<double>(TIME_SYNC_OFFSET_DECAY);
 
-    m_timeOffset = utility::decayedAverage(m_timeOffset, samples, offset);
+    if (fetch.info.assert_sequence == m_ppsSequence)
+        return;
+
+    m_ppsSequence = fetch.info.assert_sequence;
+    m_ppsHostEdge = (static_cast<double>(fetch.info.assert_tu.sec) +
+                     1e-9 * static_cast<double>(fetch.info.assert_tu.nsec));
+}
+
+//
+// Pair the latest sensor and host edges if they are of the same pulse,
+// judged by the network model. Call with m_timeLock held.
+
+void impl::pairPpsEdges()
+{
+    if (m_ppsSensorEdge < 0.0 || m_ppsHostEdge < 0.0 ||
+        false == m_clockModel.valid())
+        return;
+
+    const double error = m_ppsHostEdge - m_clockModel.toLocal(m_ppsSensorEdge);
+
+    if (fabs(error) > TIME_SYNC_PPS_MATCH)
+        return;
+
+    m_ppsModel.add(m_ppsSensorEdge, m_ppsHostEdge, 0.0);
+
+    m_ppsLastPaired = utility::TimeStamp::getMonotonicTime();
+    m_ppsSensorEdge = -1.0;
+    m_ppsHostEdge   = -1.0;
+
+    publishTimeMapping();
 }
 
 //
@@ -439,8 +905,7 @@ void impl::applySensorTimeOffset(const double& offset)
 
 double impl::sensorToLocalTime(const double& sensorTime)
 {
-    utility::ScopedLock lock(m_timeLock);
-    return m_timeOffset + sensorTime;
+    return m_timeMapping.load().toLocal(sensorTime);
 }
 
 //
@@ -450,9 +915,30 @@ void impl::sensorToLocalTime(const double& sensorTime,
                              uint32_t&     seconds,
                              uint32_t&     microseconds)
 {
-    double corrected = sensorToLocalTime(sensorTime);
-    seconds          = static_cast<uint32_t>(corrected);
-    microseconds     = static_cast<uint32_t>(1e6 * (corrected - static_cast<double>(seconds)));
+    splitTime(sensorToLocalTime(sensorTime), seconds, microseconds);
+}
+
+//
+// Correct an array of times in place, against a single fit
+
+void impl::sensorToLocalTimes(double   *timesP,
+                              uint32_t  count)
+{
+    const utility::ClockModel::Mapping mapping = m_timeMapping.load();
+
+    for(uint32_t i=0; i<count; i++)
+        timesP[i] = mapping.toLocal(timesP[i]);
+}
+
+//
+// Split a time into seconds/microseconds
+
+void impl::splitTime(const double& time,
+                     uint32_t&     seconds,
+                     uint32_t&     microseconds)
+{
+    seconds      = static_cast<uint32_t>(time);
+    microseconds = static_cast<uint32_t>(1e6 * (time - static_cast<double>(seconds)));
 }
 
 //
@@ -470,43 +956,49 @@ void *impl::statusThread(void *userDataP)
         try {
 
             //
-            // Setup handler for the status response
+            // Send the status request, recording the (approx) local time.
+            // The round trip is measured on the raw monotonic clock, which
+            // is not slewed by NTP mid-probe.
 
-            ScopedWatch ack(wire::StatusResponse::ID, selfP->m_watch);
+            wire::StatusResponse msg;
 
-            //
-            // Send the status request, recording the (approx) local time
-
-            const double ping = utility::TimeStamp::getCurrentTime();
-            selfP->publish(wire::StatusRequest());
+            const double pingRaw = utility::TimeStamp::getMonotonicRawTime();
+            const double ping    = utility::TimeStamp::getCurrentTime();
+            Pending request(*selfP, wire::StatusRequest(), msg);
 
             //
             // Wait for the response
 
-            Status status;
-            if (ack.wait(status, 0.010)) {
-
-                //
-                // Record (approx) time of response
+            if (Status_Ok == request.wait(0.010, 1)) {
 
-                const double pong = utility::TimeStamp::getCurrentTime();
+                const double pong      = utility::TimeStamp::getCurrentTime();
+                double       roundTrip = utility::TimeStamp::getMonotonicRawTime() - pingRaw;
 
                 //
-                // Extract the response payload
+                // Take out the time between the kernel receiving the
+                // response (a realtime stamp) and this thread waking up
+                // to it. The round trip itself stays on the raw clock;
+                // only this short realtime interval is subtracted, and
+                // it is ignored if a stale arrival time or a clock step
+                // puts it out of range.
 
-                wire::StatusResponse msg;
-                selfP->m_messages.extract(msg);
+                double arrival;
+                {
+                    utility::ScopedLock lock(selfP->m_timeLock);
+                    arrival = selfP->m_statusArrival;
+                }
 
-                //
-                // Estimate 'msg.uptime' capture using half of the round trip period
+                const double wakeUp = pong - arrival;
 
-                const double latency = (pong - ping) / 2.0;
+                if (arrival > ping && wakeUp >= 0.0 && wakeUp < roundTrip)
+                    roundTrip = std::max(roundTrip - wakeUp, 0.0);
 
                 //
-                // Compute and apply the estimated time offset
+                // Estimate 'msg.uptime' capture using half of the round trip period
 
-                const double offset = (ping + latency) - static_cast<double>(msg.uptime);
-                selfP->applySensorTimeOffset(offset);
+                selfP->addTimeSample(static_cast<double>(msg.uptime),
+                                     ping + roundTrip / 2.0,
+                                     roundTrip);
             }
         
         } catch (const std::exception& e) {
@@ -519,21 +1011,134 @@ void *impl::statusThread(void *userDataP)
         }
 
         //
-        // Recompute offset at ~1Hz
+        // Probe again at the configured rate, in short sleeps so that
+        // shutdown is not held up
+
+        double remaining = 1.0 / selfP->m_timeSyncRate;
 
-        usleep(1e6);
+        while(selfP->m_threadsRunning && remaining > 0.0) {
+            const double slice = std::min(remaining, 0.1);
+            usleep(static_cast<useconds_t>(1e6 * slice));
+            remaining -= slice;
+        }
     }
 
     return NULL;
 }
 
+//
+// An internal thread for asynchronous commands
+
+void *impl::commandThread(void *userDataP)
+{
+    impl *selfP = reinterpret_cast<impl*>(userDataP);
+
+    //
+    // Loop until shutdown
+
+    while(selfP->m_threadsRunning) {
+
+        AsyncCommand *commandP;
+
+        if (false == selfP->m_asyncCommands.wait(commandP))
+            continue;
+
+        //
+        // The command itself completes with Status_Exception if it
+        // throws; this catches a throwing completion callback
+
+        try {
+
+            commandP->run(*selfP);
+
+        } catch (const std::exception& e) {
+
+            CRL_DEBUG("exception: %s\n", e.what());
+
+        } catch (...) {
+
+            CRL_DEBUG("unknown exception\n");
+        }
+
+        delete commandP;
+    }
+
+    return NULL;
+}
+
+namespace {
+
+//
+// Disparity unpacking, see Channel::unpackDisparity()
+
+void unpackPixels(const uint8_t *sP, uint16_t *dP, uint32_t count) { utility::unpack12To16(sP, dP, count);    }
+void unpackPixels(const uint8_t *sP, float    *dP, uint32_t count) { utility::unpack12ToFloat(sP, dP, count); }
+
+void convertPixel(uint32_t value, uint16_t& pixel) { pixel = value;                               }
+void convertPixel(uint32_t value, float&    pixel) { pixel = static_cast<float>(value) / 16.0f; }
+
+template<typename T>
+Status unpackDisparityRegion(const image::Header& header,
+                             T                   *dataP,
+                             uint32_t             firstRow,
+                             uint32_t             rowCount,
+                             uint32_t             decimation)
+{
+    if (0 == (header.source & (Source_Disparity | Source_Disparity_Right)) ||
+        wire::Disparity::WIRE_BITS_PER_PIXEL != header.bitsPerPixel       ||
+        NULL == header.imageDataP || NULL == dataP                        ||
+        0 == decimation || firstRow >= header.height)
+        return Status_Error;
+
+    if (0 == rowCount || rowCount > (header.height - firstRow))
+        rowCount = header.height - firstRow;
+
+    const uint8_t  *sP    = reinterpret_cast<const uint8_t*>(header.imageDataP);
+    const uint32_t  width = header.width;
+
+    if (header.imageLength < wire::Disparity::packedLength(width, firstRow + rowCount))
+        return Status_Error;
+
+    //
+    // Whole rows of an even width start on a byte boundary, and are
+    // handed to the vector kernels in one go
+
+    if (1 == decimation && 0 == (width % 2)) {
+
+        unpackPixels(sP + (firstRow * width / 2) * 3, dataP, rowCount * width);
+        return Status_Ok;
+    }
+
+    for(uint32_t y=firstRow; y<(firstRow + rowCount); y+=decimation)
+        for(uint32_t x=0; x<width; x+=decimation) {
+
+            const uint32_t  i = (y * width) + x;
+            const uint8_t  *pP = sP + (i / 2) * 3;
+
+            if (0 == (i % 2))
+                convertPixel(pP[0] | ((pP[1] & 0x0F) << 8), *dataP++);
+            else
+                convertPixel((pP[1] >> 4) | (pP[2] << 4), *dataP++);
+        }
+
+    return Status_Ok;
+}
+
+}; // anonymous
+
 }; // namespace details
 
 Channel* Channel::Create(const std::string& address)
+{
+    return Create(address, RxBackend_Socket);
+}
+
+Channel* Channel::Create(const std::string& address,
+                         RxBackend          backend)
 {
     try {
 
-        return new details::impl(address);
+        return new details::impl(address, backend);
 
     } catch (const std::exception& e) {
 
@@ -570,5 +1175,39 @@ const char *Channel::statusString(Status status)
     return "Unknown Error";
 }
 
+Status Channel::unpackDisparity(const image::Header& header,
+                                uint16_t            *dataP,
+                                uint32_t             firstRow,
+                                uint32_t             rowCount,
+                                uint32_t             decimation)
+{
+    return details::unpackDisparityRegion(header, dataP, firstRow, rowCount, decimation);
+}
+
+Status Channel::unpackDisparity(const image::Header& header,
+                                float               *dataP,
+                                uint32_t             firstRow,
+                                uint32_t             rowCount,
+                                uint32_t             decimation)
+{
+    return details::unpackDisparityRegion(header, dataP, firstRow, rowCount, decimation);
+}
+
+//
+// Configure the shared callback threads
+
+Status Channel::setCallbackThreads(uint32_t            threads,
+                                   const ThreadPolicy& policy)
+{
+    try {
+
+        return details::WorkerPool::configure(threads, policy);
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+}
+
 }; // namespace multisense
 }; // namespace crl
@@ -30,15 +30,21 @@
 
 #include "details/utility/Thread.hh"
 #include "details/utility/BufferStream.hh"
+#include "details/utility/BufferPool.hh"
 #include "details/utility/Units.hh"
+#include "details/utility/ClockModel.hh"
+#include "details/utility/SeqLock.hh"
 #include "details/listeners.hh"
+#include "details/frameset.hh"
 #include "details/signal.hh"
 #include "details/storage.hh"
+#include "details/tracker.hh"
 #include "details/wire/Protocol.h"
 #include "details/wire/ImageMetaMessage.h"
 #include "details/wire/VersionResponseMessage.h"
 
 #include <netinet/ip.h>
+#include <sys/socket.h>
 
 #include <unistd.h>
 #include <vector>
@@ -61,7 +67,8 @@ public:
     //
     // Construction
 
-    impl(const std::string& address);
+    impl(const std::string& address,
+         RxBackend          backend=RxBackend_Socket);
     ~impl();
 
     //
@@ -70,6 +77,10 @@ public:
     virtual Status addIsolatedCallback   (image::Callback callback,
                                           DataSource      imageSourceMask,
                                           void           *userDataP);
+    virtual Status addIsolatedCallback   (image::Callback callback,
+                                          DataSource      imageSourceMask,
+                                          void           *userDataP,
+                                          CallbackFlags   flags);
     virtual Status addIsolatedCallback   (lidar::Callback callback,
                                           void           *userDataP);
     virtual Status addIsolatedCallback   (pps::Callback   callback,
@@ -77,19 +88,57 @@ public:
     virtual Status addIsolatedCallback   (imu::Callback   callback,
                                           void           *userDataP);
 
+    virtual Status addIsolatedCallback   (image::Callback      callback,
+                                          DataSource           imageSourceMask,
+                                          void                *userDataP,
+                                          CallbackFlags        flags,
+                                          const CallbackQueue& queue);
+    virtual Status addIsolatedCallback   (lidar::Callback      callback,
+                                          void                *userDataP,
+                                          const CallbackQueue& queue);
+    virtual Status addIsolatedCallback   (pps::Callback        callback,
+                                          void                *userDataP,
+                                          const CallbackQueue& queue);
+    virtual Status addIsolatedCallback   (imu::Callback        callback,
+                                          void                *userDataP,
+                                          const CallbackQueue& queue);
+
+    virtual Status addIsolatedCallback   (image::FrameSetCallback callback,
+                                          DataSource              sourceMask,
+                                          void                   *userDataP,
+                                          double                  timeout,
+                                          CallbackFlags           flags);
+
     virtual Status removeIsolatedCallback(image::Callback callback);
     virtual Status removeIsolatedCallback(lidar::Callback callback);
     virtual Status removeIsolatedCallback(pps::Callback   callback);
     virtual Status removeIsolatedCallback(imu::Callback   callback);
+    virtual Status removeIsolatedCallback(image::FrameSetCallback callback);
+
+    virtual Status getCallbackDrops      (image::Callback callback,
+                                          uint64_t&       drops);
+    virtual Status getCallbackDrops      (lidar::Callback callback,
+                                          uint64_t&       drops);
+    virtual Status getCallbackDrops      (pps::Callback   callback,
+                                          uint64_t&       drops);
+    virtual Status getCallbackDrops      (imu::Callback   callback,
+                                          uint64_t&       drops);
+    virtual Status getCallbackDrops      (image::FrameSetCallback callback,
+                                          uint64_t&               drops);
 
     virtual void*  reserveCallbackBuffer ();
     virtual Status releaseCallbackBuffer (void *referenceP);
 
     virtual Status networkTimeSynchronization(bool enabled);
+    virtual Status setNetworkTimeSyncRate    (double hz);
+    virtual Status setHostPpsDevice          (const std::string& device);
+    virtual Status addHostPpsEdge            (double seconds);
+    virtual Status getTimeSyncStatus         (system::TimeSyncStatus& status);
 
     virtual Status startStreams          (DataSource mask);
     virtual Status stopStreams           (DataSource mask);
     virtual Status getEnabledStreams     (DataSource& mask);
+    virtual Status getSubscribedSources  (DataSource& mask);
 
     virtual Status startDirectedStream   (const DirectedStream& stream);
     virtual Status stopDirectedStream    (const DirectedStream& stream);
@@ -118,6 +167,18 @@ public:
 
     virtual Status getImageHistogram     (int64_t frameId, image::Histogram& histogram);
 
+    virtual Status getLightingConfigAsync(lighting::ConfigCallback callback,
+                                          void                    *userDataP);
+    virtual Status setLightingConfigAsync(const lighting::Config&  c,
+                                          CompletionCallback       callback,
+                                          void                    *userDataP);
+
+    virtual Status getImageConfigAsync   (image::ConfigCallback    callback,
+                                          void                    *userDataP);
+    virtual Status setImageConfigAsync   (const image::Config&     c,
+                                          CompletionCallback       callback,
+                                          void                    *userDataP);
+
     virtual Status getDeviceModes        (std::vector<system::DeviceMode>& modes);
 
     virtual Status getMtu                (int32_t& mtu);
@@ -150,15 +211,18 @@ public:
                                           uint32_t                     bufferSize);
     virtual Status getLocalUdpPort       (uint16_t& port);
 
-private:
+    virtual Status getChannelStatistics  (system::ChannelStatistics& s);
 
-    //
-    // A handler prototype for custom UDP datagram reassembly
+    virtual Status setRxPollMode         (RxPollMode mode,
+                                          uint32_t   spinMicroseconds);
+    virtual Status getRxPollMode         (RxPollMode& mode,
+                                          uint32_t&   spinMicroseconds);
+    virtual Status setThreadPolicy       (ThreadRole          role,
+                                          const ThreadPolicy& policy);
+
+    virtual Status setRxBufferArena      (RxArenaFlags flags);
 
-    typedef void (*UdpAssembler)(utility::BufferStreamWriter& stream,
-                                 const uint8_t               *dataP,
-                                 uint32_t                     offset,
-                                 uint32_t                     length);
+private:
 
     //
     // The version of this API
@@ -174,12 +238,29 @@ private:
     static const uint32_t RX_POOL_LARGE_BUFFER_COUNT = 50;
     static const uint32_t RX_POOL_SMALL_BUFFER_SIZE  = (10 * (1024));
     static const uint32_t RX_POOL_SMALL_BUFFER_COUNT = 100;
+    static const uint32_t RX_POOL_BUFFERS_PER_STREAM = 10;
+    static const uint32_t RX_POOL_MESSAGE_OVERHEAD   = 4096; // wire headers and metadata
+    static const uint32_t RX_POOL_BUFFER_ALIGNMENT   = 4096;
+    static const uint32_t RX_BATCH_DEPTH             = 32; // datagrams per recvmmsg()
+    static const int32_t  RX_POLL_TIMEOUT_MS         = 200; // 5Hz
+    static const double   FRAME_SET_FLUSH_INTERVAL   = 0.01; // seconds
+    static const uint32_t DEFAULT_RX_SPIN_US         = 100;
+    static const uint32_t RX_RING_BLOCK_SIZE         = (1024 * 1024);
+    static const uint32_t RX_RING_BLOCK_COUNT        = 64;
+    static const uint32_t RX_RING_FRAME_SIZE         = 2048;
+    static const uint32_t RX_RING_BLOCK_TIMEOUT_MS   = 1;
 
     static const double   DEFAULT_ACK_TIMEOUT        = 0.2; // seconds
     static const uint32_t DEFAULT_ACK_ATTEMPTS       = 5;
-    static const uint32_t IMAGE_META_CACHE_DEPTH     = 20;
-    static const uint32_t UDP_TRACKER_CACHE_DEPTH    = 10;
-    static const uint32_t TIME_SYNC_OFFSET_DECAY     = 8;
+    static const uint32_t IMAGE_META_CACHE_DEPTH     = 20; // frame IDs
+    static const uint32_t UDP_TRACKER_CACHE_DEPTH    = 64; // sequence IDs
+    static const uint32_t TIME_SYNC_WINDOW           = 32; // probes
+    static const double   DEFAULT_TIME_SYNC_RATE     = 1.0; // Hz
+    static const double   MAX_TIME_SYNC_RATE         = 100.0; // Hz
+    static const uint32_t TIME_SYNC_PPS_WINDOW       = 16; // PPS edges
+    static const uint32_t TIME_SYNC_PPS_MIN_EDGES    = 3;
+    static const double   TIME_SYNC_PPS_MATCH        = 0.5; // seconds
+    static const double   TIME_SYNC_PPS_TIMEOUT      = 3.0; // seconds
 
     //
     // We must protect ourselves from user callbacks misbehaving
@@ -206,50 +287,145 @@ private:
     static const uint32_t MAX_DIRECTED_STREAMS = 10;
 
     //
-    // A re-assembler for multi-packet messages
+    // A command in flight
+    //
+    // The command is sent on construction and re-sent by wait() as
+    // needed, so several may be outstanding at once: construct them
+    // all, then wait() on each. Its responses are matched first-in,
+    // first-out per message ID (see MessageWatch), so the command is
+    // not re-sent while a later command waits on the same response
+    // ID: that reply would arrive out of order.
 
-    class UdpTracker {
+    class Pending {
     public:
-        
-        UdpTracker(uint32_t                     t,
-                   UdpAssembler                 a,
-                   utility::BufferStreamWriter& s) :
-            m_totalBytesInMessage(t),
-            m_bytesAssembled(0), 
-            m_packetsAssembled(0),
-            m_lastByteOffset(-1),
-            m_assembler(a),
-            m_stream(s) {};
-
-        utility::BufferStreamWriter& stream() { return m_stream;           };
-        uint32_t packets()                    { return m_packetsAssembled; };
-        
-        bool assemble(uint32_t       bytes,
-                      uint32_t       offset,
-                      const uint8_t *dataP) {
-
-            if (offset <= m_lastByteOffset)
-                CRL_EXCEPTION("out-of-order or duplicate packet");
-
-            m_assembler(m_stream, dataP, offset, bytes);
-
-            m_bytesAssembled   += bytes;
-            m_lastByteOffset    = offset;
-            m_packetsAssembled ++;
-
-            if (m_bytesAssembled == m_totalBytesInMessage)
-                return true;
-            return false;
-        }
+
+        //
+        // Wait for the command to be ack'd (or for [ackId])
+
+        template<class T> Pending(impl&         channel,
+                                  const T&      command,
+                                  wire::IdType  ackId=MSG_ID(T::ID));
+
+        //
+        // Wait for a data message, copied into [data], or for the
+        // command to be rejected
+
+        template<class T, class U> Pending(impl&    channel,
+                                           const T& command,
+                                           U&       data);
+
+        Status wait(const double& timeout=double(DEFAULT_ACK_TIMEOUT),
+                    int32_t       attempts=DEFAULT_ACK_ATTEMPTS);
 
     private:
 
-        uint32_t                    m_totalBytesInMessage;
-        uint32_t                    m_bytesAssembled;
-        uint32_t                    m_packetsAssembled;
-        int64_t                     m_lastByteOffset; 
-        UdpAssembler                m_assembler;
+        void send();
+
+        impl&                       m_channel;
         utility::BufferStreamWriter m_stream;
+        ScopedWatch                 m_response;
+        ScopedWatch                 m_command;
+        bool                        m_data;
+    };
+
+    //
+    // Asynchronous commands, run in order by m_commandThreadP. Each
+    // calls the blocking form of a getter or setter, then completes,
+    // with Status_Exception if the getter or setter threw. A command
+    // discarded unrun is cancelled instead, completing with
+    // Status_Error.
+
+    class AsyncCommand {
+    public:
+        virtual ~AsyncCommand() {};
+        virtual void run(impl& channel) = 0;
+        virtual void cancel() = 0;
+    };
+
+    template<class T, class CALLBACK> class AsyncGet : public AsyncCommand {
+    public:
+
+        typedef Status (impl::*Getter)(T&);
+
+        AsyncGet(Getter    getterP,
+                 CALLBACK  callback,
+                 void     *userDataP) : m_getterP(getterP),
+                                        m_callback(callback),
+                                        m_userDataP(userDataP) {};
+
+        void run(impl& channel) {
+            T      value;
+            Status status;
+
+            try {
+                status = (channel.*m_getterP)(value);
+            } catch (const std::exception& e) {
+                CRL_DEBUG("exception: %s\n", e.what());
+                status = Status_Exception;
+            } catch (...) {
+                CRL_DEBUG("unknown exception\n");
+                status = Status_Exception;
+            }
+
+            if (m_callback)
+                m_callback(status, value, m_userDataP);
+        };
+
+        void cancel() {
+            T value;
+
+            if (m_callback)
+                m_callback(Status_Error, value, m_userDataP);
+        };
+
+    private:
+
+        Getter    m_getterP;
+        CALLBACK  m_callback;
+        void     *m_userDataP;
+    };
+
+    template<class T> class AsyncSet : public AsyncCommand {
+    public:
+
+        typedef Status (impl::*Setter)(const T&);
+
+        AsyncSet(Setter              setterP,
+                 const T&            value,
+                 CompletionCallback  callback,
+                 void               *userDataP) : m_setterP(setterP),
+                                                  m_value(value),
+                                                  m_callback(callback),
+                                                  m_userDataP(userDataP) {};
+
+        void run(impl& channel) {
+            Status status;
+
+            try {
+                status = (channel.*m_setterP)(m_value);
+            } catch (const std::exception& e) {
+                CRL_DEBUG("exception: %s\n", e.what());
+                status = Status_Exception;
+            } catch (...) {
+                CRL_DEBUG("unknown exception\n");
+                status = Status_Exception;
+            }
+
+            if (m_callback)
+                m_callback(status, m_userDataP);
+        };
+
+        void cancel() {
+            if (m_callback)
+                m_callback(Status_Error, m_userDataP);
+        };
+
+    private:
+
+        Setter              m_setterP;
+        T                   m_value;
+        CompletionCallback  m_callback;
+        void               *m_userDataP;
     };
 
     //
@@ -258,6 +434,18 @@ private:
     int32_t  m_serverSocket;
     uint16_t m_serverSocketPort;
 
+    //
+    // The optional AF_PACKET receive ring (RxBackend_PacketRing.) The UDP
+    // socket is kept for transmission and to own the port, but discards
+    // everything it receives.
+
+    RxBackend m_rxBackend;
+    int32_t   m_ringSocket;
+    uint8_t  *m_ringP;
+    uint32_t  m_ringBlockIndex;
+    uint64_t  m_ringPackets;
+    uint64_t  m_ringDrops;
+
     //
     // The address of the sensor
 
@@ -269,9 +457,50 @@ private:
     int32_t m_sensorMtu;
 
     //
-    // A buffer to receive incoming UDP packets
+    // A buffer to receive incoming UDP packets, divided into
+    // RX_BATCH_DEPTH MTU-sized slots for batched reception.
+    //
+    // Each slot has RX_SLOT_IOVECS scatter entries: either the whole
+    // slot, or [header, predicted payload location, overflow] when
+    // the datagram is expected to continue a message in reassembly.
 
-    std::vector<uint8_t> m_incomingBuffer;
+    static const uint32_t RX_SLOT_IOVECS = 3;
+
+    //
+    // Ancillary data per slot, for the kernel's receive timestamp
+    // (SO_TIMESTAMPNS)
+
+    static const uint32_t RX_CONTROL_SIZE = 64; // bytes
+
+    std::vector<uint8_t>        m_incomingBuffer;
+    std::vector<struct iovec>   m_rxIovecs;
+    std::vector<uint8_t>        m_rxControl;
+    std::vector<struct mmsghdr> m_rxMessages;
+
+    //
+    // The message whose payload is being received in place. We hold
+    // a reference to its stream so the buffer cannot be recycled
+    // while the kernel may be writing into it.
+
+    bool                        m_rxPredictionValid;
+    int64_t                     m_rxPredictedSequence;
+    uint16_t                    m_rxPredictedWireSequence;
+    uint32_t                    m_rxPredictedOffset;
+    uint32_t                    m_rxPredictedStride;
+    uint32_t                    m_rxPredictedLength;
+    utility::BufferStreamWriter m_rxPredictedStream;
+
+    //
+    // Reception statistics
+
+    utility::Mutex        m_statisticsLock;
+    uint64_t              m_rxSystemCalls;
+    uint64_t              m_rxDatagrams;
+    std::vector<uint64_t> m_rxBatchHistogram;
+    uint64_t              m_rxZeroCopyDatagrams;
+    uint64_t              m_rxZeroCopyMisses;
+    uint64_t              m_rxDeferredDatagrams;
+    uint64_t              m_rxDuplicateDatagrams;
 
     //
     // Sequence ID for multi-packet message reassembly
@@ -281,22 +510,31 @@ private:
     int64_t  m_unWrappedRxSeqId;
 
     //
-    // A cache to track incoming messages by sequence ID
+    // A cache to track incoming messages by sequence ID. Only used by
+    // the RX thread with m_rxLock held.
 
-    DepthCache<int64_t, UdpTracker> m_udpTrackerCache;
+    RingCache<int64_t, UdpTracker> m_udpTrackerCache;
 
     //
-    // A pool of RX buffers, to reduce the amount of internal copying
+    // Pools of RX buffers, to reduce the amount of internal copying.
+    //
+    // Small messages share a single fixed-size pool. The large pools
+    // are sized from the imager resolution and the enabled streams,
+    // in ascending order of buffer size (see tuneBufferPools().)
     
-    typedef std::vector<utility::BufferStreamWriter*> BufferPool;
-
-    BufferPool m_rxLargeBufferPool;
-    BufferPool m_rxSmallBufferPool;
+    utility::BufferPool               m_rxSmallBufferPool;
+    std::vector<utility::BufferPool*> m_rxLargeBufferPools;
+    bool                              m_rxPoolAutoTune;
+    RxArenaFlags                      m_rxArenaFlags;
+    volatile int32_t                  m_rxNumaNode;
+    uint32_t                          m_rxImageWidth;
+    uint32_t                          m_rxImageHeight;
+    uint64_t                          m_rxOneOffAllocations;
 
     //
     // A cache of image meta data
 
-    DepthCache<int64_t, wire::ImageMeta> m_imageMetaCache;
+    RingCache<int64_t, wire::ImageMeta> m_imageMetaCache;
 
     //
     // A map of custom UDP assemblers
@@ -306,7 +544,8 @@ private:
     UdpAssemblerMap m_udpAssemblerMap;
 
     //
-    // Mutex for callback registration and dispatching
+    // Mutex for callback registration (dispatching takes no lock, see
+    // ListenerSet)
 
     utility::Mutex m_dispatchLock;
 
@@ -326,23 +565,56 @@ private:
     utility::Thread *m_rxThreadP;
     utility::Mutex   m_rxLock;
 
+    //
+    // How the reception thread waits for datagrams
+
+    int32_t             m_rxEpollFd;
+    volatile RxPollMode m_rxPollMode;
+    volatile uint32_t   m_rxSpinMicroseconds;
+
     //
     // Internal status thread
 
     utility::Thread *m_statusThreadP;
 
+    //
+    // Internal thread for asynchronous commands
+
+    utility::Thread                      *m_commandThreadP;
+    utility::WaitQueue<AsyncCommand*>     m_asyncCommands;
+
+    //
+    // Held to check m_threadsRunning and queue a command as one step,
+    // so that nothing is queued once cleanup() has stopped the threads
+
+    utility::Mutex                        m_asyncLock;
+
+    //
+    // Conversions for image listeners, outliving them
+
+    Converter<image::Header> m_imageConverter;
+
     //
     // The lists of user callbacks
 
-    std::list<ImageListener*> m_imageListeners;
-    std::list<LidarListener*> m_lidarListeners;
-    std::list<PpsListener*>   m_ppsListeners;
-    std::list<ImuListener*>   m_imuListeners;
+    ListenerSet<ImageListener> m_imageListeners;
+    ListenerSet<LidarListener> m_lidarListeners;
+    ListenerSet<PpsListener>   m_ppsListeners;
+    ListenerSet<ImuListener>   m_imuListeners;
+
+    ListenerSet<FrameSetListener> m_frameSetListeners;
 
     //
-    // A message signal interface
+    // For the dispatch threads of new callbacks
 
-    MessageWatch m_watch;
+    ThreadPolicy m_dispatchPolicy;
+
+    //
+    // A message signal interface. Commands with a response are sent
+    // with m_commandLock held, in the order their watches are armed.
+
+    MessageWatch   m_watch;
+    utility::Mutex m_commandLock;
 
     //
     // A message storage interface
@@ -355,12 +627,39 @@ private:
     DataSource m_streamsEnabled;
 
     //
-    // The current sensor time offset
+    // The current models of the sensor clock, and the rate it is probed at.
+    // The lock serializes updates of the models; the fit of the one in use
+    // is published to the RX thread through the sequence lock, which never
+    // blocks.
 
-    utility::Mutex m_timeLock;
-    bool           m_timeOffsetInit;
-    double         m_timeOffset;
-    bool           m_networkTimeSyncEnabled;
+    utility::Mutex                                m_timeLock;
+    utility::ClockModel                           m_clockModel;
+    utility::SeqLock<utility::ClockModel::Mapping> m_timeMapping;
+    bool                                          m_networkTimeSyncEnabled;
+    volatile double                               m_timeSyncRate; // Hz
+
+    //
+    // PPS discipline: the model fit to paired PPS edges, the host's PPS
+    // device, and the latest edges not yet paired (negative if none)
+
+    utility::ClockModel                           m_ppsModel;
+    system::TimeSyncSource                        m_timeSyncSource;
+    int32_t                                       m_ppsDevice;
+    uint32_t                                      m_ppsSequence;
+    double                                        m_ppsSensorEdge;  // sensor seconds
+    double                                        m_ppsHostEdge;    // local seconds
+    double                                        m_ppsLastPaired;  // monotonic seconds
+
+    //
+    // The kernel's receive time of the latest status response
+
+    double                                        m_statusArrival;  // local seconds
+
+    //
+    // Sensor times of the IMU samples being converted, only touched by
+    // the RX thread
+
+    std::vector<double> m_imuTimes;
 
     //
     // Cached version info from the device
@@ -379,9 +678,15 @@ private:
                                                const double& timeout=double(DEFAULT_ACK_TIMEOUT),
                                                int32_t       attempts=DEFAULT_ACK_ATTEMPTS);
     
+    template<class T> void       serialize    (const T&                     message,
+                                               utility::BufferStreamWriter& stream);
     template<class T> void       publish      (const T& message); 
-    void                         publish      (const utility::BufferStreamWriter& stream);
-    void                         dispatch     (utility::BufferStreamWriter& buffer);
+    uint16_t                     publish      (const utility::BufferStreamWriter& stream);
+    Status                       queueCommand (AsyncCommand *commandP);
+    template<class T> void       deliver      (const T& message);
+    void                         dispatch     (utility::BufferStreamWriter& buffer,
+                                               double                       firstArrival,
+                                               double                       lastArrival);
     void                         dispatchImage(utility::BufferStream& buffer,
                                                image::Header&         header);
     void                         dispatchLidar(utility::BufferStream& buffer,
@@ -390,7 +695,11 @@ private:
     void                         dispatchImu  (imu::Header& header);
 
 
-    utility::BufferStreamWriter& findFreeBuffer  (uint32_t messageLength);
+    utility::BufferStreamWriter  findFreeBuffer  (uint32_t messageLength);
+    bool                         tuneBufferPools (RxArenaFlags flags);
+    void                         discardPools    (std::vector<utility::BufferPool*>& pools);
+    void                         setImageResolution(uint32_t width,
+                                                    uint32_t height);
     const int64_t&               unwrapSequenceId(uint16_t id);
     UdpAssembler                 getUdpAssembler (const uint8_t *udpDatagramP,
                                                   uint32_t       length);
@@ -403,15 +712,35 @@ private:
                                                             uint32_t           operation,
                                                             uint32_t           region);
 
-    void                         applySensorTimeOffset(const double& offset);
+    void                         addTimeSample        (double sensorTime,
+                                                       double localTime,
+                                                       double roundTrip);
+    void                         addSensorPpsEdge     (int64_t nanoSeconds);
+    void                         pairPpsEdges         ();
+    void                         fetchHostPpsEdge     ();
+    void                         publishTimeMapping   ();
     double                       sensorToLocalTime    (const double& sensorTime);
     void                         sensorToLocalTime    (const double& sensorTime,
                                                        uint32_t&     seconds,
                                                        uint32_t&     microseconds);
+    void                         sensorToLocalTimes   (double       *timesP,
+                                                       uint32_t      count);
+    static void                  splitTime            (const double& time,
+                                                       uint32_t&     seconds,
+                                                       uint32_t&     microseconds);
 
-    void                         cleanup();
-    void                         bind   ();
-    void                         handle ();
+    void                         cleanup       ();
+    void                         bind          ();
+    void                         bindRing      ();
+    uint32_t                     handle        ();
+    uint32_t                     handleRing    ();
+    void                         handleDatagram(const uint8_t *datagramP,
+                                                uint32_t       length,
+                                                const uint8_t *payloadP=NULL,
+                                                double         arrival=0.0);
+    static double                rxTimestamp   (struct msghdr& message);
+    uint32_t                     predictBatch  ();
+    void                         resetPrediction();
 
     //
     // Static members
@@ -422,8 +751,11 @@ private:
     static uint32_t              hardwareWireToApi(uint32_t h);
     static uint32_t              imagerApiToWire(uint32_t h);
     static uint32_t              imagerWireToApi(uint32_t h);
+    static uint32_t              arenaApiToUtility(RxArenaFlags f);
+    static RxArenaFlags          arenaUtilityToApi(uint32_t f);
     static void                 *rxThread       (void *userDataP);
     static void                 *statusThread   (void *userDataP);
+    static void                 *commandThread  (void *userDataP);
 };
 
 
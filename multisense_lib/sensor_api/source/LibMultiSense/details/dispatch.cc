@@ -25,6 +25,7 @@
  **/
 
 #include "details/channel.hh"
+#include "details/query.hh"
 
 #include "details/wire/AckMessage.h"
 
@@ -60,6 +61,12 @@
 #include "details/wire/SysTestMtuResponseMessage.h"
 #include "details/wire/SysDirectedStreamsMessage.h"
 
+#include "details/utility/TimeStamp.hh"
+
+#include <sys/epoll.h>
+#include <linux/if_packet.h>
+
+#include <algorithm>
 #include <limits>
 
 namespace crl {
@@ -75,26 +82,115 @@ void defaultUdpAssembler(utility::BufferStreamWriter& stream,
                          uint32_t                     offset,
                          uint32_t                     length)
 {
+    //
+    // The payload may already have been received in place
+
+    if (dataP == (reinterpret_cast<const uint8_t*>(stream.data()) + offset)) {
+        stream.seek(offset + length);
+        return;
+    }
+
     stream.seek(offset);
     stream.write(dataP, length);
 }
 
+//
+// The number of bits per imager pixel carried by each image source,
+// once reassembled. Chroma is subsampled by two in each direction,
+// and a JPEG is expected to be no larger than the luma image.
+// Anything else is small enough for the small buffer pool.
+
+uint32_t reassembledBitsPerPixel(DataSource source)
+{
+    switch(source) {
+    case Source_Raw_Left:
+    case Source_Raw_Right:              return 16;
+    case Source_Luma_Left:
+    case Source_Luma_Right:
+    case Source_Luma_Rectified_Left:
+    case Source_Luma_Rectified_Right:   return 8;
+    case Source_Chroma_Left:
+    case Source_Chroma_Right:           return 4;
+    case Source_Disparity:
+    case Source_Disparity_Right:        return wire::Disparity::WIRE_BITS_PER_PIXEL; // kept packed
+    case Source_Disparity_Cost:         return 8;
+    case Source_Jpeg_Left:              return 8;
+    case Source_Rgb_Left:               return 24;
+    default:                            return 0;
+    }
+}
+
 }; // anonymous
 
+//
+// Disparity is received packed. Unless the listener asked for it
+// packed, unpack it, once per image.
+
+bool Converter<image::Header>::convert(image::Header&               header,
+                                       uint32_t                     flags,
+                                       utility::BufferStreamWriter& converted)
+{
+    if (0 == (header.source & (Source_Disparity | Source_Disparity_Right)) ||
+        wire::Disparity::WIRE_BITS_PER_PIXEL != header.bitsPerPixel       ||
+        (flags & Callback_PackedDisparity))
+        return false;
+
+    const uint32_t length = static_cast<uint32_t>(std::ceil(((double) wire::Disparity::API_BITS_PER_PIXEL / 8.0) *
+                                                            header.width * header.height));
+
+    Unpacked& u = (header.source & Source_Disparity) ? m_left : m_right;
+
+    utility::ScopedLock lock(u.lock);
+
+    if (u.packedP != header.imageDataP || u.frameId != header.frameId) {
+
+        //
+        // Write to whichever buffer is free, else to a new one
+
+        if (u.current.shared()) {
+            utility::BufferStreamWriter held = u.current;
+
+            u.current = u.spare;
+            u.spare   = held;
+        }
+
+        if (u.current.size() < length || u.current.shared())
+            u.current = utility::BufferStreamWriter(length);
+
+        u.packedP = NULL;
+
+        Status status;
+
+        if (16 == wire::Disparity::API_BITS_PER_PIXEL)
+            status = Channel::unpackDisparity(header, reinterpret_cast<uint16_t*>(u.current.data()));
+        else
+            status = Channel::unpackDisparity(header, reinterpret_cast<float*>(u.current.data()));
+
+        if (Status_Ok != status)
+            CRL_EXCEPTION("unable to unpack a %dx%d disparity image",
+                          header.width, header.height);
+
+        u.packedP = header.imageDataP;
+        u.frameId = header.frameId;
+    }
+
+    converted = u.current;
+
+    header.bitsPerPixel = wire::Disparity::API_BITS_PER_PIXEL;
+    header.imageLength  = length;
+    header.imageDataP   = converted.data();
+
+    return true;
+}
+
 //
 // Publish an image 
 
 void impl::dispatchImage(utility::BufferStream& buffer,
                          image::Header&         header)
 {
-    utility::ScopedLock lock(m_dispatchLock);
-
-    std::list<ImageListener*>::const_iterator it;
-
-    for(it  = m_imageListeners.begin();
-        it != m_imageListeners.end();
-        it ++)
-        (*it)->dispatch(buffer, header);
+    m_imageListeners.dispatch(buffer, header);
+    m_frameSetListeners.dispatch(buffer, header);
 }
 
 //
@@ -103,14 +199,7 @@ void impl::dispatchImage(utility::BufferStream& buffer,
 void impl::dispatchLidar(utility::BufferStream& buffer,
                          lidar::Header&         header)
 {
-    utility::ScopedLock lock(m_dispatchLock);
-
-    std::list<LidarListener*>::const_iterator it;
-
-    for(it  = m_lidarListeners.begin();
-        it != m_lidarListeners.end();
-        it ++)
-        (*it)->dispatch(buffer, header);
+    m_lidarListeners.dispatch(buffer, header);
 }
 
 //
@@ -118,14 +207,7 @@ void impl::dispatchLidar(utility::BufferStream& buffer,
 
 void impl::dispatchPps(pps::Header& header)
 {
-    utility::ScopedLock lock(m_dispatchLock);
-
-    std::list<PpsListener*>::const_iterator it;
-
-    for(it  = m_ppsListeners.begin();
-        it != m_ppsListeners.end();
-        it ++)
-        (*it)->dispatch(header);
+    m_ppsListeners.dispatch(header);
 }
 
 //
@@ -133,20 +215,15 @@ void impl::dispatchPps(pps::Header& header)
 
 void impl::dispatchImu(imu::Header& header)
 {
-    utility::ScopedLock lock(m_dispatchLock);
-
-    std::list<ImuListener*>::const_iterator it;
-
-    for(it  = m_imuListeners.begin();
-        it != m_imuListeners.end();
-        it ++)
-        (*it)->dispatch(header);
+    m_imuListeners.dispatch(header);
 }
 
 //
 // Dispatch incoming messages
 
-void impl::dispatch(utility::BufferStreamWriter& buffer)
+void impl::dispatch(utility::BufferStreamWriter& buffer,
+                    double                       firstArrival,
+                    double                       lastArrival)
 {
     utility::BufferStreamReader stream(buffer);
 
@@ -206,18 +283,41 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
         header.rangesP           = scan.distanceP;
         header.intensitiesP      = scan.intensityP;
 
+        splitTime(firstArrival, header.rxFirstSeconds, header.rxFirstMicroSeconds);
+        splitTime(lastArrival,  header.rxLastSeconds,  header.rxLastMicroSeconds);
+
         dispatchLidar(buffer, header);
 
         break;
     }
     case MSG_ID(wire::ImageMeta::ID):
     {
-        wire::ImageMeta *metaP = new (std::nothrow) wire::ImageMeta(stream, version);
+        const wire::ImageMeta meta(stream, version);
 
-        if (NULL == metaP)
-            CRL_EXCEPTION("unable to allocate metadata");
+        utility::ScopedLock lock(m_imageMetaCache.mutex());
+
+        wire::ImageMeta *metaP = m_imageMetaCache.insert_nolock(meta.frameId); // evicts oldest
+        if (NULL == metaP) {
+
+            //
+            // Older than the window. Frame IDs restart from zero with
+            // the sensor, so a frame ID of zero, or one more than a
+            // whole window below it, starts over. Otherwise the
+            // metadata is late, and dropped.
+
+            const int64_t window = m_imageMetaCache.capacity();
+            int64_t       newest = 0;
 
-        m_imageMetaCache.insert(metaP->frameId, metaP); // destroys oldest
+            if (0 != meta.frameId &&
+                m_imageMetaCache.newest_nolock(newest) &&
+                meta.frameId > newest - 2 * window)
+                break;
+
+            m_imageMetaCache.clear_nolock();
+            metaP = m_imageMetaCache.insert_nolock(meta.frameId);
+        }
+
+        *metaP = meta;
 
         break;
     }
@@ -253,6 +353,9 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
         header.imageDataP       = image.dataP;
         header.imageLength      = image.length;
         
+        splitTime(firstArrival, header.rxFirstSeconds, header.rxFirstMicroSeconds);
+        splitTime(lastArrival,  header.rxLastSeconds,  header.rxLastMicroSeconds);
+
         dispatchImage(buffer, header);
 
         break;
@@ -289,6 +392,9 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
         header.imageDataP       = image.dataP;
         header.imageLength      = static_cast<uint32_t>(std::ceil(((double) image.bitsPerPixel / 8.0) * image.width * image.height));
 
+        splitTime(firstArrival, header.rxFirstSeconds, header.rxFirstMicroSeconds);
+        splitTime(lastArrival,  header.rxLastSeconds,  header.rxLastMicroSeconds);
+
         dispatchImage(buffer, header);
 
         break;
@@ -315,7 +421,7 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
                               header.timeSeconds, header.timeMicroSeconds);
         
         header.source           = Source_Disparity;
-        header.bitsPerPixel     = wire::Disparity::API_BITS_PER_PIXEL;
+        header.bitsPerPixel     = wire::Disparity::WIRE_BITS_PER_PIXEL;
         header.width            = image.width;
         header.height           = image.height;
         header.frameId          = image.frameId;
@@ -323,6 +429,10 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
         header.gain             = metaP->gain;
         header.framesPerSecond  = metaP->framesPerSecond;
         header.imageDataP       = image.dataP;
+        header.imageLength      = wire::Disparity::packedLength(image.width, image.height);
+
+        splitTime(firstArrival, header.rxFirstSeconds, header.rxFirstMicroSeconds);
+        splitTime(lastArrival,  header.rxLastSeconds,  header.rxLastMicroSeconds);
 
         dispatchImage(buffer, header);
 
@@ -336,6 +446,7 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
 
         header.sensorTime = pps.ppsNanoSeconds;
 
+        addSensorPpsEdge(pps.ppsNanoSeconds);
         dispatchPps(header);
 
         break;
@@ -348,13 +459,30 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
 
         header.sequence = imu.sequence;
         header.samples.resize(imu.samples.size());
+
+        //
+        // Correct all of the sample times against one fit of the
+        // sensor clock
+
+        const uint32_t count     = imu.samples.size();
+        const bool     corrected = m_networkTimeSyncEnabled;
+
+        if (corrected && count > 0) {
+
+            m_imuTimes.resize(count);
+
+            for(uint32_t i=0; i<count; i++)
+                m_imuTimes[i] = static_cast<double>(imu.samples[i].timeNanoSeconds) / 1e9;
+
+            sensorToLocalTimes(&(m_imuTimes[0]), count);
+        }
         
-        for(uint32_t i=0; i<imu.samples.size(); i++) {
+        for(uint32_t i=0; i<count; i++) {
 
             const wire::ImuSample& w = imu.samples[i];
             imu::Sample&           a = header.samples[i];
 
-            if (false == m_networkTimeSyncEnabled) {
+            if (false == corrected) {
 
                 const int64_t oneBillion = static_cast<int64_t>(1e9);
 
@@ -363,8 +491,7 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
                                                            static_cast<int64_t>(1000));
 
             } else
-                sensorToLocalTime(static_cast<double>(w.timeNanoSeconds) / 1e9,
-                                  a.timeSeconds, a.timeMicroSeconds);
+                splitTime(m_imuTimes[i], a.timeSeconds, a.timeMicroSeconds);
 
             switch(w.type) {
             case wire::ImuSample::TYPE_ACCEL: a.type = imu::Sample::Type_Accelerometer; break;
@@ -376,60 +503,74 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
             a.x = w.x; a.y = w.y; a.z = w.z;
         }
 
+        splitTime(firstArrival, header.rxFirstSeconds, header.rxFirstMicroSeconds);
+        splitTime(lastArrival,  header.rxLastSeconds,  header.rxLastMicroSeconds);
+
         dispatchImu(header);
 
         break;
     }
     case MSG_ID(wire::Ack::ID):
         break; // handle below
+
+    //
+    // Control responses go straight to the waiting command, which
+    // also signals it
+
     case MSG_ID(wire::CamConfig::ID):
-        m_messages.store(wire::CamConfig(stream, version));
-        break;
+        deliver(wire::CamConfig(stream, version));
+        return;
     case MSG_ID(wire::CamHistory::ID):
-        m_messages.store(wire::CamHistory(stream, version));
-        break;
+        deliver(wire::CamHistory(stream, version));
+        return;
     case MSG_ID(wire::LedStatus::ID):
-        m_messages.store(wire::LedStatus(stream, version));
-        break;
+        deliver(wire::LedStatus(stream, version));
+        return;
     case MSG_ID(wire::SysFlashResponse::ID):
-        m_messages.store(wire::SysFlashResponse(stream, version));
-        break;
+        deliver(wire::SysFlashResponse(stream, version));
+        return;
     case MSG_ID(wire::SysDeviceInfo::ID):
-        m_messages.store(wire::SysDeviceInfo(stream, version));
-        break;
+        deliver(wire::SysDeviceInfo(stream, version));
+        return;
     case MSG_ID(wire::SysCameraCalibration::ID):
-        m_messages.store(wire::SysCameraCalibration(stream, version));
-        break;
+        deliver(wire::SysCameraCalibration(stream, version));
+        return;
     case MSG_ID(wire::SysLidarCalibration::ID):
-        m_messages.store(wire::SysLidarCalibration(stream, version));
-        break;
+        deliver(wire::SysLidarCalibration(stream, version));
+        return;
     case MSG_ID(wire::SysMtu::ID):
-        m_messages.store(wire::SysMtu(stream, version));
-        break;
+        deliver(wire::SysMtu(stream, version));
+        return;
     case MSG_ID(wire::SysNetwork::ID):
-        m_messages.store(wire::SysNetwork(stream, version));
-        break;
+        deliver(wire::SysNetwork(stream, version));
+        return;
     case MSG_ID(wire::SysDeviceModes::ID):
-        m_messages.store(wire::SysDeviceModes(stream, version));
-        break;
+        deliver(wire::SysDeviceModes(stream, version));
+        return;
     case MSG_ID(wire::VersionResponse::ID):
-        m_messages.store(wire::VersionResponse(stream, version));
-        break;
+        deliver(wire::VersionResponse(stream, version));
+        return;
     case MSG_ID(wire::StatusResponse::ID):
-        m_messages.store(wire::StatusResponse(stream, version));   
-        break;
+    {
+        {
+            utility::ScopedLock lock(m_timeLock);
+            m_statusArrival = lastArrival; // for the status thread's round trip
+        }
+        deliver(wire::StatusResponse(stream, version));
+        return;
+    }
     case MSG_ID(wire::ImuConfig::ID):
-        m_messages.store(wire::ImuConfig(stream, version));
-        break;
+        deliver(wire::ImuConfig(stream, version));
+        return;
     case MSG_ID(wire::ImuInfo::ID):
-        m_messages.store(wire::ImuInfo(stream, version));
-        break;
+        deliver(wire::ImuInfo(stream, version));
+        return;
     case MSG_ID(wire::SysTestMtuResponse::ID):
-        m_messages.store(wire::SysTestMtuResponse(stream, version));
-        break;
+        deliver(wire::SysTestMtuResponse(stream, version));
+        return;
     case MSG_ID(wire::SysDirectedStreams::ID):
-        m_messages.store(wire::SysDirectedStreams(stream, version));
-        break;
+        deliver(wire::SysDirectedStreams(stream, version));
+        return;
     default:
 
         CRL_DEBUG("unknown message received: id=%d, version=%d\n",
@@ -458,8 +599,8 @@ void impl::dispatch(utility::BufferStreamWriter& buffer)
 // Get a UDP assembler for this message type. We are given
 // the first UDP packet in the stream
 
-impl::UdpAssembler impl::getUdpAssembler(const uint8_t *firstDatagramP,
-                                         uint32_t       length)
+UdpAssembler impl::getUdpAssembler(const uint8_t *firstDatagramP,
+                                   uint32_t       length)
 {
     //
     // Get the message type, it is stored after wire::Header
@@ -483,28 +624,179 @@ impl::UdpAssembler impl::getUdpAssembler(const uint8_t *firstDatagramP,
 
 //
 // Find a suitably sized buffer for the incoming message
+//
+// Messages that no pool is sized for (a stream we did not enable, or
+// a resolution we have not been told about) get a buffer of their own.
 
-utility::BufferStreamWriter& impl::findFreeBuffer(uint32_t messageLength)
+utility::BufferStreamWriter impl::findFreeBuffer(uint32_t messageLength)
 {    
-    BufferPool *bP = NULL;
-    
-    if (messageLength <= RX_POOL_SMALL_BUFFER_SIZE)
-        bP = &(m_rxSmallBufferPool);
-    else if (messageLength <= RX_POOL_LARGE_BUFFER_SIZE)
-        bP = &(m_rxLargeBufferPool);
-    else
+    utility::BufferStreamWriter buffer;
+
+    if (messageLength <= RX_POOL_SMALL_BUFFER_SIZE) {
+
+        if (false == m_rxSmallBufferPool.acquire(buffer))
+            CRL_EXCEPTION("no free RX buffers (%d in use by consumers)\n", 
+                          m_rxSmallBufferPool.size());
+        return buffer;
+    }
+
+    bool sized = false;
+
+    for(uint32_t i=0; i<m_rxLargeBufferPools.size(); i++) {
+
+        utility::BufferPool *bP = m_rxLargeBufferPools[i];
+
+        if (messageLength > bP->bufferSize())
+            continue;
+
+        sized = true;
+
+        if (bP->acquire(buffer))
+            return buffer;
+    }
+
+    if (sized)
+        CRL_EXCEPTION("no free RX buffers for a %d byte message\n", messageLength);
+    else if (messageLength > RX_POOL_LARGE_BUFFER_SIZE)
         CRL_EXCEPTION("message too large: %d bytes", messageLength);
 
+    {
+        utility::ScopedLock lock(m_statisticsLock);
+        m_rxOneOffAllocations ++;
+    }
+
+    return utility::BufferStreamWriter(messageLength);
+}
+
+//
+// Size the large RX buffer pools for what is currently streaming.
+//
+// Each enabled image stream gets RX_POOL_BUFFERS_PER_STREAM buffers
+// of its largest message size, and streams of equal message size
+// share a pool, allocated as requested by setRxBufferArena(). Pools
+// whose shape is unchanged are kept, so retuning does not disturb
+// buffers in flight.
+//
+// Best-effort: if the new pools can not be allocated the old ones
+// are kept, and false is returned. Never throws.
+//
+// The new pools are allocated (and, if locked, faulted in) while the
+// RX thread carries on with the old ones; it is only held off for the
+// swap. The pool list only changes under m_streamLock, which the
+// caller must hold.
+
+bool impl::tuneBufferPools(RxArenaFlags flags)
+{
+    std::map<std::size_t, uint32_t> classes;
+
+    for(uint32_t i=0; i<32; i++) {
+
+        const DataSource source = (1u << i);
+        const uint32_t   bits   = reassembledBitsPerPixel(source);
+
+        if (0 == (m_streamsEnabled & source) || 0 == bits)
+            continue;
+
+        std::size_t bytes = RX_POOL_MESSAGE_OVERHEAD +
+            (static_cast<std::size_t>(bits) * m_rxImageWidth * m_rxImageHeight) / 8;
+
+        bytes = RX_POOL_BUFFER_ALIGNMENT * 
+            ((bytes + RX_POOL_BUFFER_ALIGNMENT - 1) / RX_POOL_BUFFER_ALIGNMENT);
+
+        if (bytes > RX_POOL_SMALL_BUFFER_SIZE)
+            classes[bytes] += RX_POOL_BUFFERS_PER_STREAM;
+    }
+
+    if (false == m_rxPoolAutoTune)
+        return true;
+
+    std::vector<utility::BufferPool*> pools;
+    std::vector<bool>                 kept(m_rxLargeBufferPools.size(), false);
+    const uint32_t                    arenaFlags = arenaApiToUtility(flags);
+
+    try {
+
+        std::map<std::size_t, uint32_t>::const_iterator it;
+        for(it = classes.begin(); it != classes.end(); ++it) {
+
+            utility::BufferPool *bP = NULL;
+
+            for(uint32_t i=0; i<m_rxLargeBufferPools.size(); i++)
+                if (false == kept[i]                                        &&
+                    it->first  == m_rxLargeBufferPools[i]->bufferSize()     &&
+                    it->second == m_rxLargeBufferPools[i]->size()           &&
+                    arenaFlags == m_rxLargeBufferPools[i]->arenaRequested()) {
+                    bP      = m_rxLargeBufferPools[i];
+                    kept[i] = true;
+                    break;
+                }
+
+            if (NULL == bP) {
+                bP = new utility::BufferPool();
+                pools.push_back(bP);
+                bP->create(it->second, it->first, arenaFlags, m_rxNumaNode);
+            } else
+                pools.push_back(bP);
+        }
+
+    } catch (const std::exception& e) {
+
+        CRL_DEBUG("unable to retune RX buffer pools, keeping the old ones: %s\n",
+                  e.what());
+        discardPools(pools);
+        return false;
+
+    } catch ( ... ) {
+
+        CRL_DEBUG("unable to retune RX buffer pools, keeping the old ones\n");
+        discardPools(pools);
+        return false;
+    }
+
+    {
+        utility::ScopedLock lock(m_rxLock);
+        m_rxLargeBufferPools.swap(pools);
+    }
+
     //
-    // TODO: re-think the shared() mechanism of the buffers, so we do not
-    //       have to walk this vector.
+    // Buffers still in flight keep their memory (BufferStream is
+    // reference counted)
+
+    for(uint32_t i=0; i<pools.size(); i++)
+        if (false == kept[i])
+            delete pools[i];
+
+    return true;
+}
+
+//
+// Drop the pools of a failed retune that are not currently in use
+
+void impl::discardPools(std::vector<utility::BufferPool*>& pools)
+{
+    for(uint32_t i=0; i<pools.size(); i++)
+        if (m_rxLargeBufferPools.end() == std::find(m_rxLargeBufferPools.begin(),
+                                                    m_rxLargeBufferPools.end(),
+                                                    pools[i]))
+            delete pools[i];
+    pools.clear();
+}
+
+//
+// Remember the imager resolution, resizing the RX buffers to suit
 
-    BufferPool::const_iterator it = bP->begin();
-    for(; it != bP->end(); it++)
-        if (false == (*it)->shared())
-            return *(*it);
+void impl::setImageResolution(uint32_t width,
+                              uint32_t height)
+{
+    utility::ScopedLock lock(m_streamLock);
+
+    if (width == m_rxImageWidth && height == m_rxImageHeight)
+        return;
 
-    CRL_EXCEPTION("no free RX buffers (%d in use by consumers)\n", bP->size());
+    m_rxImageWidth  = width;
+    m_rxImageHeight = height;
+
+    tuneBufferPools(m_rxArenaFlags);
 }
 
 //
@@ -549,150 +841,543 @@ const int64_t& impl::unwrapSequenceId(uint16_t wireId)
     return m_unWrappedRxSeqId;
 }
 
+//
+// Handles a single incoming datagram
+//
+// The payload normally follows the header, but may have been
+// received directly into a reassembly buffer (see predictBatch())
+
+void impl::handleDatagram(const uint8_t *inP,
+                          uint32_t       bytesRead,
+                          const uint8_t *payloadP,
+                          double         arrival)
+{
+    //
+    // Check for undersized packets
+
+    if (bytesRead < sizeof(wire::Header))
+        CRL_EXCEPTION("undersized packet: %d/%d bytes\n",
+                      bytesRead, sizeof(wire::Header));
+
+    //
+    // Validate the header
+
+    const wire::Header& header = *(reinterpret_cast<const wire::Header*>(inP));
+
+    if (wire::HEADER_MAGIC != header.magic)
+        CRL_EXCEPTION("bad protocol magic: 0x%x, expecting 0x%x",
+                      header.magic, wire::HEADER_MAGIC);
+    else if (wire::HEADER_VERSION != header.version)
+        CRL_EXCEPTION("bad protocol version: 0x%x, expecting 0x%x",
+                      header.version, wire::HEADER_VERSION);
+    else if (wire::HEADER_GROUP != header.group)
+        CRL_EXCEPTION("bad protocol group: 0x%x, expecting 0x%x",
+                      header.group, wire::HEADER_GROUP);
+
+    //
+    // Unwrap the sequence identifier
+
+    const int64_t& sequence = unwrapSequenceId(header.sequenceIdentifier);
+
+    if (NULL == payloadP)
+        payloadP = &(inP[sizeof(wire::Header)]);
+
+    //
+    // See if we are already tracking this messge ID
+
+    UdpTracker *trP     = m_udpTrackerCache.find_nolock(sequence);
+    const bool  created = (NULL == trP);
+
+    if (created) {
+
+        //
+        // A late datagram for a message we have given up on
+
+        trP = m_udpTrackerCache.insert_nolock(sequence);
+        if (NULL == trP)
+            return;
+
+        trP->reset(header.messageLength);
+    }
+
+    trP->arrived(arrival);
+
+    //
+    // Assemble the datagram into the message stream, returns true if the
+    // assembly is complete. The first datagram starts assembly.
+
+    const uint32_t payloadLength = bytesRead - sizeof(wire::Header);
+    const uint32_t packets       = trP->packets();
+    const bool     started       = trP->started();
+    bool           complete      = false;
+
+    try {
+
+        if (0 == header.byteOffset && false == started) {
+
+            //
+            // The assembler and buffer are chosen from the first
+            // datagram
+
+            complete = trP->start(getUdpAssembler(inP, bytesRead),
+                                  findFreeBuffer(header.messageLength),
+                                  payloadLength, payloadP);
+        } else
+            complete = trP->assemble(payloadLength, header.byteOffset, payloadP);
+
+    } catch (...) {
+        if (created)
+            m_udpTrackerCache.remove_nolock(sequence);
+        throw;
+    }
+
+    //
+    // Note datagrams held back for, or repeating, a message
+
+    if (false == started && 0 != header.byteOffset) {
+        utility::ScopedLock statsLock(m_statisticsLock);
+        m_rxDeferredDatagrams ++;
+    } else if (started && packets == trP->packets()) {
+        utility::ScopedLock statsLock(m_statisticsLock);
+        m_rxDuplicateDatagrams ++;
+    }
+
+    if (complete) {
+
+        //
+        // Stop receiving into this message before handing it out
+
+        if (m_rxPredictionValid && sequence == m_rxPredictedSequence)
+            resetPrediction();
+
+        //
+        // Dispatch to any listeners
+
+        dispatch(trP->stream(), trP->firstArrival(), trP->lastArrival());
+
+        //
+        // Release the tracker
+
+        m_udpTrackerCache.remove_nolock(sequence);
+
+    } else {
+
+        //
+        // Expect the remainder of a default-assembled message to follow
+        // contiguously, with every datagram carrying this many bytes.
+        //
+        // Only while everything so far has arrived in order, as nothing
+        // already assembled may be received over.
+
+        const bool inOrder = (trP->bytesAssembled() == header.byteOffset + payloadLength);
+
+        if (false == inOrder) {
+
+            if (m_rxPredictionValid && sequence == m_rxPredictedSequence)
+                resetPrediction();
+
+        } else if (defaultUdpAssembler == trP->assembler()) {
+
+            if (false == m_rxPredictionValid || sequence != m_rxPredictedSequence) {
+                m_rxPredictionValid       = true;
+                m_rxPredictedSequence     = sequence;
+                m_rxPredictedWireSequence = header.sequenceIdentifier;
+                m_rxPredictedLength       = header.messageLength;
+                m_rxPredictedStream       = trP->stream();
+            }
+
+            m_rxPredictedOffset = header.byteOffset + payloadLength;
+            m_rxPredictedStride = payloadLength;
+        }
+    }
+}
+
+//
+// The kernel's receive timestamp of a datagram (SO_TIMESTAMPNS),
+// in seconds of the local system clock, or 0 if there is none
+
+double impl::rxTimestamp(struct msghdr& message)
+{
+    for(struct cmsghdr *cP = CMSG_FIRSTHDR(&message); NULL != cP; cP = CMSG_NXTHDR(&message, cP))
+        if (SOL_SOCKET == cP->cmsg_level && SCM_TIMESTAMPNS == cP->cmsg_type) {
+
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(cP), sizeof(time));
+
+            return (static_cast<double>(time.tv_sec) +
+                    1e-9 * static_cast<double>(time.tv_nsec));
+        }
+
+    return 0.0;
+}
+
+//
+// Stop receiving in place
+
+void impl::resetPrediction()
+{
+    m_rxPredictionValid = false;
+    m_rxPredictedStream = utility::BufferStreamWriter();
+}
+
+//
+// Prepare the receive slots for the next batch. Slots expected to
+// carry the next datagrams of the message being reassembled have
+// their payload scattered straight to its final location in the
+// message buffer, anything else lands in the slot as usual.
+//
+// Returns the number of slots prepared for in-place reception.
+
+uint32_t impl::predictBatch()
+{
+    uint32_t predicted = 0;
+
+    //
+    // The message may have been evicted from the tracker cache
+
+    if (m_rxPredictionValid) {
+        UdpTracker *trP = m_udpTrackerCache.find_nolock(m_rxPredictedSequence);
+        if (NULL == trP || trP->stream().data() != m_rxPredictedStream.data())
+            resetPrediction();
+    }
+
+    uint8_t *streamP = reinterpret_cast<uint8_t*>(m_rxPredictedStream.data());
+    uint32_t offset  = m_rxPredictedOffset;
+
+    for(uint32_t i=0; i<RX_BATCH_DEPTH; i++) {
+
+        struct iovec *iovP  = &(m_rxIovecs[i * RX_SLOT_IOVECS]);
+        uint8_t      *slotP = &(m_incomingBuffer[i * MAX_MTU_SIZE]);
+
+        m_rxMessages[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE; // returned length
+
+        if (false == m_rxPredictionValid   ||
+            0 == m_rxPredictedStride       ||
+            offset >= m_rxPredictedLength) {
+
+            iovP[0].iov_base = slotP;
+            iovP[0].iov_len  = MAX_MTU_SIZE;
+
+            m_rxMessages[i].msg_hdr.msg_iovlen = 1;
+            continue;
+        }
+
+        iovP[0].iov_base = slotP;
+        iovP[0].iov_len  = sizeof(wire::Header);
+        iovP[1].iov_base = streamP + offset;
+        iovP[1].iov_len  = std::min(m_rxPredictedStride,
+                                    m_rxPredictedLength - offset);
+        iovP[2].iov_base = slotP + sizeof(wire::Header);
+        iovP[2].iov_len  = MAX_MTU_SIZE - sizeof(wire::Header);
+
+        m_rxMessages[i].msg_hdr.msg_iovlen = RX_SLOT_IOVECS;
+
+        offset    += m_rxPredictedStride;
+        predicted ++;
+    }
+
+    return predicted;
+}
+
 //
 // Handles any incoming packets
+//
+// Datagrams are received in batches of up to RX_BATCH_DEPTH per
+// system call, each into its own MTU-sized slot.
 
-void impl::handle()
+uint32_t impl::handle()
 {
     utility::ScopedLock lock(m_rxLock);
 
+    if (RxBackend_PacketRing == m_rxBackend)
+        return handleRing();
+
+    uint32_t received = 0;
+
     for(;;) {
- 
+
         //
-        // Receive the packet
-        
-        const ssize_t bytesRead = recvfrom(m_serverSocket,
-                                           m_incomingBuffer.data(),
-                                           m_incomingBuffer.size(),
-                                           0, NULL, NULL);
+        // Receive a batch of datagrams
+
+        const uint32_t predicted = predictBatch();
+        const int32_t  count     = recvmmsg(m_serverSocket,
+                                            &(m_rxMessages[0]),
+                                            RX_BATCH_DEPTH,
+                                            MSG_DONTWAIT, NULL);
         //
         // Nothing left to read
-        
-        if (bytesRead < 0)
+
+        if (count <= 0)
             break;
 
+        received += count;
+
         //
-        // Check for undersized packets
+        // Processing may move the prediction on to another message, so
+        // keep hold of the buffer the kernel wrote into for this batch.
 
-        else if (bytesRead < (ssize_t) sizeof(wire::Header))
-            CRL_EXCEPTION("undersized packet: %d/%d bytes\n",
-                          bytesRead, sizeof(wire::Header));
+        utility::BufferStreamWriter batchStream(m_rxPredictedStream);
+        const uint16_t              batchSequence = m_rxPredictedWireSequence;
+        const uint8_t              *baseP         = reinterpret_cast<const uint8_t*>(batchStream.data());
 
         //
-        // For convenience below
+        // Check that each datagram scattered into the message buffer
+        // landed where we expected it. If not, gather it back into its
+        // slot and take the copying path.
+        //
+        // This is done for the whole batch before anything is assembled,
+        // as a datagram that arrived early is assembled over the place
+        // where a later slot's datagram was received.
 
-        const uint8_t *inP = reinterpret_cast<const uint8_t*>(m_incomingBuffer.data());
+        uint32_t       zeroCopies = 0;
+        uint32_t       misses     = 0;
+        uint32_t       lengths [RX_BATCH_DEPTH];
+        const uint8_t *payloads[RX_BATCH_DEPTH];
 
-        //
-        // Validate the header
+        for(int32_t i=0; i<count; i++) {
 
-        const wire::Header& header = *(reinterpret_cast<const wire::Header*>(inP));
+            uint8_t        *slotP    = &(m_incomingBuffer[i * MAX_MTU_SIZE]);
+            uint32_t&       length   = lengths[i];
+            const uint8_t *&payloadP = payloads[i];
 
-        if (wire::HEADER_MAGIC != header.magic)
-            CRL_EXCEPTION("bad protocol magic: 0x%x, expecting 0x%x",
-                          header.magic, wire::HEADER_MAGIC);
-        else if (wire::HEADER_VERSION != header.version)
-            CRL_EXCEPTION("bad protocol version: 0x%x, expecting 0x%x",
-                          header.version, wire::HEADER_VERSION);
-        else if (wire::HEADER_GROUP != header.group)
-            CRL_EXCEPTION("bad protocol group: 0x%x, expecting 0x%x",
-                          header.group, wire::HEADER_GROUP);
+            length   = m_rxMessages[i].msg_len;
+            payloadP = NULL;
 
-        //
-        // Unwrap the sequence identifier
+            if (static_cast<uint32_t>(i) < predicted &&
+                length >= sizeof(wire::Header)) {
+
+                const wire::Header& header = *(reinterpret_cast<const wire::Header*>(slotP));
+                const struct iovec& iov    = m_rxIovecs[i * RX_SLOT_IOVECS + 1];
+                uint8_t            *destP  = reinterpret_cast<uint8_t*>(iov.iov_base);
+                const uint32_t      bytes  = length - sizeof(wire::Header);
+
+                if (batchSequence == header.sequenceIdentifier                &&
+                    static_cast<uint32_t>(destP - baseP) == header.byteOffset &&
+                    bytes <= iov.iov_len) {
+
+                    payloadP = destP;
+                    zeroCopies ++;
+
+                } else {
+
+                    const uint32_t inPlace  = std::min(bytes, static_cast<uint32_t>(iov.iov_len));
+                    const uint32_t overflow = std::min(bytes - inPlace,
+                                                       static_cast<uint32_t>(MAX_MTU_SIZE - sizeof(wire::Header) - inPlace));
 
-        const int64_t& sequence = unwrapSequenceId(header.sequenceIdentifier);
+                    memmove(slotP + sizeof(wire::Header) + inPlace,
+                            slotP + sizeof(wire::Header), overflow);
+                    memcpy(slotP + sizeof(wire::Header), destP, inPlace);
+
+                    length = sizeof(wire::Header) + inPlace + overflow;
+                    misses ++;
+                }
+            }
+        }
 
         //
-        // See if we are already tracking this messge ID
+        // Process each datagram in turn. A malformed datagram must not
+        // cost us the remainder of the batch.
 
-        UdpTracker *trP = m_udpTrackerCache.find(sequence);
-        if (NULL == trP) {
+        for(int32_t i=0; i<count; i++) {
 
-            //
-            // If we drop first packet, we will drop entire message. Currently we 
-            // require the first datagram in order to assign an assembler.
-            // TODO: re-think this.
+            try {
 
-            if (0 != header.byteOffset)
-                continue;
-            else {
+                handleDatagram(&(m_incomingBuffer[i * MAX_MTU_SIZE]), lengths[i], payloads[i],
+                               rxTimestamp(m_rxMessages[i].msg_hdr));
 
-                //
-                // Create a new tracker for this sequence id.
+            } catch (const std::exception& e) {
 
-                trP = new UdpTracker(header.messageLength,
-                                     getUdpAssembler(inP, bytesRead),
-                                     findFreeBuffer(header.messageLength));
+                CRL_DEBUG("exception while decoding packet: %s\n", e.what());
+
+            } catch ( ... ) {
+
+                CRL_DEBUG("unknown exception while decoding packet\n");
             }
         }
-     
+
         //
-        // Assemble the datagram into the message stream, returns true if the
-        // assembly is complete.
+        // Record the batching factor
 
-        if (true == trP->assemble(bytesRead - sizeof(wire::Header),
-                                  header.byteOffset,
-                                  &(inP[sizeof(wire::Header)]))) {
+        {
+            utility::ScopedLock statsLock(m_statisticsLock);
 
-            //
-            // Dispatch to any listeners
+            m_rxSystemCalls           += 1;
+            m_rxDatagrams             += count;
+            m_rxBatchHistogram[count] += 1;
+            m_rxZeroCopyDatagrams     += zeroCopies;
+            m_rxZeroCopyMisses        += misses;
+        }
 
-            dispatch(trP->stream());
+        //
+        // A short batch means the socket has been drained
 
-            //
-            // Release the tracker
+        if (count < static_cast<int32_t>(RX_BATCH_DEPTH))
+            break;
+    }
+
+    return received;
+}
+
+//
+// Process every block the kernel has retired to us from the packet ring.
+// Packets are read in place, no system call is made. m_rxLock must be
+// held.
+
+uint32_t impl::handleRing()
+{
+    uint32_t received = 0;
+
+    for(;;) {
+
+        struct tpacket_block_desc *blockP = reinterpret_cast<struct tpacket_block_desc*>(
+            m_ringP + (m_ringBlockIndex * RX_RING_BLOCK_SIZE));
+
+        if (0 == (blockP->hdr.bh1.block_status & TP_STATUS_USER))
+            break;
+
+        __sync_synchronize(); // block contents are valid once the status is
+
+        const uint32_t  count = blockP->hdr.bh1.num_pkts;
+        const uint8_t  *pktP  = reinterpret_cast<const uint8_t*>(blockP) +
+                                blockP->hdr.bh1.offset_to_first_pkt;
 
-            if (1 == trP->packets())
-                delete trP; // has not yet been cached
-            else
-                m_udpTrackerCache.remove(sequence);
+        for(uint32_t i=0; i<count; i++) {
 
-        } else if (1 == trP->packets()) {
+            const struct tpacket3_hdr *headerP = reinterpret_cast<const struct tpacket3_hdr*>(pktP);
+            const struct sockaddr_ll  *linkP   = reinterpret_cast<const struct sockaddr_ll*>(
+                pktP + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
 
             //
-            // Cache the tracker, as more UDP packets are
-            // forthcoming for this message.
+            // The filter has already matched protocol, addresses and
+            // port; just make sure the headers are within the capture.
+
+            const uint8_t  *ipP      = pktP + headerP->tp_net;
+            const uint32_t  captured = headerP->tp_snaplen;
+
+            if (PACKET_OUTGOING != linkP->sll_pkttype && captured >= 20) {
+
+                const uint32_t ipHeader = 4 * (ipP[0] & 0x0f);
+
+                if (captured >= ipHeader + 8) {
+
+                    const uint8_t  *udpP      = ipP + ipHeader;
+                    const uint32_t  udpLength = std::min(static_cast<uint32_t>((udpP[4] << 8) | udpP[5]),
+                                                         captured - ipHeader);
+                    //
+                    // The ring's packet headers carry the kernel's
+                    // receive timestamp
 
-            m_udpTrackerCache.insert(sequence, trP);
+                    const double arrival = (static_cast<double>(headerP->tp_sec) +
+                                            1e-9 * static_cast<double>(headerP->tp_nsec));
+
+                    if (udpLength > 8) try {
+
+                        handleDatagram(udpP + 8, udpLength - 8, NULL, arrival);
+
+                    } catch (const std::exception& e) {
+
+                        CRL_DEBUG("exception while decoding packet: %s\n", e.what());
+
+                    } catch ( ... ) {
+
+                        CRL_DEBUG("unknown exception while decoding packet\n");
+                    }
+                }
+            }
+
+            pktP += headerP->tp_next_offset;
         }
+
+        //
+        // Hand the block back to the kernel
+
+        __sync_synchronize();
+        blockP->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        m_ringBlockIndex             = (m_ringBlockIndex + 1) % RX_RING_BLOCK_COUNT;
+
+        received += count;
+    }
+
+    if (received) {
+        utility::ScopedLock statsLock(m_statisticsLock);
+        m_rxDatagrams += received;
     }
+
+    return received;
 }
 
 //
 // This thread waits for UDP packets
+//
+// How it waits depends on the polling mode, see setRxPollMode()
 
 void *impl::rxThread(void *userDataP)
 {
-    impl     *selfP  = reinterpret_cast<impl*>(userDataP);
-    const int server = selfP->m_serverSocket;
-    fd_set    readSet;
+    impl        *selfP      = reinterpret_cast<impl*>(userDataP);
+    const int    epollFd    = selfP->m_rxEpollFd;
+    double       lastRxTime = 0.0;
+    double       lastFlush  = 0.0;
+    epoll_event  event;
+
+    selfP->m_rxNumaNode = utility::Arena::currentNumaNode();
 
     //
     // Loop until shutdown
 
     while(selfP->m_threadsRunning) {
 
+        const RxPollMode mode    = selfP->m_rxPollMode;
+        int32_t          timeout = RX_POLL_TIMEOUT_MS;
+
         //
-        // Add the server socket to the read set.
+        // Frame sets that will not complete (their sources stopped,
+        // or were never started) are let go of even while nothing
+        // arrives, so they do not hold on to RX buffers
+
+        const double current = utility::TimeStamp::getMonotonicTime();
 
-        FD_ZERO(&readSet);
-        FD_SET(server, &readSet);
+        if (current - lastFlush >= FRAME_SET_FLUSH_INTERVAL) {
+            selfP->m_frameSetListeners.flush(current, selfP->m_streamsEnabled);
+            lastFlush = current;
+        }
 
         //
-        // Wait for a new packet to arrive, timing out every once in awhile
+        // Busy-polling reads the socket directly, the kernel
+        // polls the device queue on our behalf (SO_BUSY_POLL).
+        //
+        // Adaptive polling keeps checking without sleeping for
+        // a short while after the last datagram.
 
-        struct timeval tv = {0, 200000}; // 5Hz
-        const int result  = select(server+1, &readSet, NULL, NULL, &tv);
-        if (result <= 0)
-            continue;
+        if (RxPoll_Adaptive == mode) {
+
+            const double window = 1e-6 * selfP->m_rxSpinMicroseconds;
+
+            if (current - lastRxTime < window)
+                timeout = 0;
+        }
+
+        if (RxPoll_BusyPoll != mode) {
+
+            const int result = epoll_wait(epollFd, &event, 1, timeout);
+            if (result <= 0) {
+
+                //
+                // Keep track of where we are running while idle, so
+                // buffers can be placed near us (see setRxBufferArena())
+
+                if (0 == result && 0 != timeout)
+                    selfP->m_rxNumaNode = utility::Arena::currentNumaNode();
+                continue;
+            }
+        }
 
         //
         // Let the comm object handle decoding
 
         try {
 
-            selfP->handle();
+            if (selfP->handle() > 0 && RxPoll_Adaptive == mode)
+                lastRxTime = utility::TimeStamp::getMonotonicTime();
 
         } catch (const std::exception& e) {
                     
@@ -0,0 +1,251 @@
+/**
+ * @file LibMultiSense/details/frameset.cc
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "details/frameset.hh"
+
+#include "details/utility/TimeStamp.hh"
+
+namespace crl {
+namespace multisense {
+namespace details {
+
+//
+// Construction/destruction
+
+FrameSetListener::FrameSetListener(image::FrameSetCallback c,
+                                   DataSource              s,
+                                   void                   *d,
+                                   uint32_t                m,
+                                   uint32_t                f,
+                                   double                  t,
+                                   Converter<image::Header> *cP) :
+    Strand(WorkerPool::acquire()),
+    m_callback(c),
+    m_sourceMask(s),
+    m_userDataP(d),
+    m_flags(f),
+    m_timeout(t),
+    m_assembling(),
+    m_enabled(0),
+    m_running(false),
+    m_queue(m),
+    m_dispatchThreadP(NULL),
+    m_converterP(cP),
+    m_converted()
+{
+    const double now = utility::TimeStamp::getMonotonicTime();
+
+    for(uint32_t i=0; i<sizeof(DataSource) * 8; i++)
+        m_arrived[i] = now;
+
+    if (NULL == pool()) {
+        m_running         = true;
+        m_dispatchThreadP = new utility::Thread(dispatchThread, this);
+        m_dispatchThreadP->setName("ms-cb-frameset");
+    }
+}
+
+FrameSetListener::~FrameSetListener()
+{
+    if (m_running) {
+        m_running = false;
+        m_queue.kick();
+        delete m_dispatchThreadP;
+    } else
+        detach();
+}
+
+//
+// Threads of the shared pool are left alone
+
+void FrameSetListener::setThreadPolicy(const ThreadPolicy& policy)
+{
+    if (m_dispatchThreadP)
+        m_dispatchThreadP->setPolicy(policy.scheduler,
+                                     policy.priority,
+                                     policy.cpus);
+}
+
+//
+// Add an image to the set of its frameId
+
+void FrameSetListener::dispatch(utility::BufferStream& buffer,
+                                image::Header&         header)
+{
+    if (false == header.inMask(m_sourceMask))
+        return;
+
+    const double now = utility::TimeStamp::getMonotonicTime();
+
+    for(DataSource bits = header.source; 0 != bits; bits &= bits - 1)
+        m_arrived[__builtin_ctz(bits)] = now;
+
+    flush(now, m_enabled);
+
+    std::deque<Assembly>::iterator it;
+    for(it  = m_assembling.begin();
+        it != m_assembling.end();
+        it ++)
+        if (it->set.frameId == header.frameId)
+            break;
+
+    if (m_assembling.end() == it) {
+
+        if (m_assembling.size() >= MAX_ASSEMBLING) {
+            post(m_assembling.front());
+            m_assembling.pop_front();
+        }
+
+        m_assembling.push_back(Assembly());
+
+        it              = m_assembling.end() - 1;
+        it->set.frameId = header.frameId;
+        it->started     = now;
+
+    } else if (it->set.sources & header.source)
+        return; // a duplicate
+
+    it->set.sources |= header.source;
+    it->set.images.push_back(header);
+    it->buffers.push_back(buffer);
+
+    const DataSource awaited = expected(now);
+
+    if ((it->set.sources & awaited) == awaited) {
+        post(*it);
+        m_assembling.erase(it);
+    }
+}
+
+//
+// Dispatch the sets that can not usefully wait any longer
+
+void FrameSetListener::flush(double     now,
+                             DataSource enabled)
+{
+    m_enabled = enabled;
+
+    const DataSource awaited = expected(now);
+
+    std::deque<Assembly>::iterator it = m_assembling.begin();
+
+    while(m_assembling.end() != it)
+        if ((it->set.sources & awaited) == awaited ||
+            now - it->started > m_timeout) {
+            post(*it);
+            it = m_assembling.erase(it);
+        } else
+            it ++;
+}
+
+//
+// The requested sources that are streaming
+
+DataSource FrameSetListener::expected(double now) const
+{
+    DataSource awaited = m_sourceMask & m_enabled;
+
+    for(DataSource bits = m_sourceMask & ~awaited; 0 != bits; bits &= bits - 1) {
+
+        const uint32_t bit = __builtin_ctz(bits);
+
+        if (now - m_arrived[bit] <= m_timeout)
+            awaited |= (1u << bit);
+    }
+
+    return awaited;
+}
+
+//
+// Queue a set for the callback
+
+void FrameSetListener::post(const Assembly& assembly)
+{
+    if (m_queue.post(assembly))
+        schedule();
+}
+
+//
+// Invoke the callback, unpacking disparity images first unless the
+// user asked for them packed
+
+void FrameSetListener::invoke(Assembly& assembly)
+{
+    try {
+
+        if (m_converted.size() < assembly.set.images.size())
+            m_converted.resize(assembly.set.images.size());
+
+        for(uint32_t i=0; i<assembly.set.images.size(); i++)
+            m_converterP->convert(assembly.set.images[i], m_flags, m_converted[i]);
+
+        dispatchBufferReferenceTP = NULL;
+
+        m_callback(assembly.set, m_userDataP);
+
+        //
+        // Let go of the converted images, so the converter can reuse
+        // their buffers
+
+        for(uint32_t i=0; i<m_converted.size(); i++)
+            m_converted[i] = utility::BufferStreamWriter();
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception invoking frame set callback: %s\n",
+                  e.what());
+    } catch ( ... ) {
+        CRL_DEBUG("unknown exception invoking frame set callback\n");
+    }
+}
+
+//
+// The dispatch thread
+
+void *FrameSetListener::dispatchThread(void *argumentP)
+{
+    FrameSetListener *selfP = reinterpret_cast<FrameSetListener*>(argumentP);
+
+    while(selfP->m_running) {
+        Assembly assembly;
+        if (false == selfP->m_queue.wait(assembly))
+            break;
+        selfP->invoke(assembly);
+    }
+
+    return NULL;
+}
+
+//
+// As a strand of the shared pool
+
+bool FrameSetListener::run()
+{
+    Assembly assembly;
+    if (false == m_queue.tryWait(assembly))
+        return false;
+    invoke(assembly);
+    return true;
+}
+
+}; // namespace details
+}; // namespace multisense
+}; // namespace crl
@@ -0,0 +1,144 @@
+/**
+ * @file LibMultiSense/details/frameset.hh
+ *
+ * Declares the listener that assembles images of several sources
+ * into frame sets.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LibMultiSense_details_frameset_hh
+#define LibMultiSense_details_frameset_hh
+
+#include "details/listeners.hh"
+
+#include <deque>
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+
+//
+// Collects the images of each frameId, in the RX thread, into a
+// FrameSet, and dispatches the set as a Listener does.
+//
+// A set is dispatched once it holds every requested source that is
+// streaming. An incomplete set is dispatched once it is older than
+// the timeout, or to make room for a newer set. The RX thread checks
+// as images arrive, and calls flush() regularly in between.
+//
+// A source is taken to be streaming if it was enabled by the channel,
+// or one of its images arrived within the timeout. Every source is
+// taken to have just arrived when the listener is created, so sources
+// streamed by someone else are waited for from the start.
+//
+// Each image's buffer is referenced by the set until its callback
+// returns.
+
+class FrameSetListener : public Strand {
+public:
+
+    FrameSetListener(image::FrameSetCallback c,
+                     DataSource              s,
+                     void                   *d,
+                     uint32_t                m,
+                     uint32_t                f,
+                     double                  t,
+                     Converter<image::Header> *cP);
+    ~FrameSetListener();
+
+    void dispatch(utility::BufferStream& buffer,
+                  image::Header&         header);
+
+    //
+    // Dispatch the sets that are complete, given the sources now
+    // enabled, or too old
+
+    void flush(double     now,
+               DataSource enabled);
+
+    image::FrameSetCallback callback()   { return m_callback;       };
+    DataSource              sourceMask() { return m_sourceMask;     };
+    uint64_t                drops()      { return m_queue.drops();  };
+
+    void setThreadPolicy(const ThreadPolicy& policy);
+
+private:
+
+    //
+    // Sets being assembled at once, at most
+
+    static const uint32_t MAX_ASSEMBLING = 4;
+
+    class Assembly {
+    public:
+
+        Assembly() : set(), buffers(), started(0.0) {};
+
+        image::FrameSet                    set;
+        std::vector<utility::BufferStream> buffers;
+        double                             started; // monotonic seconds
+    };
+
+    void       post    (const Assembly& assembly);
+    void       invoke  (Assembly& assembly);
+    DataSource expected(double now) const;
+
+    static void *dispatchThread(void *argumentP);
+
+    bool     run();
+    uint32_t pending() { return m_queue.size(); };
+
+    //
+    // Set by user
+
+    image::FrameSetCallback m_callback;
+    DataSource              m_sourceMask;
+    void                   *m_userDataP;
+    uint32_t                m_flags;
+    double                  m_timeout;
+
+    //
+    // Assembly, only touched by the RX thread
+
+    std::deque<Assembly> m_assembling;
+    DataSource           m_enabled;
+    double               m_arrived[sizeof(DataSource) * 8]; // monotonic seconds, per source bit
+
+    //
+    // Dispatch mechanism
+
+    volatile bool                       m_running;
+    utility::BoundedWaitQueue<Assembly> m_queue;
+    utility::Thread                    *m_dispatchThreadP;
+
+    //
+    // Shared by the channel's image listeners (see Converter), and
+    // the converted images of the set being delivered, one per place
+
+    Converter<image::Header>                *m_converterP;
+    std::vector<utility::BufferStreamWriter> m_converted;
+};
+
+}; // namespace details
+}; // namespace multisense
+}; // namespace crl
+
+#endif // LibMultiSense_details_frameset_hh
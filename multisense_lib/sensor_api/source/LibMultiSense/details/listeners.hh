@@ -31,6 +31,11 @@
 
 #include "details/utility/Thread.hh"
 #include "details/utility/BufferStream.hh"
+#include "details/utility/BoundedQueue.hh"
+#include "details/workers.hh"
+
+#include <sched.h>
+#include <vector>
 
 namespace crl {
 namespace multisense {
@@ -41,64 +46,152 @@ namespace details {
 
 extern __thread utility::BufferStream *dispatchBufferReferenceTP;
 
+//
+// Converts a datum to the form a listener asked for (see the
+// Callback_* flags), in the listener's dispatch thread.
+//
+// One converter is shared by all of a channel's listeners, so a datum
+// is converted once however many listeners want it converted: the
+// first listener to run converts it, the others reuse the result.
+// convert() returns true if the header now references [converted],
+// false to deliver the datum as received.
+
+template<class HEADER> class Converter {
+public:
+    bool convert(HEADER&                      header,
+                 uint32_t                     flags,
+                 utility::BufferStreamWriter& converted) { return false; };
+};
+
+template<> class Converter<image::Header> {
+public:
+    bool convert(image::Header&               header,
+                 uint32_t                     flags,
+                 utility::BufferStreamWriter& converted);
+
+private:
+
+    //
+    // The latest image unpacked from one disparity source. A buffer
+    // is only written while no listener or user holds it (see
+    // reserveCallbackBuffer()); the previous one is kept as a spare,
+    // so that while it is still held the next image is unpacked
+    // without allocating.
+
+    struct Unpacked {
+        Unpacked() : packedP(NULL), frameId(-1) {};
+
+        utility::Mutex              lock;
+        const void                 *packedP;
+        int64_t                     frameId;
+        utility::BufferStreamWriter current;
+        utility::BufferStreamWriter spare;
+    };
+
+    Unpacked m_left;
+    Unpacked m_right;
+};
+
+//
+// The name of a listener's dispatch thread
+
+template<class HEADER> const char *dispatchThreadName()      { return "ms-callback";  };
+template<> inline const char *dispatchThreadName<image::Header>() { return "ms-cb-image"; };
+template<> inline const char *dispatchThreadName<lidar::Header>() { return "ms-cb-lidar"; };
+template<> inline const char *dispatchThreadName<pps::Header>()   { return "ms-cb-pps";   };
+template<> inline const char *dispatchThreadName<imu::Header>()   { return "ms-cb-imu";   };
+
 //
 // The dispatch mechanism. Each instance represents a bound
 // listener to a datum stream.
+//
+// A listener has its own dispatch thread, unless a shared WorkerPool
+// was configured when it was created; it is then run as a strand
+// of the pool.
 
 template<class HEADER, class CALLBACK>
-class Listener {
+class Listener : public Strand {
 public:
     
-    Listener(CALLBACK   c,
-             DataSource s,
-             void      *d,
-             uint32_t   m=0)
-        : m_callback(c),
+    Listener(CALLBACK          c,
+             DataSource        s,
+             void             *d,
+             uint32_t          m,
+             uint32_t          f=0,
+             utility::Overflow o=utility::Overflow_DropOldest,
+             double            t=0.0,
+             Converter<HEADER> *cP=NULL)
+        : Strand(WorkerPool::acquire()),
+          m_callback(c),
           m_sourceMask(s),
           m_userDataP(d),
+          m_flags(f),
           m_running(false),
-          m_queue(m),
-          m_dispatchThreadP(NULL) {
+          m_queue(m, o, t),
+          m_dispatchThreadP(NULL),
+          m_converterP(cP) {
         
-        m_running         = true;
-        m_dispatchThreadP = new utility::Thread(dispatchThread, this);
+        if (NULL == pool()) {
+            m_running         = true;
+            m_dispatchThreadP = new utility::Thread(dispatchThread, this);
+            m_dispatchThreadP->setName(dispatchThreadName<HEADER>());
+        }
     };
 
     Listener() :
+        Strand(NULL),
         m_callback(NULL),
         m_sourceMask(0),
         m_userDataP(NULL),
+        m_flags(0),
         m_running(false),
-        m_queue(),
-        m_dispatchThreadP(NULL) {};
+        m_queue(1),
+        m_dispatchThreadP(NULL),
+        m_converterP(NULL) {};
 
     ~Listener() {
         if (m_running) {
             m_running = false;
             m_queue.kick();
             delete m_dispatchThreadP;
-        }
+        } else
+            detach();
     };
 
     void dispatch(HEADER& header) {
 
-        if (header.inMask(m_sourceMask))
-            m_queue.post(Dispatch(m_callback,
-                                  header,
-                                  m_userDataP));
+        if (header.inMask(m_sourceMask) &&
+            m_queue.post(m_callback,
+                         header,
+                         m_userDataP))
+            schedule();
     };
 
     void dispatch(utility::BufferStream& buffer,
                   HEADER&                header) {
 
-        if (header.inMask(m_sourceMask))
-            m_queue.post(Dispatch(m_callback,
-                                  buffer,
-                                  header,
-                                  m_userDataP));
+        if (header.inMask(m_sourceMask) &&
+            m_queue.post(m_callback,
+                         buffer,
+                         header,
+                         m_userDataP,
+                         m_flags))
+            schedule();
     };
 
-    CALLBACK callback() { return m_callback; };
+    CALLBACK   callback()   { return m_callback;   };
+    DataSource sourceMask() { return m_sourceMask; };
+    uint64_t   drops()      { return m_queue.drops(); };
+
+    //
+    // Threads of the shared pool are left alone
+
+    void setThreadPolicy(const ThreadPolicy& policy) {
+        if (m_dispatchThreadP)
+            m_dispatchThreadP->setPolicy(policy.scheduler,
+                                         policy.priority,
+                                         policy.cpus);
+    };
 
 private:
 
@@ -108,36 +201,49 @@ private:
     class Dispatch {
     public:
 
-        Dispatch(CALLBACK  c,
-                 HEADER&   h,
-                 void     *d) :
+        Dispatch(CALLBACK      c,
+                 const HEADER& h,
+                 void         *d) :
             m_callback(c),
             m_exposeBuffer(false),
             m_header(h),
-            m_userDataP(d) {};
-
-        Dispatch(CALLBACK               c,
-                 utility::BufferStream& b,
-                 HEADER&                h,
-                 void                  *d) :
+            m_userDataP(d),
+            m_flags(0) {};
+
+        Dispatch(CALLBACK                     c,
+                 const utility::BufferStream& b,
+                 const HEADER&                h,
+                 void                        *d,
+                 uint32_t                     f) :
             m_callback(c),
             m_buffer(b),
             m_exposeBuffer(true),
             m_header(h),
-            m_userDataP(d) {};
+            m_userDataP(d),
+            m_flags(f) {};
 
         Dispatch() :
             m_callback(NULL),
             m_buffer(),
             m_exposeBuffer(false),
             m_header(),
-            m_userDataP(NULL) {};
+            m_userDataP(NULL),
+            m_flags(0) {};
 
-        void operator() (void) {
+        void operator() (Converter<HEADER> *converterP) {
 
             if (m_callback) {
+
+                //
+                // Holds the converted data for the callback's duration
+
+                utility::BufferStreamWriter converted;
+
                 if (m_exposeBuffer)
-                    dispatchBufferReferenceTP = &m_buffer;
+                    dispatchBufferReferenceTP = ((converterP &&
+                                                  converterP->convert(m_header, m_flags, converted)) ?
+                                                 &converted : &m_buffer);
+
                 m_callback(m_header, m_userDataP);
             }
         };
@@ -149,49 +255,74 @@ private:
         bool                  m_exposeBuffer;
         HEADER                m_header;
         void                 *m_userDataP;
+        uint32_t              m_flags;
+    };
+
+    static void invoke(Dispatch&          d,
+                       Converter<HEADER> *converterP) {
+        try {
+            d(converterP);
+        } catch (const std::exception& e) {
+            CRL_DEBUG("exception invoking image callback: %s\n",
+                      e.what());
+        } catch ( ... ) {
+            CRL_DEBUG("unknown exception invoking image callback\n");
+        }
     };
 
     //
     // The dispatch thread
     //
-    // We are penalized with two memory copies of
-    // HEADER by std::deque, but the image/lidar data
-    // is zero-copy (reference-counted by BufferStream)
+    // Each Dispatch is constructed in place in the queue, and copied
+    // out once. The image/lidar data is zero-copy (reference-counted
+    // by BufferStream)
 
     static void *dispatchThread(void *argumentP) {
         
         Listener<HEADER,CALLBACK> *selfP = reinterpret_cast< Listener<HEADER,CALLBACK> * >(argumentP);
     
         while(selfP->m_running) {
-            try {
-                Dispatch d;
-                if (false == selfP->m_queue.wait(d))
-                    break;
-                d();
-            } catch (const std::exception& e) {
-                CRL_DEBUG("exception invoking image callback: %s\n",
-                          e.what());
-            } catch ( ... ) {
-                CRL_DEBUG("unknown exception invoking image callback\n");
-            }
+            Dispatch d;
+            if (false == selfP->m_queue.wait(d))
+                break;
+            invoke(d, selfP->m_converterP);
         };
 
         return NULL;
     }
 
+    //
+    // As a strand of the shared pool
+
+    bool run() {
+        Dispatch d;
+        if (false == m_queue.tryWait(d))
+            return false;
+        invoke(d, m_converterP);
+        return true;
+    };
+
+    uint32_t pending() { return m_queue.size(); };
+
     //
     // Set by user
 
     CALLBACK   m_callback;
     DataSource m_sourceMask;
     void      *m_userDataP;
+    uint32_t   m_flags;
 
     //
     // Dispatch mechanism
     
-    volatile bool                m_running;
-    utility::WaitQueue<Dispatch> m_queue;
-    utility::Thread             *m_dispatchThreadP;
+    volatile bool                       m_running;
+    utility::BoundedWaitQueue<Dispatch> m_queue;
+    utility::Thread                    *m_dispatchThreadP;
+
+    //
+    // Shared by the channel's listeners, may be NULL
+
+    Converter<HEADER>                  *m_converterP;
 };
 
 typedef Listener<image::Header, image::Callback> ImageListener;
@@ -199,6 +330,221 @@ typedef Listener<lidar::Header, lidar::Callback> LidarListener;
 typedef Listener<pps::Header,   pps::Callback>   PpsListener;
 typedef Listener<imu::Header,   imu::Callback>   ImuListener;
 
+//
+// The route a datum takes through a ListenerSet: the index of its
+// source bit, or -1 to offer it to every listener
+
+template<class HEADER>
+int32_t routeOf(const HEADER& header) { return -1; };
+
+template<>
+inline int32_t routeOf<image::Header>(const image::Header& header) {
+    const DataSource source = header.source;
+    if (0 == source || 0 != (source & (source - 1)))
+        return -1;
+    return __builtin_ctz(source);
+};
+
+//
+// A set of listeners that the RX thread walks without locking
+//
+// Writers (serialized by the caller) publish a new copy of the set,
+// then wait until no reader can still be walking the old copy before
+// freeing it. Readers count themselves in one of two counters; each
+// writer flips between them, so new readers cannot keep the counter
+// it is waiting on from draining (as in sleepable RCU.)
+//
+// Each copy also routes every source bit to the listeners whose mask
+// holds it, so a datum is only offered to listeners that want it.
+//
+// Removed listeners are handed back, to be deleted (which may join
+// a dispatch thread) once the caller has let go of its lock.
+
+template<class LISTENER> class ListenerSet {
+public:
+
+    typedef std::vector<LISTENER*> List;
+
+    ListenerSet() : m_currentP(new Snapshot), m_epoch(0) {
+        m_readers[0] = m_readers[1] = 0;
+    };
+
+    ~ListenerSet() {
+        delete m_currentP;
+    };
+
+    //
+    // Readers
+
+    template<class HEADER> void dispatch(HEADER& header) {
+        ReadSection section(*this);
+        const List& list = section.snapshot().route(routeOf(header));
+
+        for(uint32_t i=0; i<list.size(); i++)
+            list[i]->dispatch(header);
+    };
+
+    template<class HEADER> void dispatch(utility::BufferStream& buffer,
+                                         HEADER&                header) {
+        ReadSection section(*this);
+        const List& list = section.snapshot().route(routeOf(header));
+
+        for(uint32_t i=0; i<list.size(); i++)
+            list[i]->dispatch(buffer, header);
+    };
+
+    //
+    // Let frame set listeners dispatch what can not wait any longer
+    // (see FrameSetListener::flush())
+
+    void flush(double     now,
+               DataSource enabled) {
+        ReadSection section(*this);
+        const List& list = section.snapshot().listeners;
+
+        for(uint32_t i=0; i<list.size(); i++)
+            list[i]->flush(now, enabled);
+    };
+
+    //
+    // The union of the listeners' source masks, or 0 if there are none
+
+    DataSource sources() {
+        ReadSection section(*this);
+        return section.snapshot().sources;
+    };
+
+    //
+    // The listeners, valid until the caller lets another writer in
+
+    const List& listeners() const {
+        return m_currentP->listeners;
+    };
+
+    //
+    // The listener for a callback, valid until the caller lets
+    // another writer in
+
+    template<class CALLBACK> LISTENER *find(CALLBACK callback) {
+        const List& current = m_currentP->listeners;
+
+        for(uint32_t i=0; i<current.size(); i++)
+            if (current[i]->callback() == callback)
+                return current[i];
+
+        return NULL;
+    };
+
+    //
+    // Writers
+
+    void add(LISTENER *listenerP) {
+        List next(m_currentP->listeners);
+        next.push_back(listenerP);
+        publish(new Snapshot(next));
+    };
+
+    template<class CALLBACK> LISTENER *remove(CALLBACK callback) {
+        const List& current = m_currentP->listeners;
+
+        for(uint32_t i=0; i<current.size(); i++)
+            if (current[i]->callback() == callback) {
+
+                LISTENER *listenerP = current[i];
+                List      next(current);
+
+                next.erase(next.begin() + i);
+                publish(new Snapshot(next));
+
+                return listenerP;
+            }
+
+        return NULL;
+    };
+
+    //
+    // Remove and delete every listener
+
+    void clear() {
+        const List removed = m_currentP->listeners;
+
+        publish(new Snapshot);
+
+        for(uint32_t i=0; i<removed.size(); i++)
+            delete removed[i];
+    };
+
+private:
+
+    static const uint32_t ROUTES = sizeof(DataSource) * 8;
+
+    class Snapshot {
+    public:
+
+        Snapshot() : listeners(), sources(0) {};
+
+        Snapshot(const List& l) : listeners(l), sources(0) {
+            for(uint32_t i=0; i<listeners.size(); i++) {
+
+                const DataSource mask = listeners[i]->sourceMask();
+
+                sources |= mask;
+                for(uint32_t r=0; r<ROUTES; r++)
+                    if (mask & (1u << r))
+                        routes[r].push_back(listeners[i]);
+            }
+        };
+
+        const List& route(int32_t r) const {
+            return (r < 0) ? listeners : routes[r];
+        };
+
+        List       listeners;
+        List       routes[ROUTES];
+        DataSource sources;
+    };
+
+    class ReadSection {
+    public:
+        ReadSection(ListenerSet& s) : m_set(s),
+                                      m_index(m_set.m_epoch & 1) {
+            __sync_fetch_and_add(&m_set.m_readers[m_index], 1);
+            m_snapshotP = m_set.m_currentP;
+        };
+        ~ReadSection() {
+            __sync_fetch_and_sub(&m_set.m_readers[m_index], 1);
+        };
+        const Snapshot& snapshot() const { return *m_snapshotP; };
+    private:
+        ListenerSet&    m_set;
+        const uint32_t  m_index;
+        const Snapshot *m_snapshotP;
+    };
+
+    void publish(Snapshot *nextP) {
+        Snapshot *previousP = m_currentP;
+
+        m_currentP = nextP;
+        __sync_synchronize();
+
+        //
+        // A reader of the previous copy counted itself before loading
+        // it, in either counter, and stays counted until it is done
+
+        for(uint32_t i=0; i<2; i++) {
+            const uint32_t index = __sync_fetch_and_add(&m_epoch, 1) & 1;
+            while(0 != m_readers[index])
+                sched_yield();
+        }
+
+        delete previousP;
+    };
+
+    Snapshot * volatile m_currentP;
+    volatile uint32_t   m_epoch;
+    volatile int32_t    m_readers[2];
+};
+
 }; // namespace details
 }; // namespace multisense
 }; // namespace crl
@@ -74,6 +74,11 @@
 #include "details/wire/SysTestMtuMessage.h"
 #include "details/wire/SysTestMtuResponseMessage.h"
 
+#include <linux/if_packet.h>
+#include <linux/pps.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+
 namespace crl {
 namespace multisense {
 namespace details {
@@ -84,6 +89,80 @@ namespace details {
 
 __thread utility::BufferStream *dispatchBufferReferenceTP = NULL;
 
+namespace {
+
+//
+// The depth and overflow behaviour of a callback's queue. Returns
+// false if the options are not valid.
+
+bool queueOptions(const CallbackQueue& queue,
+                  uint32_t             defaultDepth,
+                  uint32_t&            depth,
+                  utility::Overflow&   overflow)
+{
+    depth = queue.depth ? queue.depth : defaultDepth;
+
+    switch(queue.policy) {
+    case Queue_DropOldest: overflow = utility::Overflow_DropOldest;            break;
+    case Queue_KeepLatest: overflow = utility::Overflow_DropOldest; depth = 1; break;
+    case Queue_DropNewest: overflow = utility::Overflow_DropNewest;            break;
+    case Queue_Block:      overflow = utility::Overflow_Block;                 break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Register a new listener, running its thread as the policy says
+
+template<class LISTENER>
+void addListener(ListenerSet<LISTENER>& listeners,
+                 LISTENER              *listenerP,
+                 const ThreadPolicy&    policy)
+{
+    try {
+        listenerP->setThreadPolicy(policy);
+        listeners.add(listenerP);
+    } catch (...) {
+        delete listenerP;
+        throw;
+    }
+}
+
+//
+// Apply a policy to the threads of registered listeners
+
+template<class LISTENER>
+void applyThreadPolicy(ListenerSet<LISTENER>& listeners,
+                       const ThreadPolicy&    policy)
+{
+    const typename ListenerSet<LISTENER>::List& list = listeners.listeners();
+
+    for(uint32_t i=0; i<list.size(); i++)
+        list[i]->setThreadPolicy(policy);
+}
+
+//
+// The drop count of a callback's queue
+
+template<class LISTENER, class CALLBACK>
+Status callbackDrops(ListenerSet<LISTENER>& listeners,
+                     CALLBACK               callback,
+                     uint64_t&              drops)
+{
+    LISTENER *listenerP = listeners.find(callback);
+    if (NULL == listenerP)
+        return Status_Error;
+
+    drops = listenerP->drops();
+
+    return Status_Ok;
+}
+
+}; // anonymous
+
 //
 //
 // Public API follows
@@ -97,13 +176,48 @@ Status impl::addIsolatedCallback(image::Callback callback,
                                  DataSource     imageSourceMask,
                                  void           *userDataP)
 {
+    return addIsolatedCallback(callback, imageSourceMask, userDataP, Callback_Default);
+}
+
+//
+// Adds a new image listener, with delivery options
+
+Status impl::addIsolatedCallback(image::Callback callback, 
+                                 DataSource      imageSourceMask,
+                                 void           *userDataP,
+                                 CallbackFlags   flags)
+{
+    return addIsolatedCallback(callback, imageSourceMask, userDataP, flags, CallbackQueue());
+}
+
+//
+// Adds a new image listener, with delivery and queue options
+
+Status impl::addIsolatedCallback(image::Callback      callback, 
+                                 DataSource           imageSourceMask,
+                                 void                *userDataP,
+                                 CallbackFlags        flags,
+                                 const CallbackQueue& queue)
+{
+    uint32_t          depth;
+    utility::Overflow overflow;
+
+    if (false == queueOptions(queue, MAX_USER_IMAGE_QUEUE_SIZE, depth, overflow))
+        return Status_Error;
+
     try {
 
         utility::ScopedLock lock(m_dispatchLock);
-        m_imageListeners.push_back(new ImageListener(callback, 
-                                                     imageSourceMask, 
-                                                     userDataP,
-                                                     MAX_USER_IMAGE_QUEUE_SIZE));
+        addListener(m_imageListeners,
+                    new ImageListener(callback,
+                                      imageSourceMask,
+                                      userDataP,
+                                      depth,
+                                      flags,
+                                      overflow,
+                                      queue.timeout,
+                                      &m_imageConverter),
+                    m_dispatchPolicy);
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -118,13 +232,34 @@ Status impl::addIsolatedCallback(image::Callback callback,
 Status impl::addIsolatedCallback(lidar::Callback callback, 
                                  void           *userDataP)
 {
+    return addIsolatedCallback(callback, userDataP, CallbackQueue());
+}
+
+//
+// Adds a new laser listener, with queue options
+
+Status impl::addIsolatedCallback(lidar::Callback      callback, 
+                                 void                *userDataP,
+                                 const CallbackQueue& queue)
+{
+    uint32_t          depth;
+    utility::Overflow overflow;
+
+    if (false == queueOptions(queue, MAX_USER_LASER_QUEUE_SIZE, depth, overflow))
+        return Status_Error;
+
     try {
 
         utility::ScopedLock lock(m_dispatchLock);
-        m_lidarListeners.push_back(new LidarListener(callback, 
-                                                     0,
-                                                     userDataP,
-                                                     MAX_USER_LASER_QUEUE_SIZE));
+        addListener(m_lidarListeners,
+                    new LidarListener(callback,
+                                      Source_Lidar_Scan,
+                                      userDataP,
+                                      depth,
+                                      0,
+                                      overflow,
+                                      queue.timeout),
+                    m_dispatchPolicy);
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -139,13 +274,34 @@ Status impl::addIsolatedCallback(lidar::Callback callback,
 Status impl::addIsolatedCallback(pps::Callback callback, 
                                  void         *userDataP)
 {
+    return addIsolatedCallback(callback, userDataP, CallbackQueue());
+}
+
+//
+// Adds a new PPS listener, with queue options
+
+Status impl::addIsolatedCallback(pps::Callback      callback, 
+                                 void              *userDataP,
+                                 const CallbackQueue& queue)
+{
+    uint32_t          depth;
+    utility::Overflow overflow;
+
+    if (false == queueOptions(queue, MAX_USER_PPS_QUEUE_SIZE, depth, overflow))
+        return Status_Error;
+
     try {
 
         utility::ScopedLock lock(m_dispatchLock);
-        m_ppsListeners.push_back(new PpsListener(callback, 
-                                                 0,
-                                                 userDataP,
-                                                 MAX_USER_PPS_QUEUE_SIZE));
+        addListener(m_ppsListeners,
+                    new PpsListener(callback,
+                                    0,
+                                    userDataP,
+                                    depth,
+                                    0,
+                                    overflow,
+                                    queue.timeout),
+                    m_dispatchPolicy);
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -159,14 +315,64 @@ Status impl::addIsolatedCallback(pps::Callback callback,
 
 Status impl::addIsolatedCallback(imu::Callback callback, 
                                  void         *userDataP)
+{
+    return addIsolatedCallback(callback, userDataP, CallbackQueue());
+}
+
+//
+// Adds a new IMU listener, with queue options
+
+Status impl::addIsolatedCallback(imu::Callback      callback, 
+                                 void              *userDataP,
+                                 const CallbackQueue& queue)
+{
+    uint32_t          depth;
+    utility::Overflow overflow;
+
+    if (false == queueOptions(queue, MAX_USER_IMU_QUEUE_SIZE, depth, overflow))
+        return Status_Error;
+
+    try {
+
+        utility::ScopedLock lock(m_dispatchLock);
+        addListener(m_imuListeners,
+                    new ImuListener(callback,
+                                    Source_Imu,
+                                    userDataP,
+                                    depth,
+                                    0,
+                                    overflow,
+                                    queue.timeout),
+                    m_dispatchPolicy);
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+    return Status_Ok;
+}
+
+//
+// Adds a new frame set listener
+
+Status impl::addIsolatedCallback(image::FrameSetCallback callback,
+                                 DataSource              sourceMask,
+                                 void                   *userDataP,
+                                 double                  timeout,
+                                 CallbackFlags           flags)
 {
     try {
 
         utility::ScopedLock lock(m_dispatchLock);
-        m_imuListeners.push_back(new ImuListener(callback, 
-                                                 0,
-                                                 userDataP,
-                                                 MAX_USER_IMU_QUEUE_SIZE));
+        addListener(m_frameSetListeners,
+                    new FrameSetListener(callback,
+                                         sourceMask,
+                                         userDataP,
+                                         MAX_USER_IMAGE_QUEUE_SIZE,
+                                         flags,
+                                         timeout,
+                                         &m_imageConverter),
+                    m_dispatchPolicy);
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -181,18 +387,15 @@ Status impl::addIsolatedCallback(imu::Callback callback,
 Status impl::removeIsolatedCallback(image::Callback callback)
 {
     try {
-        utility::ScopedLock lock(m_dispatchLock);
+        ImageListener *listenerP;
+        {
+            utility::ScopedLock lock(m_dispatchLock);
+            listenerP = m_imageListeners.remove(callback);
+        }
 
-        std::list<ImageListener*>::iterator it;
-        for(it  = m_imageListeners.begin();
-            it != m_imageListeners.end();
-            it ++) {
-        
-            if ((*it)->callback() == callback) {
-                delete *it;
-                m_imageListeners.erase(it);
-                return Status_Ok;
-            }
+        if (listenerP) {
+            delete listenerP;
+            return Status_Ok;
         }
 
     } catch (const std::exception& e) {
@@ -209,18 +412,15 @@ Status impl::removeIsolatedCallback(image::Callback callback)
 Status impl::removeIsolatedCallback(lidar::Callback callback)
 {
     try {
-        utility::ScopedLock lock(m_dispatchLock);
+        LidarListener *listenerP;
+        {
+            utility::ScopedLock lock(m_dispatchLock);
+            listenerP = m_lidarListeners.remove(callback);
+        }
 
-        std::list<LidarListener*>::iterator it;
-        for(it  = m_lidarListeners.begin();
-            it != m_lidarListeners.end();
-            it ++) {
-        
-            if ((*it)->callback() == callback) {
-                delete *it;
-                m_lidarListeners.erase(it);
-                return Status_Ok;
-            }
+        if (listenerP) {
+            delete listenerP;
+            return Status_Ok;
         }
 
     } catch (const std::exception& e) {
@@ -237,18 +437,15 @@ Status impl::removeIsolatedCallback(lidar::Callback callback)
 Status impl::removeIsolatedCallback(pps::Callback callback)
 {
     try {
-        utility::ScopedLock lock(m_dispatchLock);
+        PpsListener *listenerP;
+        {
+            utility::ScopedLock lock(m_dispatchLock);
+            listenerP = m_ppsListeners.remove(callback);
+        }
 
-        std::list<PpsListener*>::iterator it;
-        for(it  = m_ppsListeners.begin();
-            it != m_ppsListeners.end();
-            it ++) {
-        
-            if ((*it)->callback() == callback) {
-                delete *it;
-                m_ppsListeners.erase(it);
-                return Status_Ok;
-            }
+        if (listenerP) {
+            delete listenerP;
+            return Status_Ok;
         }
 
     } catch (const std::exception& e) {
@@ -265,18 +462,40 @@ Status impl::removeIsolatedCallback(pps::Callback callback)
 Status impl::removeIsolatedCallback(imu::Callback callback)
 {
     try {
-        utility::ScopedLock lock(m_dispatchLock);
+        ImuListener *listenerP;
+        {
+            utility::ScopedLock lock(m_dispatchLock);
+            listenerP = m_imuListeners.remove(callback);
+        }
 
-        std::list<ImuListener*>::iterator it;
-        for(it  = m_imuListeners.begin();
-            it != m_imuListeners.end();
-            it ++) {
-        
-            if ((*it)->callback() == callback) {
-                delete *it;
-                m_imuListeners.erase(it);
-                return Status_Ok;
-            }
+        if (listenerP) {
+            delete listenerP;
+            return Status_Ok;
+        }
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+
+    return Status_Error;
+}
+
+//
+// Removes a frame set listener
+
+Status impl::removeIsolatedCallback(image::FrameSetCallback callback)
+{
+    try {
+        FrameSetListener *listenerP;
+        {
+            utility::ScopedLock lock(m_dispatchLock);
+            listenerP = m_frameSetListeners.remove(callback);
+        }
+
+        if (listenerP) {
+            delete listenerP;
+            return Status_Ok;
         }
 
     } catch (const std::exception& e) {
@@ -382,6 +601,95 @@ Status impl::networkTimeSynchronization(bool enabled)
     return Status_Ok;
 }
 
+//
+// Set the rate the sensor clock is probed at
+
+Status impl::setNetworkTimeSyncRate(double hz)
+{
+    if (false == (hz > 0.0 && hz <= MAX_TIME_SYNC_RATE))
+        return Status_Error;
+
+    m_timeSyncRate = hz;
+    return Status_Ok;
+}
+
+//
+// Open (or close) the host's PPS device
+
+Status impl::setHostPpsDevice(const std::string& device)
+{
+    utility::ScopedLock lock(m_timeLock);
+
+    if (m_ppsDevice >= 0) {
+        close(m_ppsDevice);
+        m_ppsDevice = -1;
+    }
+
+    if (device.empty())
+        return Status_Ok;
+
+    const int32_t fd = open(device.c_str(), O_RDWR);
+    if (fd < 0) {
+        CRL_DEBUG("failed to open %s: %s\n", device.c_str(), strerror(errno));
+        return Status_Failed;
+    }
+
+    int capabilities = 0;
+
+    if (0 != ioctl(fd, PPS_GETCAP, &capabilities) ||
+        0 == (capabilities & PPS_CAPTUREASSERT)) {
+        CRL_DEBUG("%s does not capture assert edges\n", device.c_str());
+        close(fd);
+        return Status_Unsupported;
+    }
+
+    struct pps_fdata fetch;
+
+    memset(&fetch, 0, sizeof(fetch));
+    if (0 == ioctl(fd, PPS_FETCH, &fetch))
+        m_ppsSequence = fetch.info.assert_sequence; // only edges from now on
+
+    m_ppsDevice = fd;
+
+    return Status_Ok;
+}
+
+//
+// The host's time of a PPS edge, from the caller
+
+Status impl::addHostPpsEdge(double seconds)
+{
+    if (false == (seconds > 0.0))
+        return Status_Error;
+
+    utility::ScopedLock lock(m_timeLock);
+
+    m_ppsHostEdge = seconds;
+    pairPpsEdges();
+
+    return Status_Ok;
+}
+
+//
+// Query the current time mapping
+
+Status impl::getTimeSyncStatus(system::TimeSyncStatus& status)
+{
+    utility::ScopedLock lock(m_timeLock);
+
+    const utility::ClockModel& model = (system::TimeSync_Pps == m_timeSyncSource ?
+                                        m_ppsModel : m_clockModel);
+
+    status.source   = m_networkTimeSyncEnabled ? m_timeSyncSource : system::TimeSync_None;
+    status.offset   = model.mapping().offset;
+    status.skew     = model.mapping().skew;
+    status.center   = model.mapping().center;
+    status.residual = model.residual();
+    status.samples  = model.fitted();
+
+    return Status_Ok;
+}
+
 //
 // Primary stream control
 
@@ -394,8 +702,10 @@ Status impl::startStreams(DataSource mask)
     cmd.enable(sourceApiToWire(mask));
 
     Status status = waitAck(cmd);
-    if (Status_Ok == status)
+    if (Status_Ok == status) {
         m_streamsEnabled |= mask;
+        tuneBufferPools(m_rxArenaFlags);
+    }
 
     return status;
 }
@@ -408,8 +718,10 @@ Status impl::stopStreams(DataSource mask)
     cmd.disable(sourceApiToWire(mask));
 
     Status status = waitAck(cmd);
-    if (Status_Ok == status)
+    if (Status_Ok == status) {
         m_streamsEnabled &= ~mask;
+        tuneBufferPools(m_rxArenaFlags);
+    }
 
     return status;
 }
@@ -421,6 +733,45 @@ Status impl::getEnabledStreams(DataSource& mask)
 
     return Status_Ok;
 }
+Status impl::getCallbackDrops(image::Callback callback,
+                              uint64_t&       drops)
+{
+    utility::ScopedLock lock(m_dispatchLock);
+    return callbackDrops(m_imageListeners, callback, drops);
+}
+Status impl::getCallbackDrops(lidar::Callback callback,
+                              uint64_t&       drops)
+{
+    utility::ScopedLock lock(m_dispatchLock);
+    return callbackDrops(m_lidarListeners, callback, drops);
+}
+Status impl::getCallbackDrops(pps::Callback callback,
+                              uint64_t&     drops)
+{
+    utility::ScopedLock lock(m_dispatchLock);
+    return callbackDrops(m_ppsListeners, callback, drops);
+}
+Status impl::getCallbackDrops(imu::Callback callback,
+                              uint64_t&     drops)
+{
+    utility::ScopedLock lock(m_dispatchLock);
+    return callbackDrops(m_imuListeners, callback, drops);
+}
+Status impl::getCallbackDrops(image::FrameSetCallback callback,
+                              uint64_t&               drops)
+{
+    utility::ScopedLock lock(m_dispatchLock);
+    return callbackDrops(m_frameSetListeners, callback, drops);
+}
+Status impl::getSubscribedSources(DataSource& mask)
+{
+    mask = (m_imageListeners.sources()    |
+            m_frameSetListeners.sources() |
+            m_lidarListeners.sources()    |
+            m_imuListeners.sources());
+
+    return Status_Ok;
+}
 
 //
 // Secondary stream control
@@ -613,6 +964,8 @@ Status impl::getImageConfig(image::Config& config)
     // what is the proper c++ cast for this?
     ConfigAccess& a = *((ConfigAccess *) &config);
     
+    setImageResolution(d.width, d.height);
+
     a.setResolution(d.width, d.height);
     if (-1 == d.disparities) { // pre v2.3 firmware
         if (1024 == d.width)   // TODO: check for monocular
@@ -660,6 +1013,8 @@ Status impl::setImageConfig(const image::Config& c)
     if (Status_Ok != status)
         return status;
 
+    setImageResolution(c.width(), c.height());
+
     wire::CamControl cmd;
 
     cmd.framesPerSecond = c.fps();
@@ -682,6 +1037,67 @@ Status impl::setImageConfig(const image::Config& c)
     return waitAck(cmd);
 }
 
+//
+// Asynchronous lighting/camera configuration
+
+Status impl::getLightingConfigAsync(lighting::ConfigCallback callback,
+                                    void                    *userDataP)
+{
+    try {
+
+        return queueCommand(new AsyncGet<lighting::Config, lighting::ConfigCallback>(
+                                &impl::getLightingConfig, callback, userDataP));
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+}
+
+Status impl::setLightingConfigAsync(const lighting::Config&  c,
+                                    CompletionCallback       callback,
+                                    void                    *userDataP)
+{
+    try {
+
+        return queueCommand(new AsyncSet<lighting::Config>(
+                                &impl::setLightingConfig, c, callback, userDataP));
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+}
+
+Status impl::getImageConfigAsync(image::ConfigCallback callback,
+                                 void                 *userDataP)
+{
+    try {
+
+        return queueCommand(new AsyncGet<image::Config, image::ConfigCallback>(
+                                &impl::getImageConfig, callback, userDataP));
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+}
+
+Status impl::setImageConfigAsync(const image::Config& c,
+                                 CompletionCallback   callback,
+                                 void                *userDataP)
+{
+    try {
+
+        return queueCommand(new AsyncSet<image::Config>(
+                                &impl::setImageConfig, c, callback, userDataP));
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+}
+
 //
 // Get camera calibration
 
@@ -1095,22 +1511,33 @@ Status impl::setLargeBuffers(const std::vector<uint8_t*>& buffers,
 
     try {
 
-        utility::ScopedLock lock(m_rxLock); // halt potential pool traversal
-        
         //
-        // Deletion is safe even if the buffer is in use elsewhere
+        // The pool list only changes under m_streamLock (see
+        // tuneBufferPools())
+
+        utility::ScopedLock streamLock(m_streamLock);
+
+        //
+        // Replacement is safe even if a buffer is in use elsewhere
         // (BufferStream is reference counted.)
+        //
+        // User buffers are used for all large messages from now on,
+        // regardless of resolution or enabled streams.
+
+        utility::BufferPool *bP = new utility::BufferPool();
+        bP->create(buffers, bufferSize);
 
-        BufferPool::const_iterator it;
-        for(it  = m_rxLargeBufferPool.begin();
-            it != m_rxLargeBufferPool.end();
-            ++it)
-            delete *it;
+        std::vector<utility::BufferPool*> pools(1, bP);
 
-        m_rxLargeBufferPool.clear();
+        {
+            utility::ScopedLock lock(m_rxLock); // halt potential pool acquisition
 
-        for(uint32_t i=0; i<buffers.size(); i++)
-            m_rxLargeBufferPool.push_back(new utility::BufferStreamWriter(buffers[i], bufferSize));
+            m_rxLargeBufferPools.swap(pools);
+            m_rxPoolAutoTune = false;
+        }
+
+        for(uint32_t i=0; i<pools.size(); i++)
+            delete pools[i];
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -1129,4 +1556,193 @@ Status impl::getLocalUdpPort(uint16_t& port)
     return Status_Ok;
 }
 
+//
+// Retrieve a snapshot of the internal statistics
+
+Status impl::getChannelStatistics(system::ChannelStatistics& s)
+{
+    try {
+
+        {
+            utility::ScopedLock lock(m_statisticsLock);
+
+            s.rxSystemCalls        = m_rxSystemCalls;
+            s.rxDatagrams          = m_rxDatagrams;
+            s.rxBatchHistogram     = m_rxBatchHistogram;
+            s.rxZeroCopyDatagrams  = m_rxZeroCopyDatagrams;
+            s.rxZeroCopyMisses     = m_rxZeroCopyMisses;
+            s.rxDeferredDatagrams  = m_rxDeferredDatagrams;
+            s.rxDuplicateDatagrams = m_rxDuplicateDatagrams;
+            s.rxOneOffAllocations  = m_rxOneOffAllocations;
+
+            //
+            // The kernel resets the ring counters on every read
+
+            if (m_ringSocket >= 0) {
+
+                struct tpacket_stats_v3 ring;
+                socklen_t               length = sizeof(ring);
+
+                memset(&ring, 0, sizeof(ring));
+                if (0 == getsockopt(m_ringSocket, SOL_PACKET, PACKET_STATISTICS,
+                                    &ring, &length)) {
+                    m_ringPackets += ring.tp_packets;
+                    m_ringDrops   += ring.tp_drops;
+                }
+            }
+
+            s.rxRingPackets = m_ringPackets;
+            s.rxRingDrops   = m_ringDrops;
+        }
+
+        //
+        // The RX thread takes m_statisticsLock while holding m_rxLock,
+        // so never hold both here.
+
+        utility::ScopedLock lock(m_rxLock); // pools may be retuned
+
+        std::vector<utility::BufferPool*> pools(1, &m_rxSmallBufferPool);
+        pools.insert(pools.end(), m_rxLargeBufferPools.begin(), m_rxLargeBufferPools.end());
+
+        s.rxBufferPools.resize(pools.size());
+
+        for(uint32_t i=0; i<s.rxBufferPools.size(); i++) {
+
+            system::BufferPoolStatistics& p     = s.rxBufferPools[i];
+            std::size_t                   size  = 0;
+
+            uint32_t                      arena = 0;
+
+            pools[i]->statistics(size,
+                                 p.bufferCount,
+                                 p.buffersInUse,
+                                 p.highWaterMark,
+                                 p.exhaustedEvents,
+                                 arena);
+            p.bufferSize = size;
+            p.arenaFlags = arenaUtilityToApi(arena);
+        }
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+
+    return Status_Ok;
+}
+
+//
+// Select how the reception thread waits for datagrams
+
+Status impl::setRxPollMode(RxPollMode mode,
+                           uint32_t   spinMicroseconds)
+{
+    if (RxPoll_Blocking != mode &&
+        RxPoll_Adaptive != mode &&
+        RxPoll_BusyPoll != mode)
+        return Status_Error;
+
+    //
+    // Kernel busy-polling is a socket option, leave it off unless
+    // we are spinning on the socket anyway. The receive ring is read
+    // without a system call, so the kernel never polls on its behalf.
+
+    if (RxBackend_PacketRing != m_rxBackend) {
+
+        int busyPoll = (RxPoll_BusyPoll == mode) ? spinMicroseconds : 0;
+
+        if (0 != setsockopt(m_serverSocket, SOL_SOCKET, SO_BUSY_POLL,
+                            (void*) &busyPoll, sizeof(busyPoll)))
+            CRL_DEBUG("failed to set SO_BUSY_POLL to %d us: %s\n",
+                      busyPoll, strerror(errno));
+    }
+
+    m_rxSpinMicroseconds = spinMicroseconds;
+    m_rxPollMode         = mode;
+
+    return Status_Ok;
+}
+
+//
+// Query the reception thread polling mode
+
+Status impl::getRxPollMode(RxPollMode& mode,
+                           uint32_t&   spinMicroseconds)
+{
+    mode             = m_rxPollMode;
+    spinMicroseconds = m_rxSpinMicroseconds;
+
+    return Status_Ok;
+}
+
+//
+// Schedule the internal threads of a role
+
+Status impl::setThreadPolicy(ThreadRole          role,
+                             const ThreadPolicy& policy)
+{
+    try {
+
+        switch(role) {
+        case Thread_Rx:
+
+            m_rxThreadP->setPolicy(policy.scheduler, policy.priority, policy.cpus);
+            break;
+
+        case Thread_Control:
+
+            m_statusThreadP->setPolicy(policy.scheduler, policy.priority, policy.cpus);
+            m_commandThreadP->setPolicy(policy.scheduler, policy.priority, policy.cpus);
+            break;
+
+        case Thread_Dispatch: {
+
+            utility::ScopedLock lock(m_dispatchLock);
+
+            applyThreadPolicy(m_imageListeners,    policy);
+            applyThreadPolicy(m_lidarListeners,    policy);
+            applyThreadPolicy(m_ppsListeners,      policy);
+            applyThreadPolicy(m_imuListeners,      policy);
+            applyThreadPolicy(m_frameSetListeners, policy);
+
+            m_dispatchPolicy = policy;
+            break;
+        }
+        default:
+            return Status_Error;
+        }
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+
+    return Status_Ok;
+}
+
+//
+// Select the placement of the large RX buffers
+
+Status impl::setRxBufferArena(RxArenaFlags flags)
+{
+    try {
+
+        utility::ScopedLock lock(m_streamLock);
+
+        if (false == m_rxPoolAutoTune)
+            return Status_Error; // setLargeBuffers() is in effect
+
+        if (false == tuneBufferPools(flags))
+            return Status_Exception;
+
+        m_rxArenaFlags = flags;
+
+    } catch (const std::exception& e) {
+        CRL_DEBUG("exception: %s\n", e.what());
+        return Status_Exception;
+    }
+
+    return Status_Ok;
+}
+
 }}}; // namespaces
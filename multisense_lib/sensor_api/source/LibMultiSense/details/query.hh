@@ -34,20 +34,15 @@ namespace multisense {
 namespace details {
 
 //
-// Publishes the given message to the sensor (message must
-// serialize into a single MTU)
+// Serializes the given message (it must fit into a single MTU),
+// leaving room for the header
 
-template<class T> void impl::publish(const T& message)
+template<class T> void impl::serialize(const T&                     message,
+                                       utility::BufferStreamWriter& stream)
 {
     const wire::IdType      id      = T::ID;
     const wire::VersionType version = T::VERSION;
 
-    //
-    // An output stream to serialize the data
-
-    utility::BufferStreamWriter stream(m_sensorMtu - 
-                                       wire::COMBINED_HEADER_LENGTH);
-
     //
     // Hide the header area
 
@@ -65,6 +60,20 @@ template<class T> void impl::publish(const T& message)
     // mark it const.
 
     const_cast<T*>(&message)->serialize(stream, version);
+}
+
+//
+// Publishes the given message to the sensor
+
+template<class T> void impl::publish(const T& message)
+{
+    //
+    // An output stream to serialize the data
+
+    utility::BufferStreamWriter stream(m_sensorMtu - 
+                                       wire::COMBINED_HEADER_LENGTH);
+
+    serialize(message, stream);
 
     //
     // Publish the stream
@@ -72,6 +81,44 @@ template<class T> void impl::publish(const T& message)
     publish(stream);
 }
 
+//
+// Stores a received message and hands it to the oldest waiter
+
+template<class T> void impl::deliver(const T& message)
+{
+    m_messages.store(message);
+    m_watch.signal(message);
+}
+
+//
+// Commands in flight
+
+template<class T> impl::Pending::Pending(impl&         channel,
+                                         const T&      command,
+                                         wire::IdType  ackId) :
+    m_channel(channel),
+    m_stream(channel.m_sensorMtu - wire::COMBINED_HEADER_LENGTH),
+    m_response(ackId, channel.m_watch, false),
+    m_command(MSG_ID(T::ID), channel.m_watch, false),
+    m_data(false)
+{
+    channel.serialize(command, m_stream);
+    send();
+}
+
+template<class T, class U> impl::Pending::Pending(impl&    channel,
+                                                  const T& command,
+                                                  U&       data) :
+    m_channel(channel),
+    m_stream(channel.m_sensorMtu - wire::COMBINED_HEADER_LENGTH),
+    m_response(MSG_ID(U::ID), channel.m_watch, data, false),
+    m_command(MSG_ID(T::ID), channel.m_watch, false),
+    m_data(true)
+{
+    channel.serialize(command, m_stream);
+    send();
+}
+
 //
 // Send a message, wait for a particular repsonse, re-trying if
 // necessary
@@ -82,20 +129,9 @@ template <class T> Status impl::waitAck(const T&      msg,
                                         int32_t       attempts)
 {
     try {
-        ScopedWatch ack(ackId, m_watch);
-
-        while(attempts-- > 0) {
-
-            publish(msg);
-            
-            Status status;
-            if (false == ack.wait(status, timeout))
-                continue;
-            else
-                return status;
-        }
+        Pending command(*this, msg, ackId);
 
-        return Status_TimedOut;
+        return command.wait(timeout, attempts);
 
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -113,43 +149,9 @@ template <class T, class U> Status impl::waitData(const T&      command,
                                                   int32_t       attempts)
 {
     try {
+        Pending query(*this, command, data);
 
-        //
-        // Set up a watch on the command ID in case it is rejected or
-        // unsupported.
-
-        ScopedWatch commandAck(T::ID, m_watch);
-
-        //
-        // Send the command with retry, expecting the data message as a response.
-
-        Status dataStatus = waitAck(command, MSG_ID(U::ID), timeout, attempts);
-
-        //
-        // Also store the response from the command. Do not block, as any
-        // response would be registered by this time.
-
-        Status commandStatus;
-        if (false == commandAck.wait(commandStatus, 0.0))
-            commandStatus = Status_TimedOut;
-    
-        //
-        // If we did not receive the data message, return the response from
-        // the command code instead, unless there was an exception or the 
-        // command ack'd OK.
-
-        if (Status_Ok != dataStatus) {
-            if (Status_Exception == dataStatus ||   // exception 
-                Status_Ok        == commandStatus)  // data payload timeout or MTU error
-                return dataStatus;
-            else
-                return commandStatus; // command error
-        }
-
-        //
-        // We have received the data message, extract it for the user.
-        
-        return m_messages.extract(data);
+        return query.wait(timeout, attempts);
         
     } catch (const std::exception& e) {
         CRL_DEBUG("exception: %s\n", e.what());
@@ -27,11 +27,15 @@
 #ifndef LibMultiSense_details_signal_hh
 #define LibMultiSense_details_signal_hh
 
+#include "MultiSenseTypes.hh"
+
 #include "details/utility/Thread.hh"
+#include "details/utility/TimeStamp.hh"
+#include "details/utility/BufferStream.hh"
 #include "details/wire/Protocol.h"
 #include "details/wire/AckMessage.h"
 
-#include <map>
+#include <vector>
 
 namespace crl {
 namespace multisense {
@@ -40,90 +44,338 @@ namespace details {
 //
 // Here we provide a thread-safe, blocking, signaling
 // interface for sensor message RX.
+//
+// Any number of watches may be set on one message ID. The sensor
+// answers commands in the order it receives them, and does not echo
+// any request identifier, so a message is handed to the oldest watch
+// on its ID that is still owed a response. Commands must therefore be
+// sent in the order their watches are armed (see impl::Pending.)
+//
+// A watch that counts its transmissions with sent() is owed one
+// response per transmission: the first signals it, the rest are
+// swallowed. Responses still owed when it is removed are swallowed
+// in its place, for at most the stale timeout, so that the late
+// reply to a re-sent command cannot complete a later watch.
+
+class MessageWatch;
+
+class ScopedWatch {
+public:
+
+    //
+    // An unarmed watch is not signaled until arm() is called
+
+    ScopedWatch(wire::IdType  t,
+                MessageWatch& m,
+                bool          armed=true);
+
+    //
+    // As above, but the signaling message is also copied into
+    // [data]. Assumes a 1:1 relationship between class and ID.
+
+    template<class U> ScopedWatch(wire::IdType  t,
+                                  MessageWatch& m,
+                                  U&            data,
+                                  bool          armed=true);
+
+    ~ScopedWatch();
+
+    void arm();
+
+    //
+    // Count one more transmission answered on this watch's ID
+
+    void sent();
+
+    //
+    // True if a newer watch is queued on the same ID
+
+    bool queuedBehind() const;
+
+    bool wait(Status&       status, 
+	      const double& timeout) {
+	return m_signal.timedWait(status, timeout);
+    };
+
+private:
+
+    friend class MessageWatch;
+
+    template<class U> static void copy(void *dataP, const void *messageP) {
+        *(reinterpret_cast<U*>(dataP)) = *(reinterpret_cast<const U*>(messageP));
+    };
+
+    void post(Status status) {
+        m_signaled = true;
+        m_signal.post(status);
+    };
+
+    wire::IdType              m_id;
+    MessageWatch&             m_map;
+    utility::WaitVar<Status>  m_signal;
+    bool                      m_armed;
+    bool                      m_signaled;
+    void                     *m_dataP;
+    void                    (*m_copyP)(void*, const void*);
+    ScopedWatch              *m_nextP;
+
+    //
+    // Transmissions counted by sent(), and responses taken for them
+
+    uint32_t                  m_sent;
+    uint32_t                  m_received;
+
+    //
+    // Responses owed to watches removed from behind this one, and
+    // the time after which they are no longer expected
+
+    uint32_t                  m_surplus;
+    double                    m_surplusExpiry;
+};
 
 class MessageWatch {
 public:
 
+    MessageWatch(double staleTimeout) :
+        m_staleTimeout(staleTimeout),
+        m_heads(wire::ID_LIMIT, static_cast<ScopedWatch*>(NULL)),
+        m_stale(wire::ID_LIMIT) {};
+
     void signal(wire::IdType id,
 		Status       status=Status_Ok) {
         utility::ScopedLock lock(m_lock);
 
-        Map::iterator it = m_map.find(id);
+        ScopedWatch *watchP = next(id);
 
-        if (m_map.end() != it)
-            it->second->post(status);
+        if (watchP)
+            watchP->post(status);
     };
 
     void signal(const wire::Ack& ack) {
 	signal(ack.command, ack.status);
     };
 
+    //
+    // Signals reception of a data message, handing it to the watch
+
+    template<class T> void signal(const T& message) {
+        utility::ScopedLock lock(m_lock);
+
+        ScopedWatch *watchP = next(MSG_ID(T::ID));
+
+        if (NULL == watchP)
+            return;
+        if (watchP->m_dataP)
+            watchP->m_copyP(watchP->m_dataP, &message);
+
+        watchP->post(Status_Ok);
+    };
+
 private:
 
     friend class ScopedWatch;
 
-    typedef utility::WaitVar<Status>        Signal;
-    typedef std::map<wire::IdType, Signal*> Map;
-
-    void insert(wire::IdType type, 
-		Signal      *signalP) {
-        utility::ScopedLock lock(m_lock);
+    //
+    // Responses owed to removed watches, swallowed until they expire
 
-        Map::const_iterator it = m_map.find(type);
+    struct Stale {
+        Stale() : count(0), expiry(0.0) {};
 
-        //
-        // Hmm.. this will prohibit multiple threads
-        // simultaneously commanding the sensor with this 
-	// message ID.
+        uint32_t count;
+        double   expiry;
+    };
 
-        if (m_map.end() != it)
-            CRL_EXCEPTION("ack signal already set for id=%d", type);
+    static double now() {
+        return utility::TimeStamp::getMonotonicTime();
+    };
 
-        m_map[type] = signalP;
+    //
+    // Takes the oldest response owed on a list position. Returns true
+    // if the response was swallowed there.
+
+    static bool swallow(uint32_t& count, double expiry, double t) {
+        if (0 == count)
+            return false;
+        if (t > expiry) {
+            count = 0;
+            return false;
+        }
+        count --;
+        return true;
     };
 
-    void remove(wire::IdType type) {
-        utility::ScopedLock lock(m_lock);
+    //
+    // Accounts for a response to [id], returning the watch it
+    // signals, if any. Surplus responses return NULL.
 
-        Map::iterator it = m_map.find(type);
+    ScopedWatch *next(wire::IdType id) {
+        if (id >= m_heads.size())
+            return NULL;
 
-        if (m_map.end() == it)
-            CRL_EXCEPTION("ack signal not found for id=%d\n", type);
+        const double t = now();
 
-        m_map.erase(it);
+        if (swallow(m_stale[id].count, m_stale[id].expiry, t))
+            return NULL;
+
+        for(ScopedWatch *watchP = m_heads[id]; watchP; watchP = watchP->m_nextP) {
+
+            if (watchP->m_sent > 0) {
+                if (watchP->m_received < watchP->m_sent)
+                    return (1 == ++ watchP->m_received) ? watchP : NULL;
+            } else if (false == watchP->m_signaled)
+                return watchP;
+
+            if (swallow(watchP->m_surplus, watchP->m_surplusExpiry, t))
+                return NULL;
+        }
+
+        return NULL;
     };
 
-    utility::Mutex m_lock;
-    Map            m_map;
-};
+    void insert(ScopedWatch *watchP) {
+        if (watchP->m_id >= m_heads.size())
+            CRL_EXCEPTION("ack signal id=%d out of range", watchP->m_id);
 
- //
- // Exception-safe [de]registration of signal handlers
+        utility::ScopedLock lock(m_lock);
 
-class ScopedWatch {
-public:
+        ScopedWatch **linkP = &m_heads[watchP->m_id];
 
-    ScopedWatch(wire::IdType  t,
-                MessageWatch& m) : m_id(t), m_map(m) {
-	m_map.insert(m_id, &m_signal);
+        while(*linkP)
+            linkP = &((*linkP)->m_nextP);
+
+        watchP->m_nextP = NULL;
+        *linkP          = watchP;
     };
 
-    ~ScopedWatch() {
-	m_map.remove(m_id);
+    void sent(ScopedWatch *watchP) {
+        utility::ScopedLock lock(m_lock);
+        watchP->m_sent ++;
     };
 
-    bool wait(Status&       status, 
-	      const double& timeout) {
-	return m_signal.timedWait(status, timeout);
+    bool queuedBehind(const ScopedWatch *watchP) {
+        utility::ScopedLock lock(m_lock);
+        return NULL != watchP->m_nextP;
     };
 
-private:
+    //
+    // Unlinks a watch, handing whatever it is still owed to the
+    // position before it: those responses arrive after the ones owed
+    // to older watches, and before any owed to newer ones.
+
+    void remove(ScopedWatch *watchP) {
+        utility::ScopedLock lock(m_lock);
+
+        ScopedWatch **linkP = &m_heads[watchP->m_id];
+        ScopedWatch  *prevP = NULL;
+
+        while(*linkP && *linkP != watchP) {
+            prevP = *linkP;
+            linkP = &((*linkP)->m_nextP);
+        }
+
+        if (NULL == *linkP)
+            CRL_EXCEPTION("ack signal not found for id=%d\n", watchP->m_id);
+
+        *linkP = watchP->m_nextP;
+
+        const double t    = now();
+        uint32_t     owed = 0;
+
+        if (watchP->m_received < watchP->m_sent)
+            owed += watchP->m_sent - watchP->m_received;
+        if (t <= watchP->m_surplusExpiry)
+            owed += watchP->m_surplus;
 
-    wire::IdType         m_id;
-    MessageWatch&        m_map;
-    MessageWatch::Signal m_signal;
+        if (0 == owed)
+            return;
+
+        uint32_t& count  = prevP ? prevP->m_surplus       : m_stale[watchP->m_id].count;
+        double&   expiry = prevP ? prevP->m_surplusExpiry : m_stale[watchP->m_id].expiry;
+
+        if (t > expiry)
+            count = 0;
+
+        count  += owed;
+        expiry  = t + m_staleTimeout;
+    };
+
+    //
+    // Watches are kept in a list per message ID, oldest first
+
+    const double              m_staleTimeout; // seconds
+    utility::Mutex            m_lock;
+    std::vector<ScopedWatch*> m_heads;
+    std::vector<Stale>        m_stale;
 };
 
+ //
+ // Exception-safe [de]registration of signal handlers
+
+inline ScopedWatch::ScopedWatch(wire::IdType  t,
+                                MessageWatch& m,
+                                bool          armed) : 
+    m_id(t), 
+    m_map(m),
+    m_signal(),
+    m_armed(false),
+    m_signaled(false),
+    m_dataP(NULL),
+    m_copyP(NULL),
+    m_nextP(NULL),
+    m_sent(0),
+    m_received(0),
+    m_surplus(0),
+    m_surplusExpiry(0.0)
+{
+    if (armed)
+        arm();
+}
+
+template<class U> ScopedWatch::ScopedWatch(wire::IdType  t,
+                                           MessageWatch& m,
+                                           U&            data,
+                                           bool          armed) :
+    m_id(t), 
+    m_map(m),
+    m_signal(),
+    m_armed(false),
+    m_signaled(false),
+    m_dataP(&data),
+    m_copyP(&copy<U>),
+    m_nextP(NULL),
+    m_sent(0),
+    m_received(0),
+    m_surplus(0),
+    m_surplusExpiry(0.0)
+{
+    if (armed)
+        arm();
+}
+
+inline ScopedWatch::~ScopedWatch()
+{
+    if (m_armed)
+        m_map.remove(this);
+}
+
+inline void ScopedWatch::arm()
+{
+    if (false == m_armed) {
+        m_map.insert(this);
+        m_armed = true;
+    }
+}
+
+inline void ScopedWatch::sent()
+{
+    m_map.sent(this);
+}
+
+inline bool ScopedWatch::queuedBehind() const
+{
+    return m_map.queuedBehind(this);
+}
+
 }; // namespace details
 }; // namespace multisense
 }; // namespace crl
@@ -27,10 +27,15 @@
 #ifndef LibMultiSense_details_storage_hh
 #define LibMultiSense_details_storage_hh
 
+#include "MultiSenseTypes.hh"
+
 #include "details/utility/Thread.hh"
+#include "details/utility/BufferStream.hh"
+#include "details/wire/Protocol.h"
 
 #include <map>
 #include <set>
+#include <vector>
 
 namespace crl {
 namespace multisense {
@@ -39,68 +44,88 @@ namespace details {
     //
     // A message storage interface
     //
-    // Assumes a 1:1 relationship between template class and ID
+    // Assumes a 1:1 relationship between template class and ID.
+    //
+    // Each ID has its own slot. The message object in a slot is
+    // allocated on the first store() of that ID and re-assigned
+    // thereafter, so steady-state traffic does not touch the heap.
+    //
+    // Every store() bumps the slot's generation. A waiter records
+    // generation<T>() before requesting data, and passes it to
+    // extract() to refuse anything that was already there.
 
     class MessageMap {
     public:
 
+        MessageMap() : m_slots(wire::ID_LIMIT) {};
+
+        ~MessageMap() {
+            for(std::size_t i=0; i<m_slots.size(); i++)
+                if (m_slots[i].dataP)
+                    m_slots[i].destroyP(m_slots[i].dataP);
+        };
+
         template<class T> void store(const T& msg) {
+            Slot& s = slot(MSG_ID(T::ID));
+
             utility::ScopedLock lock(m_lock);
 
-            Map::iterator it = m_map.find(MSG_ID(T::ID));
-            if (m_map.end() != it) {
-                it->second.destroy<T>();
-                m_map.erase(it);
-            }
+            if (NULL == s.dataP) {
+                s.dataP    = new T(msg);
+                s.destroyP = &destroy<T>;
+            } else
+                *(reinterpret_cast<T*>(s.dataP)) = msg;
 
-            m_map[MSG_ID(T::ID)] = Holder::Create<T>(msg);
+            s.valid = true;
+            s.generation ++;
         };
 
-        template<class T> Status extract(T& msg) {
+        template<class T> Status extract(T&       msg,
+                                         uint64_t newerThan=0) {
+            Slot& s = slot(MSG_ID(T::ID));
+
             utility::ScopedLock lock(m_lock);
 
-            Map::iterator it = m_map.find(MSG_ID(T::ID));
-            if (m_map.end() == it)
+            if (false == s.valid || s.generation <= newerThan)
                 return Status_Error;
 
-            it->second.extract(msg);
-            m_map.erase(it);
+            msg     = *(reinterpret_cast<const T*>(s.dataP));
+            s.valid = false;
 
             return Status_Ok;
         };
-        
+
+        template<class T> uint64_t generation() {
+            Slot& s = slot(MSG_ID(T::ID));
+
+            utility::ScopedLock lock(m_lock);
+
+            return s.generation;
+        };
+
     private:
 
-        class Holder {
-        public:
-       
-            Holder(void *r=NULL) : m_refP(r) {};
-            
-            template<class T> static Holder Create(const T& msg) {
-                return Holder(reinterpret_cast<void *>(new T(msg)));
-            };
-      
-            template<class T> void destroy() {
-                if (NULL == m_refP)
-                    CRL_EXCEPTION("destroying NULL reference");
-                delete reinterpret_cast<T*>(m_refP);
-            };
-        
-            template<class T> void extract(T& msg) {
-                if (NULL == m_refP)
-                    CRL_EXCEPTION("extracting NULL reference");
-                msg = *(reinterpret_cast<T*>(m_refP));
-                destroy<T>();
-            };
-            
-        private:
-            void *m_refP;
+        struct Slot {
+            Slot() : dataP(NULL), destroyP(NULL), valid(false), generation(0) {};
+
+            void    *dataP;
+            void   (*destroyP)(void*);
+            bool     valid;
+            uint64_t generation;
+        };
+
+        template<class T> static void destroy(void *dataP) {
+            delete reinterpret_cast<T*>(dataP);
         };
 
-        typedef std::map<wire::IdType, Holder> Map;
+        Slot& slot(wire::IdType id) {
+            if (id >= m_slots.size())
+                CRL_EXCEPTION("message ID 0x%x out of range", id);
+            return m_slots[id];
+        };
 
-        utility::Mutex m_lock;
-        Map            m_map;
+        utility::Mutex    m_lock;
+        std::vector<Slot> m_slots;
     };
 
     //
@@ -209,6 +234,176 @@ namespace details {
         utility::Mutex    m_lock;
     };
 
+    //
+    // Resets an entry evicted from a RingCache. DATA may overload this
+    // (found by argument-dependent lookup) to keep storage that the
+    // next entry in its slot will need.
+
+    template<class DATA> void resetEntry(DATA& data) {
+        data = DATA();
+    };
+
+    //
+    // A fixed-capacity cache for keys that only grow (sequence and
+    // frame IDs.)
+    //
+    // Entries live in a ring of preallocated slots indexed by key modulo
+    // capacity, so the cache itself allocates nothing on insert. Only
+    // the [capacity] most recent keys are held: inserting a newer key
+    // evicts every entry that falls out of that window, and keys older
+    // than the window are refused.
+    //
+    // DATA is stored by value, and must be default-constructible and
+    // assignable. An evicted entry is reset with resetEntry().
+    //
+    // For *_nolock() variations, lock-management must be 
+    // done by the user.
+
+    template<class KEY, class DATA>
+    class RingCache {
+    public:
+
+        RingCache(std::size_t capacity) :
+            m_slots(capacity),
+            m_newest(0),
+            m_empty(true) {};
+
+        utility::Mutex& mutex() { 
+            return m_lock; 
+        };
+
+        DATA* find_nolock(KEY key) {
+            return find_(key);
+        };
+
+        DATA* find(KEY key) {
+            utility::ScopedLock lock(m_lock);
+            return find_(key);
+        };
+
+        //
+        // Returns the slot for 'key' (reset if it was not already held),
+        // or NULL if 'key' is older than the window.
+
+        DATA* insert_nolock(KEY key) {
+            return insert_(key);
+        };
+
+        DATA* insert(KEY key) {
+            utility::ScopedLock lock(m_lock);
+            return insert_(key);
+        };
+
+        void remove_nolock(KEY key) {
+            remove_(key);
+        };
+
+        void remove(KEY key) {
+            utility::ScopedLock lock(m_lock);
+            remove_(key);
+        };
+
+        void clear() {
+            utility::ScopedLock lock(m_lock);
+            clear_();
+        };
+
+        void clear_nolock() {
+            clear_();
+        };
+
+        //
+        // The newest key inserted since construction or clear(), if any
+
+        bool newest_nolock(KEY& key) {
+            key = m_newest;
+            return false == m_empty;
+        };
+
+        std::size_t capacity() const {
+            return m_slots.size();
+        };
+
+    private:
+
+        struct Slot {
+            Slot() : key(), valid(false), data() {};
+
+            KEY  key;
+            bool valid;
+            DATA data;
+        };
+
+        Slot& slot_(KEY key) {
+            return m_slots[static_cast<uint64_t>(key) % m_slots.size()];
+        };
+
+        void evict_(Slot& s) {
+            if (s.valid) {
+                resetEntry(s.data);
+                s.valid = false;
+            }
+        };
+
+        DATA* find_(KEY key) {
+            Slot& s = slot_(key);
+
+            if (s.valid && key == s.key)
+                return &(s.data);
+            return NULL;
+        };
+
+        DATA* insert_(KEY key) {
+
+            const KEY capacity = static_cast<KEY>(m_slots.size());
+
+            if (m_empty) {
+                m_newest = key;
+                m_empty  = false;
+            } else if (key > m_newest) {
+
+                //
+                // Advance the window, visiting each slot at most once
+
+                KEY k = (key - m_newest > capacity) ? (key - capacity + 1) : (m_newest + 1);
+                for(; k <= key; k++)
+                    evict_(slot_(k));
+
+                m_newest = key;
+
+            } else if (key <= m_newest - capacity)
+                return NULL;
+
+            Slot& s = slot_(key);
+
+            if (key != s.key)
+                evict_(s);
+
+            s.key   = key;
+            s.valid = true;
+
+            return &(s.data);
+        };
+
+        void remove_(KEY key) {
+            Slot& s = slot_(key);
+
+            if (s.valid && key == s.key)
+                evict_(s);
+        };
+
+        void clear_() {
+            for(std::size_t i=0; i<m_slots.size(); i++)
+                evict_(m_slots[i]);
+            m_empty = true;
+        };
+
+        std::vector<Slot> m_slots;
+        KEY               m_newest;
+        bool              m_empty;
+        utility::Mutex    m_lock;
+    };
+
 }}}; // namespaces
 
 #endif // LibMultiSense_details_storage_hh
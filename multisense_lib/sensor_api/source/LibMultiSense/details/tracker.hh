@@ -0,0 +1,277 @@
+/**
+ * @file LibMultiSense/details/tracker.hh
+ *
+ * Declares the re-assembler for multi-packet messages.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LibMultiSense_details_tracker_hh
+#define LibMultiSense_details_tracker_hh
+
+#include "details/utility/BufferStream.hh"
+#include "details/utility/Exception.hh"
+
+#include <algorithm>
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+
+//
+// A handler prototype for custom UDP datagram reassembly
+
+typedef void (*UdpAssembler)(utility::BufferStreamWriter& stream,
+                             const uint8_t               *dataP,
+                             uint32_t                     offset,
+                             uint32_t                     length);
+
+//
+// A re-assembler for multi-packet messages
+//
+// Datagrams may arrive in any order, and need not be of any one size.
+// The byte ranges received are kept as a sorted set of intervals, so
+// duplicates are ignored, and the message is complete once every byte
+// has been assembled. In order, each datagram just extends the last
+// interval.
+//
+// The first datagram (byte offset 0) selects the assembler and the
+// buffer, so anything arriving before it is copied aside and
+// replayed by start().
+//
+// Trackers are reused in place (see reset()), so that their
+// vectors keep their storage from one message to the next.
+
+class UdpTracker {
+public:
+
+    //
+    // Deferred data kept across reset(), at most
+
+    static const std::size_t MAX_RETAINED_DEFERRED = 64 * 1024;
+
+    UdpTracker(uint32_t t=0) :
+        m_totalBytesInMessage(t),
+        m_bytesAssembled(0),
+        m_packetsAssembled(0),
+        m_received(),
+        m_assembler(NULL),
+        m_stream(),
+        m_deferred(),
+        m_deferredData(),
+        m_firstArrival(0.0),
+        m_lastArrival(0.0) {};
+
+    //
+    // Start over with a message of [t] bytes, letting go of the
+    // buffer but keeping the bookkeeping storage
+
+    void reset(uint32_t t=0) {
+        m_totalBytesInMessage = t;
+        m_bytesAssembled      = 0;
+        m_packetsAssembled    = 0;
+        m_assembler           = NULL;
+        m_stream              = utility::BufferStreamWriter();
+        m_firstArrival        = 0.0;
+        m_lastArrival         = 0.0;
+
+        m_received.clear();
+        clearDeferred();
+    };
+
+    //
+    // As evicted from the tracker cache (see RingCache)
+
+    friend void resetEntry(UdpTracker& tracker) {
+        tracker.reset();
+    };
+
+    utility::BufferStreamWriter& stream() { return m_stream;           };
+    uint32_t packets()                    { return m_packetsAssembled; };
+    uint32_t bytesAssembled()             { return m_bytesAssembled;   };
+    UdpAssembler assembler()              { return m_assembler;        };
+    bool started()                        { return NULL != m_assembler; };
+    double firstArrival()                 { return m_firstArrival;     };
+    double lastArrival()                  { return m_lastArrival;      };
+
+    //
+    // Note the kernel's receive time of a datagram (0 if unknown)
+
+    void arrived(double t) {
+        if (t <= 0.0)
+            return;
+        if (0.0 == m_firstArrival || t < m_firstArrival)
+            m_firstArrival = t;
+        if (t > m_lastArrival)
+            m_lastArrival = t;
+    };
+
+    //
+    // Begin assembly with the first datagram, returns true if the
+    // message is complete.
+
+    bool start(UdpAssembler                       a,
+               const utility::BufferStreamWriter& s,
+               uint32_t                           bytes,
+               const uint8_t                     *dataP) {
+
+        m_assembler = a;
+        m_stream    = s;
+
+        bool complete = assemble(bytes, 0, dataP);
+
+        for(uint32_t i=0; i<m_deferred.size(); i++)
+            complete = assemble(m_deferred[i].bytes,
+                                m_deferred[i].offset,
+                                &(m_deferredData[m_deferred[i].index])) || complete;
+
+        clearDeferred();
+
+        return complete;
+    };
+
+    bool assemble(uint32_t       bytes,
+                  uint32_t       offset,
+                  const uint8_t *dataP) {
+
+        if (0 == bytes || offset >= m_totalBytesInMessage ||
+            bytes > (m_totalBytesInMessage - offset))
+            CRL_EXCEPTION("malformed packet: %u bytes at offset %u of %u",
+                          bytes, offset, m_totalBytesInMessage);
+
+        //
+        // Hold on to it until the first datagram arrives. More than
+        // a message's worth can only be duplicates.
+
+        if (false == started()) {
+
+            if (m_deferredData.size() + bytes <= m_totalBytesInMessage) {
+                m_deferred.push_back(Fragment(offset, bytes, m_deferredData.size()));
+                m_deferredData.insert(m_deferredData.end(), dataP, dataP + bytes);
+            }
+            return false;
+        }
+
+        //
+        // A datagram overlapping others is assembled whole, but only
+        // its new bytes are counted
+
+        const uint32_t added = receive(offset, offset + bytes);
+
+        if (0 == added)
+            return false; // duplicate
+
+        m_assembler(m_stream, dataP, offset, bytes);
+
+        m_bytesAssembled   += added;
+        m_packetsAssembled ++;
+
+        if (m_bytesAssembled == m_totalBytesInMessage)
+            return true;
+        return false;
+    }
+
+private:
+
+    struct Fragment {
+        Fragment(uint32_t o, uint32_t b, std::size_t i) : offset(o), bytes(b), index(i) {};
+        uint32_t    offset;
+        uint32_t    bytes;
+        std::size_t index; // into m_deferredData
+    };
+
+    //
+    // A range of bytes received, [begin, end)
+
+    struct Interval {
+        Interval(uint32_t b, uint32_t e) : begin(b), end(e) {};
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    static bool endsBefore(const Interval& i,
+                           uint32_t        offset) {
+        return i.end < offset;
+    };
+
+    void clearDeferred() {
+        m_deferred.clear();
+        if (m_deferredData.capacity() > MAX_RETAINED_DEFERRED)
+            std::vector<uint8_t>().swap(m_deferredData);
+        else
+            m_deferredData.clear();
+    };
+
+    //
+    // Mark [begin, end) as received, merging the intervals it touches,
+    // returns the number of bytes not received before
+
+    uint32_t receive(uint32_t begin,
+                     uint32_t end) {
+
+        if (m_received.empty() || m_received.back().end < begin) {
+            m_received.push_back(Interval(begin, end));
+            return end - begin;
+        } else if (m_received.back().end == begin) {
+            m_received.back().end = end;
+            return end - begin;
+        }
+
+        std::vector<Interval>::iterator first, last;
+
+        first = std::lower_bound(m_received.begin(), m_received.end(),
+                                 begin, endsBefore);
+
+        uint32_t added = end - begin;
+        Interval merged(begin, end);
+
+        for(last = first; m_received.end() != last && last->begin <= end; last ++) {
+            added       -= std::min(last->end, end) - std::max(last->begin, begin);
+            merged.begin = std::min(merged.begin, last->begin);
+            merged.end   = std::max(merged.end,   last->end);
+        }
+
+        if (first == last)
+            m_received.insert(first, merged);
+        else {
+            *first = merged;
+            m_received.erase(first + 1, last);
+        }
+
+        return added;
+    };
+
+    uint32_t                    m_totalBytesInMessage;
+    uint32_t                    m_bytesAssembled;
+    uint32_t                    m_packetsAssembled;
+    std::vector<Interval>       m_received;
+    UdpAssembler                m_assembler;
+    utility::BufferStreamWriter m_stream;
+    std::vector<Fragment>       m_deferred;
+    std::vector<uint8_t>        m_deferredData;
+    double                      m_firstArrival; // seconds, local system clock
+    double                      m_lastArrival;
+};
+
+}; // namespace details
+}; // namespace multisense
+}; // namespace crl
+
+#endif // LibMultiSense_details_tracker_hh
@@ -0,0 +1,156 @@
+/**
+ * @file LibMultiSense/details/utility/Arena.cc
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "Arena.hh"
+#include "Exception.hh"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+namespace {
+
+std::size_t roundUp(std::size_t bytes, std::size_t alignment)
+{
+    return alignment * ((bytes + alignment - 1) / alignment);
+}
+
+}; // anonymous
+
+//
+// Map the memory, then apply each placement option in turn. The NUMA
+// policy must be set before the pages are first touched, and mlock()
+// touches them all, so the order matters.
+
+Arena::Arena(std::size_t bytes,
+             uint32_t    flags,
+             int32_t     numaNode) :
+    m_mapP(NULL),
+    m_mapBytes(0),
+    m_dataP(NULL),
+    m_size(bytes),
+    m_flags(0)
+{
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    const std::size_t length   = roundUp(bytes, 
+                                         (flags & FLAG_HUGE_PAGES) ? HUGE_PAGE_SIZE : pageSize);
+
+    //
+    // Explicit hugepages, only available if the administrator has
+    // reserved some (vm.nr_hugepages)
+
+    if (flags & FLAG_HUGE_PAGES) {
+
+        void *mapP = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (MAP_FAILED != mapP) {
+            m_mapP      = mapP;
+            m_mapBytes  = length;
+            m_dataP     = reinterpret_cast<uint8_t*>(mapP);
+            m_flags    |= FLAG_HUGE_PAGES;
+        }
+    }
+
+    //
+    // Otherwise ordinary pages. If hugepages were asked for, align to a
+    // hugepage boundary and ask for transparent hugepages instead.
+
+    if (NULL == m_mapP) {
+
+        const std::size_t slack = (flags & FLAG_HUGE_PAGES) ? HUGE_PAGE_SIZE : 0;
+
+        void *mapP = mmap(NULL, length + slack, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (MAP_FAILED == mapP)
+            CRL_EXCEPTION("unable to map %d bytes: %s", length + slack, strerror(errno));
+
+        m_mapP     = mapP;
+        m_mapBytes = length + slack;
+        m_dataP    = reinterpret_cast<uint8_t*>(roundUp(reinterpret_cast<std::size_t>(mapP),
+                                                        slack ? slack : pageSize));
+
+        if ((flags & FLAG_HUGE_PAGES) &&
+            0 == madvise(m_dataP, length, MADV_HUGEPAGE))
+            m_flags |= FLAG_HUGE_PAGES;
+    }
+
+    //
+    // Bind to the requested NUMA node
+
+    if ((flags & FLAG_NUMA_LOCAL) && numaNode >= 0) {
+
+        unsigned long mask[16] = {0};
+        const int32_t bits     = 8 * sizeof(mask[0]);
+
+        if (numaNode < static_cast<int32_t>(8 * sizeof(mask))) {
+
+            mask[numaNode / bits] = 1UL << (numaNode % bits);
+
+            if (0 == syscall(SYS_mbind, m_dataP, length, MPOL_BIND,
+                             mask, 8 * sizeof(mask) + 1, 0))
+                m_flags |= FLAG_NUMA_LOCAL;
+            else
+                CRL_DEBUG("unable to bind %ld bytes to NUMA node %d: %s\n",
+                          static_cast<long int>(length), numaNode, strerror(errno));
+        }
+    }
+
+    //
+    // Fault in and pin every page
+
+    if (flags & FLAG_LOCKED) {
+
+        if (0 == mlock(m_dataP, length))
+            m_flags |= FLAG_LOCKED;
+        else
+            CRL_DEBUG("unable to lock %ld bytes: %s\n",
+                      static_cast<long int>(length), strerror(errno));
+    }
+}
+
+Arena::~Arena()
+{
+    if (m_mapP)
+        munmap(m_mapP, m_mapBytes);
+}
+
+int32_t Arena::currentNumaNode()
+{
+    unsigned int cpu  = 0;
+    unsigned int node = 0;
+
+    if (0 != syscall(SYS_getcpu, &cpu, &node, NULL))
+        return -1;
+
+    return static_cast<int32_t>(node);
+}
+
+}}}} // namespaces
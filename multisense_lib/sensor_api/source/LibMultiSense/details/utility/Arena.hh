@@ -0,0 +1,79 @@
+/**
+ * @file LibMultiSense/details/utility/Arena.hh
+ *
+ * Declares a block of memory with controlled placement: backed by
+ * huge pages, locked into RAM and/or bound to a NUMA node.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_ARENA_HH
+#define CRL_MULTISENSE_ARENA_HH
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// Placement is best-effort: each option that cannot be honoured
+// (no hugepages reserved, RLIMIT_MEMLOCK too low, no NUMA support)
+// is dropped, and flags() reports what was actually achieved.
+
+class Arena {
+public:
+
+    static const uint32_t FLAG_HUGE_PAGES = (1<<0);
+    static const uint32_t FLAG_LOCKED     = (1<<1);
+    static const uint32_t FLAG_NUMA_LOCAL = (1<<2);
+
+    static const std::size_t HUGE_PAGE_SIZE = (2 * 1024 * 1024);
+
+    Arena(std::size_t bytes,
+          uint32_t    flags,
+          int32_t     numaNode=-1);
+    ~Arena();
+
+    uint8_t    *data () const { return m_dataP; };
+    std::size_t size () const { return m_size;  };
+    uint32_t    flags() const { return m_flags; };
+
+    //
+    // The NUMA node of the calling thread's current CPU, or -1
+
+    static int32_t currentNumaNode();
+
+private:
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    void       *m_mapP;
+    std::size_t m_mapBytes;
+    uint8_t    *m_dataP;
+    std::size_t m_size;
+    uint32_t    m_flags;
+};
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_ARENA_HH */
@@ -0,0 +1,453 @@
+/**
+ * @file LibMultiSense/details/utility/BoundedQueue.hh
+ *
+ * Declares a lock-free, fixed-capacity FIFO, and a blocking queue
+ * built on it with a policy for when it is full.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_BOUNDEDQUEUE_HH
+#define CRL_MULTISENSE_BOUNDEDQUEUE_HH
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include <new>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// A fixed-capacity FIFO for any number of producers and consumers,
+// without locks (D. Vyukov's bounded MPMC queue.)
+//
+// Each slot carries a sequence number saying whose turn it is: the
+// producer of position 'p' may fill it once its sequence equals 'p',
+// the consumer once it equals 'p + 1'. Entries are constructed in
+// place and copied out exactly once.
+//
+// A single slot cannot tell full from empty this way, so a capacity
+// of 1 uses two slots and checks the depth itself.
+
+template<class T> class BoundedQueue {
+public:
+
+    BoundedQueue(std::size_t capacity) :
+        m_capacity(capacity ? capacity : 1),
+        m_slots(m_capacity < 2 ? 2 : m_capacity),
+        m_sequencesP(new uint64_t[m_slots]),
+        m_dataP(static_cast<T*>(::operator new(m_slots * sizeof(T)))),
+        m_pushPosition(0),
+        m_popPosition(0) {
+
+        for(std::size_t i=0; i<m_slots; i++)
+            m_sequencesP[i] = i;
+    };
+
+    ~BoundedQueue() {
+        clear();
+        ::operator delete(m_dataP);
+        delete [] m_sequencesP;
+    };
+
+    //
+    // Add an entry constructed from the arguments, returns false
+    // if full
+
+    template<class A1> bool push(const A1& a1) {
+        uint64_t position;
+        if (false == claimPush(position))
+            return false;
+        new (slot(position)) T(a1);
+        commitPush(position);
+        return true;
+    };
+
+    template<class A1, class A2, class A3>
+    bool push(const A1& a1, const A2& a2, const A3& a3) {
+        uint64_t position;
+        if (false == claimPush(position))
+            return false;
+        new (slot(position)) T(a1, a2, a3);
+        commitPush(position);
+        return true;
+    };
+
+    template<class A1, class A2, class A3, class A4, class A5>
+    bool push(const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5) {
+        uint64_t position;
+        if (false == claimPush(position))
+            return false;
+        new (slot(position)) T(a1, a2, a3, a4, a5);
+        commitPush(position);
+        return true;
+    };
+
+    //
+    // Take the oldest entry, returns false if empty
+
+    bool pop(T& data) {
+        uint64_t position;
+        if (false == claimPop(position))
+            return false;
+        T *dataP = slot(position);
+        data = *dataP;
+        dataP->~T();
+        commitPop(position);
+        return true;
+    };
+
+    //
+    // Discard the oldest entry, returns false if empty
+
+    bool drop() {
+        uint64_t position;
+        if (false == claimPop(position))
+            return false;
+        slot(position)->~T();
+        commitPop(position);
+        return true;
+    };
+
+    void clear() {
+        while(drop());
+    };
+
+    //
+    // Approximate, when racing with producers or consumers
+
+    std::size_t size() const {
+        const uint64_t popped = m_popPosition;
+        const uint64_t pushed = m_pushPosition;
+        return pushed > popped ? static_cast<std::size_t>(pushed - popped) : 0;
+    };
+
+    std::size_t capacity() const { return m_capacity; };
+
+private:
+
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    T *slot(uint64_t position) {
+        return m_dataP + (position % m_slots);
+    };
+
+    volatile uint64_t& sequence(uint64_t position) {
+        return m_sequencesP[position % m_slots];
+    };
+
+    bool claimPush(uint64_t& position) {
+        while(1) {
+            position = m_pushPosition;
+
+            //
+            // Signed: consumers may already have popped past a stale
+            // position, which then only fails the swap below
+
+            const int64_t used = static_cast<int64_t>(position - m_popPosition);
+
+            if (m_slots != m_capacity && used >= static_cast<int64_t>(m_capacity))
+                return false; // full
+
+            const int64_t turn = static_cast<int64_t>(sequence(position) - position);
+
+            if (0 == turn) {
+                if (__sync_bool_compare_and_swap(&m_pushPosition, position, position + 1))
+                    return true;
+            } else if (turn < 0)
+                return false; // full
+        }
+    };
+
+    void commitPush(uint64_t position) {
+        __sync_synchronize();
+        sequence(position) = position + 1;
+    };
+
+    bool claimPop(uint64_t& position) {
+        while(1) {
+            position = m_popPosition;
+
+            const int64_t turn = static_cast<int64_t>(sequence(position) - (position + 1));
+
+            if (0 == turn) {
+                if (__sync_bool_compare_and_swap(&m_popPosition, position, position + 1))
+                    return true;
+            } else if (turn < 0)
+                return false; // empty
+        }
+    };
+
+    void commitPop(uint64_t position) {
+        __sync_synchronize();
+        sequence(position) = position + m_slots;
+    };
+
+    const std::size_t              m_capacity;
+    const std::size_t              m_slots;
+    volatile uint64_t             *m_sequencesP;
+    T                             *m_dataP;
+
+    //
+    // Kept on separate cache lines, producers and consumers
+    // contend on different ones
+
+    uint8_t                        m_pad0[64];
+    volatile uint64_t              m_pushPosition;
+    uint8_t                        m_pad1[64];
+    volatile uint64_t              m_popPosition;
+    uint8_t                        m_pad2[64];
+};
+
+//
+// What posting to a full BoundedWaitQueue does
+
+enum Overflow {
+    Overflow_DropOldest, // make room (as WaitQueue does)
+    Overflow_DropNewest, // discard the new entry
+    Overflow_Block       // wait for a consumer to make room, up to a timeout
+};
+
+//
+// A blocking queue of at most [max] entries, with a policy for when
+// it is full. Entries dropped either way are counted.
+//
+// Consumers only enter the kernel when the queue is empty, and
+// producers only when a consumer is asleep (or, when blocking, when
+// the queue is full.)
+
+template<class T> class BoundedWaitQueue {
+public:
+
+    BoundedWaitQueue(std::size_t max,
+                     Overflow    overflow=Overflow_DropOldest,
+                     double      timeout=0.0) :
+        m_queue(max),
+        m_overflow(overflow),
+        m_timeout(static_cast<int64_t>(timeout * 1e9)),
+        m_events(0),
+        m_waiters(0),
+        m_kicks(0),
+        m_pops(0),
+        m_blocked(0),
+        m_drops(0) {};
+
+    //
+    // Returns false if the entry was dropped
+
+    template<class A1> bool post(const A1& a1) {
+        int64_t deadline = 0;
+        while(false == m_queue.push(a1))
+            if (false == makeRoom(deadline))
+                return false;
+        signal();
+        return true;
+    };
+
+    template<class A1, class A2, class A3>
+    bool post(const A1& a1, const A2& a2, const A3& a3) {
+        int64_t deadline = 0;
+        while(false == m_queue.push(a1, a2, a3))
+            if (false == makeRoom(deadline))
+                return false;
+        signal();
+        return true;
+    };
+
+    template<class A1, class A2, class A3, class A4, class A5>
+    bool post(const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5) {
+        int64_t deadline = 0;
+        while(false == m_queue.push(a1, a2, a3, a4, a5))
+            if (false == makeRoom(deadline))
+                return false;
+        signal();
+        return true;
+    };
+
+    //
+    // Wake one waiter, which returns false if the queue is empty
+
+    void kick() {
+        __sync_fetch_and_add(&m_kicks, 1);
+        signal();
+    };
+
+    bool wait(T& data) {
+        while(1) {
+
+            const int32_t events = m_events;
+
+            if (m_queue.pop(data)) {
+                popped();
+                return true;
+            }
+
+            const int32_t kicks = m_kicks;
+            if (kicks > 0 && __sync_bool_compare_and_swap(&m_kicks, kicks, kicks - 1))
+                return false;
+
+            //
+            // Anything posted since we sampled m_events changes it,
+            // and the futex will not sleep
+
+            __sync_fetch_and_add(&m_waiters, 1);
+            syscall(__NR_futex, &m_events, FUTEX_WAIT, events, NULL, 0, 0);
+            __sync_fetch_and_sub(&m_waiters, 1);
+        }
+    };
+
+    bool tryWait(T& data) {
+        if (false == m_queue.pop(data))
+            return false;
+        popped();
+        return true;
+    };
+
+    uint32_t size() {
+        return m_queue.size();
+    };
+
+    void clear() {
+        m_queue.clear();
+    };
+
+    uint64_t drops() const {
+        return m_drops;
+    };
+
+private:
+
+    //
+    // Returns true to try the push again, false if the new entry is
+    // to be dropped
+
+    bool makeRoom(int64_t& deadline) {
+        switch(m_overflow) {
+        case Overflow_DropNewest:
+
+            __sync_fetch_and_add(&m_drops, 1);
+            return false;
+
+        case Overflow_Block:
+
+            if (waitForRoom(deadline))
+                return true;
+            __sync_fetch_and_add(&m_drops, 1);
+            return false;
+
+        default:
+
+            //
+            // Drop the oldest entry. If that is still being written (its
+            // producer was preempted between claiming and filling it),
+            // give the producer a chance to finish.
+
+            if (m_queue.drop())
+                __sync_fetch_and_add(&m_drops, 1);
+            else
+                sched_yield();
+            return true;
+        }
+    };
+
+    //
+    // Wait for a pop, returns false once past the deadline
+    // (nanoseconds on the monotonic clock, set on the first call)
+
+    bool waitForRoom(int64_t& deadline) {
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        const int64_t now = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+
+        if (0 == deadline)
+            deadline = now + m_timeout;
+
+        //
+        // Each pop wakes one blocked producer. Giving up, we pass
+        // the wake-up on, in case it was ours.
+
+        if (now >= deadline) {
+            if (m_blocked > 0)
+                syscall(__NR_futex, &m_pops, FUTEX_WAKE, 1, NULL, 0, 0);
+            return false;
+        }
+
+        //
+        // A consumer that pops after we sample m_pops changes it, and
+        // sees m_blocked set
+
+        __sync_fetch_and_add(&m_blocked, 1);
+
+        const int32_t pops = m_pops;
+
+        if (m_queue.size() < m_queue.capacity())
+            sched_yield(); // a pop is being completed
+        else {
+            const int64_t remaining = deadline - now;
+
+            ts.tv_sec  = remaining / 1000000000LL;
+            ts.tv_nsec = remaining % 1000000000LL;
+
+            syscall(__NR_futex, &m_pops, FUTEX_WAIT, pops, &ts, 0, 0);
+        }
+
+        __sync_fetch_and_sub(&m_blocked, 1);
+
+        return true;
+    };
+
+    void popped() {
+        if (Overflow_Block != m_overflow)
+            return;
+
+        __sync_fetch_and_add(&m_pops, 1);
+        if (m_blocked > 0)
+            syscall(__NR_futex, &m_pops, FUTEX_WAKE, 1, NULL, 0, 0);
+    };
+
+    void signal() {
+        __sync_fetch_and_add(&m_events, 1);
+        if (m_waiters > 0)
+            syscall(__NR_futex, &m_events, FUTEX_WAKE, 1, NULL, 0, 0);
+    };
+
+    BoundedQueue<T>   m_queue;
+    const Overflow    m_overflow;
+    const int64_t     m_timeout;
+    volatile int32_t  m_events;
+    volatile int32_t  m_waiters;
+    volatile int32_t  m_kicks;
+    volatile int32_t  m_pops;
+    volatile int32_t  m_blocked;
+    volatile uint64_t m_drops;
+};
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_BOUNDEDQUEUE_HH */
@@ -0,0 +1,276 @@
+/**
+ * @file LibMultiSense/details/utility/BufferPool.hh
+ *
+ * Declares a pool of fixed-size stream buffers that return themselves
+ * to the pool when their last consumer releases them.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_BUFFERPOOL_HH
+#define CRL_MULTISENSE_BUFFERPOOL_HH
+
+#include "Arena.hh"
+#include "BufferStream.hh"
+#include "ReferenceCount.hh"
+#include "Thread.hh"
+
+#include <stdint.h>
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// A pool of buffers. The pool holds one reference to each buffer;
+// when every other reference has been released the buffer is pushed
+// back onto a lock-free free-list, so acquiring is O(1).
+//
+// Buffers may be released from any thread. Acquiring, and changing
+// the pool's contents, must be serialized by the caller.
+
+class BufferPool {
+public:
+
+    BufferPool() :
+        m_bufferSize(0),
+        m_buffers(),
+        m_freeListP(NULL),
+        m_arenaRequested(0),
+        m_arenaFlags(0),
+        m_highWaterMark(0),
+        m_exhaustedEvents(0),
+        m_lock() {};
+
+    ~BufferPool() {
+        clear();
+    };
+
+    //
+    // Allocate 'count' buffers of 'size' bytes. With 'arenaFlags' the
+    // buffers are carved from a single Arena, which is unmapped once
+    // the pool and every buffer have been released.
+
+    void create(uint32_t    count,
+                std::size_t size,
+                uint32_t    arenaFlags=0,
+                int32_t     numaNode=-1) {
+
+        std::vector<BufferStreamWriter*> buffers;
+        Arena                           *arenaP = NULL;
+
+        if (0 == arenaFlags)
+            for(uint32_t i=0; i<count; i++)
+                buffers.push_back(new BufferStreamWriter(size));
+        else {
+            arenaP = new Arena(count * size, arenaFlags, numaNode);
+            for(uint32_t i=0; i<count; i++)
+                buffers.push_back(new BufferStreamWriter(arenaP->data() + (i * size), size));
+        }
+
+        adopt(buffers, size, arenaFlags, arenaP);
+    };
+
+    //
+    // Use caller-owned memory
+
+    void create(const std::vector<uint8_t*>& memory, std::size_t size) {
+
+        std::vector<BufferStreamWriter*> buffers;
+
+        for(uint32_t i=0; i<memory.size(); i++)
+            buffers.push_back(new BufferStreamWriter(memory[i], size));
+
+        adopt(buffers, size, 0, NULL);
+    };
+
+    //
+    // Drop the pool's references. Buffers still held by consumers
+    // remain valid until they are released.
+
+    void clear() {
+
+        ScopedLock lock(m_lock);
+
+        for(uint32_t i=0; i<m_buffers.size(); i++)
+            delete m_buffers[i];
+        m_buffers.clear();
+
+        if (m_freeListP) {
+            m_freeListP->release();
+            m_freeListP = NULL;
+        }
+
+        m_bufferSize     = 0;
+        m_arenaRequested = 0;
+        m_arenaFlags     = 0;
+    };
+
+    //
+    // Take a free buffer, returns false if all are in use
+
+    bool acquire(BufferStreamWriter& buffer) {
+
+        uint32_t index;
+
+        if (NULL == m_freeListP || false == m_freeListP->pop(index)) {
+            __sync_fetch_and_add(&m_exhaustedEvents, 1);
+            return false;
+        }
+
+        buffer = *(m_buffers[index]);
+
+        const uint32_t used = m_buffers.size() - m_freeListP->available();
+        if (used > m_highWaterMark)
+            m_highWaterMark = used;
+
+        return true;
+    };
+
+    //
+    // Occupancy
+
+    void statistics(std::size_t& bufferSize,
+                    uint32_t&    bufferCount,
+                    uint32_t&    inUse,
+                    uint32_t&    highWaterMark,
+                    uint64_t&    exhaustedEvents,
+                    uint32_t&    arenaFlags) {
+
+        ScopedLock lock(m_lock);
+
+        bufferSize      = m_bufferSize;
+        bufferCount     = m_buffers.size();
+        inUse           = m_freeListP ? (bufferCount - m_freeListP->available()) : 0;
+        highWaterMark   = m_highWaterMark;
+        exhaustedEvents = m_exhaustedEvents;
+        arenaFlags      = m_arenaFlags;
+    };
+
+    std::size_t bufferSize()     const { return m_bufferSize;     };
+    std::size_t size()           const { return m_buffers.size(); };
+    uint32_t    arenaRequested() const { return m_arenaRequested; };
+    uint32_t    arenaFlags()     const { return m_arenaFlags;     };
+
+private:
+
+    //
+    // A Treiber stack of buffer indices. The head carries a
+    // modification tag alongside the index to defeat ABA.
+
+    class FreeList : public ReferenceRecycler {
+    public:
+
+        FreeList(uint32_t capacity,
+                 Arena   *arenaP) :
+            m_next(capacity, NIL),
+            m_head(pack(NIL, 0)),
+            m_available(0),
+            m_arenaP(arenaP) {};
+
+        ~FreeList() {
+            delete m_arenaP;
+        };
+
+        void recycle(uint32_t index) {
+
+            uint64_t head, next;
+
+            do {
+                head           = m_head;
+                m_next[index]  = indexOf(head);
+                next           = pack(index, tagOf(head) + 1);
+            } while (false == __sync_bool_compare_and_swap(&m_head, head, next));
+
+            __sync_fetch_and_add(&m_available, 1);
+        };
+
+        bool pop(uint32_t& index) {
+
+            uint64_t head, next;
+
+            do {
+                head = m_head;
+                if (NIL == indexOf(head))
+                    return false;
+                next = pack(m_next[indexOf(head)], tagOf(head) + 1);
+            } while (false == __sync_bool_compare_and_swap(&m_head, head, next));
+
+            __sync_fetch_and_sub(&m_available, 1);
+
+            index = indexOf(head);
+            return true;
+        };
+
+        uint32_t available() const { return m_available; };
+
+    private:
+
+        static const uint32_t NIL = 0xffffffff;
+
+        static uint64_t pack   (uint32_t i, uint32_t t) { return (static_cast<uint64_t>(t) << 32) | i; };
+        static uint32_t indexOf(uint64_t h)             { return static_cast<uint32_t>(h);           };
+        static uint32_t tagOf  (uint64_t h)             { return static_cast<uint32_t>(h >> 32);     };
+
+        std::vector<uint32_t> m_next;
+        volatile uint64_t     m_head;
+        volatile uint32_t     m_available;
+        Arena                *m_arenaP; // backing memory, if any
+    };
+
+    //
+    // Take ownership of 'buffers', all of which start out free
+
+    void adopt(const std::vector<BufferStreamWriter*>& buffers,
+               std::size_t                             size,
+               uint32_t                                arenaRequested,
+               Arena                                  *arenaP) {
+
+        clear();
+
+        ScopedLock lock(m_lock);
+
+        m_bufferSize     = size;
+        m_buffers        = buffers;
+        m_freeListP      = new FreeList(buffers.size(), arenaP);
+        m_arenaRequested = arenaRequested;
+        m_arenaFlags     = arenaP ? arenaP->flags() : 0;
+        m_highWaterMark  = 0;
+
+        for(uint32_t i=0; i<m_buffers.size(); i++) {
+            m_buffers[i]->recycleWith(m_freeListP, i);
+            m_freeListP->recycle(i);
+        }
+    };
+
+    std::size_t                      m_bufferSize;
+    std::vector<BufferStreamWriter*> m_buffers;
+    FreeList                        *m_freeListP;
+    uint32_t                         m_arenaRequested;
+    uint32_t                         m_arenaFlags;
+    volatile uint32_t                m_highWaterMark;
+    volatile uint64_t                m_exhaustedEvents;
+    Mutex                            m_lock;
+};
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_BUFFERPOOL_HH */
@@ -63,6 +63,10 @@ public:
 
 #ifndef SENSORPOD_FIRMWARE
     bool        shared() const { return m_ref.isShared();     };
+
+    void recycleWith(ReferenceRecycler *recyclerP, uint32_t index) {
+        m_ref.recycleWith(recyclerP, index);
+    };
 #endif // SENSORPOD_FIRMWARE
 
     virtual void read (void *bufferP, std::size_t length) {
@@ -90,7 +94,12 @@ public:
         m_alloced(false),
         m_size(0),
         m_tell(0),
+#ifndef SENSORPOD_FIRMWARE
+        m_bufferP(NULL),
+        m_ref(ReferenceCount::Empty()) {};
+#else
         m_bufferP(NULL) {};
+#endif // SENSORPOD_FIRMWARE
 
     //
     // Construction, we allocate memory
@@ -142,6 +151,30 @@ public:
 #endif // SENSORPOD_FIRMWARE
     };
 
+    //
+    // Assignment, freeing our memory if this was the last reference
+
+    BufferStream& operator=(const BufferStream& source) {
+
+        if (this != &source) {
+
+#ifndef SENSORPOD_FIRMWARE
+            if (m_alloced && false == m_ref.isShared())
+                delete[] m_bufferP;
+#endif // SENSORPOD_FIRMWARE
+
+            m_alloced = source.m_alloced;
+            m_size    = source.m_size;
+            m_tell    = source.m_tell;
+            m_bufferP = source.m_bufferP;
+
+#ifndef SENSORPOD_FIRMWARE
+            m_ref     = source.m_ref;
+#endif // SENSORPOD_FIRMWARE
+        }
+        return *this;
+    };
+
 protected:
 
     bool         m_alloced;
@@ -0,0 +1,144 @@
+/**
+ * @file LibMultiSense/details/utility/ClockModel.cc
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "ClockModel.hh"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+const double ClockModel::MIN_SKEW_SPAN = 2.0;
+const double ClockModel::MAX_SKEW      = 500e-6;
+
+ClockModel::ClockModel(uint32_t window) :
+    m_window(window < 2 ? 2 : window),
+    m_samples(),
+    m_valid(false),
+    m_mapping(),
+    m_residual(0.0),
+    m_fitted(0) {}
+
+void ClockModel::reset()
+{
+    m_samples.clear();
+
+    m_valid    = false;
+    m_mapping  = Mapping();
+    m_residual = 0.0;
+    m_fitted   = 0;
+}
+
+void ClockModel::add(double remote,
+                     double local,
+                     double roundTrip)
+{
+    if (false == m_samples.empty() && remote < m_samples.back().remote)
+        m_samples.clear();
+
+    m_samples.push_back(Sample(remote, local - remote, roundTrip));
+
+    while(m_samples.size() > m_window)
+        m_samples.pop_front();
+
+    fit();
+}
+
+void ClockModel::fit()
+{
+    //
+    // The round trip a quarter of the way up, and the probes at or below it
+
+    std::vector<double> trips;
+    for(uint32_t i=0; i<m_samples.size(); i++)
+        trips.push_back(m_samples[i].roundTrip);
+
+    const uint32_t quarter = (trips.size() - 1) / 4;
+    std::nth_element(trips.begin(), trips.begin() + quarter, trips.end());
+
+    const double threshold = trips[quarter];
+
+    std::vector<const Sample*> fitted;
+    for(uint32_t i=0; i<m_samples.size(); i++)
+        if (m_samples[i].roundTrip <= threshold)
+            fitted.push_back(&(m_samples[i]));
+
+    //
+    // Least squares, about the mean remote time to keep the sums small
+
+    double meanRemote = 0.0;
+    double meanOffset = 0.0;
+
+    for(uint32_t i=0; i<fitted.size(); i++) {
+        meanRemote += fitted[i]->remote;
+        meanOffset += fitted[i]->offset;
+    }
+
+    meanRemote /= fitted.size();
+    meanOffset /= fitted.size();
+
+    double sxx  = 0.0;
+    double sxy  = 0.0;
+    double low  = fitted[0]->remote;
+    double high = fitted[0]->remote;
+
+    for(uint32_t i=0; i<fitted.size(); i++) {
+        const double dx = fitted[i]->remote - meanRemote;
+        const double dy = fitted[i]->offset - meanOffset;
+
+        sxx += dx * dx;
+        sxy += dx * dy;
+
+        low  = std::min(low,  fitted[i]->remote);
+        high = std::max(high, fitted[i]->remote);
+    }
+
+    //
+    // Keep the last skew if this window can not measure it
+
+    double skew = m_mapping.skew;
+
+    if (high - low >= MIN_SKEW_SPAN && sxx > 0.0 && fabs(sxy / sxx) <= MAX_SKEW)
+        skew = sxy / sxx;
+
+    double squares = 0.0;
+
+    for(uint32_t i=0; i<fitted.size(); i++) {
+        const double error = (fitted[i]->offset - meanOffset -
+                              skew * (fitted[i]->remote - meanRemote));
+        squares += error * error;
+    }
+
+    m_valid          = true;
+    m_mapping.offset = meanOffset;
+    m_mapping.skew   = skew;
+    m_mapping.center = meanRemote;
+    m_residual       = sqrt(squares / fitted.size());
+    m_fitted         = fitted.size();
+}
+
+}}}} // namespaces
@@ -0,0 +1,129 @@
+/**
+ * @file LibMultiSense/details/utility/ClockModel.hh
+ *
+ * Declares an estimate of a remote clock's offset and skew from the
+ * local clock, fit to round-trip probes.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_CLOCKMODEL_HH
+#define CRL_MULTISENSE_CLOCKMODEL_HH
+
+#include <stdint.h>
+
+#include <deque>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// Maps remote times to local times as
+//
+//   local = remote + offset + skew * (remote - center)
+//
+// fit by least squares to a window of probes. Each probe pairs a
+// remote time with the local time half way through the round trip
+// that fetched it. Only the probes with the shortest round trips
+// (the fastest quarter of the window) are fit, the others having most
+// likely been delayed on one leg.
+//
+// The skew is only fit when the probes span enough time to measure
+// it. It is 0 until then, and the last one fit otherwise.
+
+class ClockModel {
+public:
+
+    //
+    // A fit, as plain data that may be copied out to readers
+
+    class Mapping {
+    public:
+        Mapping() : offset(0.0), skew(0.0), center(0.0) {};
+
+        double toLocal(double remote) const {
+            return remote + offset + skew * (remote - center);
+        };
+
+        double offset; // seconds
+        double skew;   // seconds per second
+        double center; // remote seconds
+    };
+
+    ClockModel(uint32_t window);
+
+    //
+    // Add a probe, and refit. A remote time earlier than the last one
+    // (the remote end restarted) discards the window.
+
+    void add(double remote,
+             double local,
+             double roundTrip);
+
+    void reset();
+
+    //
+    // The local time of a remote time
+
+    double toLocal(double remote) const { return m_mapping.toLocal(remote); };
+
+    //
+    // The RMS distance of the fitted probes from the fit, and their number
+
+    bool           valid()    const { return m_valid;          };
+    double         offset()   const { return m_mapping.offset; };
+    double         skew()     const { return m_mapping.skew;   };
+    const Mapping& mapping()  const { return m_mapping;        };
+    double         residual() const { return m_residual;       };
+    uint32_t       fitted()   const { return m_fitted;         };
+
+private:
+
+    //
+    // The remote time the probes must span to fit a skew, and the
+    // largest skew believed
+
+    static const double MIN_SKEW_SPAN; // seconds
+    static const double MAX_SKEW;      // seconds per second
+
+    class Sample {
+    public:
+        Sample(double r, double o, double t) : remote(r), offset(o), roundTrip(t) {};
+
+        double remote;
+        double offset; // local - remote
+        double roundTrip;
+    };
+
+    void fit();
+
+    const uint32_t     m_window;
+    std::deque<Sample> m_samples;
+
+    bool               m_valid;
+    Mapping            m_mapping;
+    double             m_residual;
+    uint32_t           m_fitted;
+};
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_CLOCKMODEL_HH */
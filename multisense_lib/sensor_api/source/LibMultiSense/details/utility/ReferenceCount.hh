@@ -38,23 +38,76 @@ namespace multisense {
 namespace details {
 namespace utility {
 
+//
+// An owner that wants to know when every reference but its own has
+// been released, so that it can reuse the underlying resource.
+//
+// Recyclers are themselves reference counted, so that a resource may
+// outlive its owner.
+
+class ReferenceRecycler
+{
+public:
+
+    virtual void recycle(uint32_t index) = 0;
+
+    void share() {
+        __sync_fetch_and_add(&m_count, 1);
+    }
+
+    void release() {
+        if (__sync_sub_and_fetch(&m_count, 1) <= 0)
+            delete this;
+    }
+
+protected:
+
+    ReferenceRecycler() : m_count(1) {};
+    virtual ~ReferenceRecycler() {};
+
+private:
+
+    volatile int32_t m_count;
+};
+
 class ReferenceCount
 {
 public:
     
     bool isShared() const {
-        if (m_countP && (*m_countP) > 1)
+        if (m_countP && m_countP->count > 1)
             return true;
         return false;
     }
 
     void reset() {
         release();
-        m_countP = new int32_t(1);
+        m_countP = new Counter();
+    }
+
+    //
+    // Have 'recyclerP' notified with 'index' whenever the count
+    // drops back to one. The holder of this reference is the owner.
+
+    void recycleWith(ReferenceRecycler *recyclerP,
+                     uint32_t           index) {
+        if (m_countP) {
+            recyclerP->share();
+            m_countP->recyclerP = recyclerP;
+            m_countP->index     = index;
+        }
     }
 
     ReferenceCount() 
-        : m_countP(new int32_t(1)) {};
+        : m_countP(new Counter()) {};
+
+    //
+    // A reference to nothing, which costs no allocation
+
+    struct Empty {};
+
+    ReferenceCount(Empty)
+        : m_countP(NULL) {};
 
     ReferenceCount(const ReferenceCount& source) 
         : m_countP(source.m_countP) {
@@ -76,18 +129,45 @@ public:
 
 private:
 
-    volatile int32_t *m_countP;
+    struct Counter {
+        volatile int32_t   count;
+        ReferenceRecycler *recyclerP;
+        uint32_t           index;
+
+        Counter() : count(1), recyclerP(NULL), index(0) {};
+    };
+
+    Counter *m_countP;
         
     void share() {
         if (m_countP) 
-            __sync_fetch_and_add(m_countP, 1);
+            __sync_fetch_and_add(&(m_countP->count), 1);
     }
 
     void release() {
         if (m_countP) {
-            int32_t count = __sync_sub_and_fetch(m_countP, 1);
-            if (count <= 0)
+
+            //
+            // Hold the recycler across the decrement, another thread
+            // may drop the final reference to it meanwhile.
+
+            ReferenceRecycler *recyclerP = m_countP->recyclerP;
+            const uint32_t     index     = m_countP->index;
+
+            if (recyclerP)
+                recyclerP->share();
+
+            int32_t count = __sync_sub_and_fetch(&(m_countP->count), 1);
+            if (count <= 0) {
+                if (recyclerP)
+                    recyclerP->release();
                 delete m_countP;
+            } else if (1 == count && recyclerP)
+                recyclerP->recycle(index);
+
+            if (recyclerP)
+                recyclerP->release();
+
             m_countP = NULL;
         }
     }
@@ -0,0 +1,87 @@
+/**
+ * @file LibMultiSense/details/utility/SeqLock.hh
+ *
+ * Declares a sequence lock, publishing a small value to readers that
+ * never block.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_SEQLOCK_HH
+#define CRL_MULTISENSE_SEQLOCK_HH
+
+#include <stdint.h>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// The sequence is odd while a store is in progress. A reader copies
+// the value between two reads of the sequence, and retries if a store
+// overlapped the copy.
+//
+// TYPE must be plain data: a copy torn by a concurrent store is made,
+// and then discarded. Stores must be serialized by the caller.
+//
+// The acquire/release fences are free on x86, where a full barrier
+// (__sync_synchronize) would cost more than the mutex this replaces.
+
+template<class TYPE> class SeqLock {
+public:
+
+    SeqLock(const TYPE& value=TYPE()) :
+        m_sequence(0),
+        m_value(value) {};
+
+    void store(const TYPE& value) {
+        const uint32_t sequence = m_sequence;
+
+        __atomic_store_n(&m_sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        m_value = value;
+
+        __atomic_store_n(&m_sequence, sequence + 2, __ATOMIC_RELEASE);
+    };
+
+    TYPE load() const {
+        for(;;) {
+            const uint32_t before = __atomic_load_n(&m_sequence, __ATOMIC_ACQUIRE);
+
+            TYPE value = m_value;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (0 == (before & 1) &&
+                before == __atomic_load_n(&m_sequence, __ATOMIC_RELAXED))
+                return value;
+        }
+    };
+
+private:
+
+    uint32_t m_sequence;
+    TYPE     m_value;
+};
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_SEQLOCK_HH */
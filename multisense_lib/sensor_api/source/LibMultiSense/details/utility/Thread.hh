@@ -55,6 +55,7 @@ namespace utility {
 // Forward declarations.
 
 class ScopedLock;
+class Condition;
 
 //
 // A simple class to wrap pthread creation and joining
@@ -120,6 +121,54 @@ public:
             0 != pthread_join(m_id, NULL))
             CRL_DEBUG("pthread_join() failed: %s\n", strerror(errno));
     };          
+
+    //
+    // Change the scheduling of the running thread. A scheduler of -1
+    // and an empty CPU list leave scheduling and affinity as they are.
+
+    void setPolicy(int32_t                     scheduler,
+                   int32_t                     priority,
+                   const std::vector<int32_t>& cpus) {
+
+        if (-1 != scheduler) {
+            struct sched_param sattr = {0};
+            sattr.sched_priority = priority;
+
+            const int error = pthread_setschedparam(m_id, scheduler, &sattr);
+            if (0 != error)
+                CRL_EXCEPTION("pthread_setschedparam(scheduler=%d, pri=%d) failed: %s",
+                              scheduler, priority, strerror(error));
+        }
+
+        if (false == cpus.empty()) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+
+            for(uint32_t i=0; i<cpus.size(); i++) {
+                if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+                    CRL_EXCEPTION("invalid CPU %d", cpus[i]);
+                CPU_SET(cpus[i], &cpuSet);
+            }
+
+            const int error = pthread_setaffinity_np(m_id, sizeof(cpuSet), &cpuSet);
+            if (0 != error)
+                CRL_EXCEPTION("pthread_setaffinity_np() failed: %s", strerror(error));
+        }
+    };
+
+    //
+    // Name the thread, as shown by top -H, perf, gdb, etc. Names are
+    // truncated to 15 characters.
+
+    void setName(const char *nameP) {
+        char name[16];
+        strncpy(name, nameP, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+
+        const int error = pthread_setname_np(m_id, name);
+        if (0 != error)
+            CRL_DEBUG("pthread_setname_np(%s) failed: %s\n", name, strerror(error));
+    };
     
 private:
 
@@ -133,6 +182,7 @@ private:
 class Mutex {
 public:
     friend class ScopedLock;
+    friend class Condition;
     
     Mutex() : m_mutex() {
         if (0 != pthread_mutex_init(&m_mutex, NULL))
@@ -181,6 +231,34 @@ private:
     pthread_mutex_t *m_lockP;
 };
 
+//
+// A simple condition variable class, waited on with its mutex held
+
+class Condition {
+public:
+
+    Condition() : m_condition() {
+        if (0 != pthread_cond_init(&m_condition, NULL))
+            CRL_EXCEPTION("pthread_cond_init() failed: %s",
+                          strerror(errno));
+    };
+
+    ~Condition() {
+        pthread_cond_destroy(&m_condition);
+    };
+
+    void wait(Mutex& mutex) {
+        pthread_cond_wait(&m_condition, &mutex.m_mutex);
+    };
+
+    void broadcast() {
+        pthread_cond_broadcast(&m_condition);
+    };
+
+private:
+    pthread_cond_t m_condition;
+};
+
 // A futex-based semaphore.
 //
 // This implementation does not work across processes.
@@ -223,6 +301,17 @@ public:
         } while (1);
     };
 
+    //
+    // Decrement if possible, without waiting
+
+    bool tryWait() {
+        int32_t val;
+        while((val = m_avail) > 0)
+            if (__sync_bool_compare_and_swap(&m_avail, val, val - 1))
+                return true;
+        return false;
+    };
+
     //
     // Post to the semaphore (increment.) Here we
     // signal the futex to wake up any waiters.
@@ -406,6 +495,22 @@ public:
         }
     }
 
+    bool tryWait(T& data) {
+        if (false == m_sem.tryWait())
+            return false;
+        {
+            ScopedLock lock(m_lock);
+
+            if (0 == m_queue.size())
+                return false;
+            else {
+                data = m_queue.front();
+                m_queue.pop_front();
+                return true;
+            }
+        }
+    }
+
     uint32_t waiters() { 
         return m_sem.waiters();
     };
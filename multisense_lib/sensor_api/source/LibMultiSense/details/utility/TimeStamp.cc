@@ -200,6 +200,25 @@ TimeStamp TimeStamp::getMonotonicTime()
     return timeStamp;
 }
 
+/*
+ * Returns the raw monotonic time. Unlike the monotonic time, this clock is
+ * not slewed by NTP, so intervals measured with it are in the units of the
+ * local oscillator.
+ */
+TimeStamp TimeStamp::getMonotonicRawTime()
+{
+    struct timespec time = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+
+    TimeStamp timeStamp;
+
+    timeStamp.time.tv_sec = time.tv_sec;
+    timeStamp.time.tv_usec = time.tv_nsec / 1000;
+
+    return timeStamp;
+}
+
 #endif // SENSORPOD_FIRMWARE
 
 /*
@@ -71,6 +71,7 @@ public:
 
     static TimeStamp getCurrentTime();
     static TimeStamp getMonotonicTime();
+    static TimeStamp getMonotonicRawTime();
 
     static void setTimeAtPps(TimeStamp& local, TimeStamp& remote);
     static void setTimeAtPps(struct timeval& local, struct timeval& remote);
@@ -0,0 +1,277 @@
+/**
+ * @file LibMultiSense/details/utility/Unpack.cc
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "Unpack.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRL_UNPACK_X86
+#include <immintrin.h>
+#elif defined(CRL_UNPACK_ENABLE_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define CRL_UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// Reference implementations
+
+void unpack12To16Scalar(const uint8_t *sP, uint16_t *dP, uint32_t count)
+{
+    for(uint32_t i=0; i<count; i+=2, sP+=3) {
+        dP[i]   = ((sP[0]     ) | ((sP[1] & 0x0F) << 8));
+        dP[i+1] = ((sP[1] >> 4) |  (sP[2] << 4)        );
+    }
+}
+
+void unpack12ToFloatScalar(const uint8_t *sP, float *dP, uint32_t count)
+{
+    for(uint32_t i=0; i<count; i+=2, sP+=3) {
+        dP[i]   = static_cast<float>((sP[0]     ) | ((sP[1] & 0x0F) << 8)) / 16.0f;
+        dP[i+1] = static_cast<float>((sP[1] >> 4) |  (sP[2] << 4)        ) / 16.0f;
+    }
+}
+
+namespace {
+
+#if defined(CRL_UNPACK_X86)
+
+//
+// Each 16-bit lane gathers the two bytes its pixel spans. Even lanes
+// then keep the low 12 bits, odd lanes the high 12.
+//
+// The vector loads read 4 bytes beyond the 12 they consume, so the
+// last few pixels are always left to the scalar code.
+
+#define CRL_UNPACK_SHUFFLE 11, 10, 10, 9, 8, 7, 7, 6, 5, 4, 4, 3, 2, 1, 1, 0
+
+__attribute__((target("sse4.1")))
+inline __m128i unpack8Sse(const uint8_t *sP)
+{
+    const __m128i shuffle = _mm_set_epi8(CRL_UNPACK_SHUFFLE);
+    const __m128i pairs   = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sP)), shuffle);
+
+    return _mm_blend_epi16(_mm_and_si128(pairs, _mm_set1_epi16(0x0fff)),
+                           _mm_srli_epi16(pairs, 4), 0xaa);
+}
+
+__attribute__((target("avx2")))
+inline __m256i unpack16Avx2(const uint8_t *sP)
+{
+    const __m256i shuffle = _mm256_set_epi8(CRL_UNPACK_SHUFFLE, CRL_UNPACK_SHUFFLE);
+    const __m256i packed  = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sP))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(sP + 12)), 1);
+    const __m256i pairs   = _mm256_shuffle_epi8(packed, shuffle);
+
+    return _mm256_blend_epi16(_mm256_and_si256(pairs, _mm256_set1_epi16(0x0fff)),
+                              _mm256_srli_epi16(pairs, 4), 0xaa);
+}
+
+__attribute__((target("sse4.1")))
+void unpack12To16Sse(const uint8_t *sP, uint16_t *dP, uint32_t count)
+{
+    uint32_t i = 0;
+
+    for(; count - i >= 16; i+=8, sP+=12)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dP + i), unpack8Sse(sP));
+
+    if (i < count)
+        unpack12To16Scalar(sP, dP + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void unpack12ToFloatSse(const uint8_t *sP, float *dP, uint32_t count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 16.0f); // exact, a power of two
+
+    uint32_t i = 0;
+
+    for(; count - i >= 16; i+=8, sP+=12) {
+
+        const __m128i pixels = unpack8Sse(sP);
+
+        _mm_storeu_ps(dP + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(pixels)), scale));
+        _mm_storeu_ps(dP + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(pixels, 8))), scale));
+    }
+
+    if (i < count)
+        unpack12ToFloatScalar(sP, dP + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void unpack12To16Avx2(const uint8_t *sP, uint16_t *dP, uint32_t count)
+{
+    uint32_t i = 0;
+
+    for(; count - i >= 24; i+=16, sP+=24)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dP + i), unpack16Avx2(sP));
+
+    if (i < count)
+        unpack12To16Scalar(sP, dP + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void unpack12ToFloatAvx2(const uint8_t *sP, float *dP, uint32_t count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 16.0f);
+
+    uint32_t i = 0;
+
+    for(; count - i >= 24; i+=16, sP+=24) {
+
+        const __m256i pixels = unpack16Avx2(sP);
+
+        _mm256_storeu_ps(dP + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(
+                             _mm256_cvtepu16_epi32(_mm256_castsi256_si128(pixels))), scale));
+        _mm256_storeu_ps(dP + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(
+                             _mm256_cvtepu16_epi32(_mm256_extracti128_si256(pixels, 1))), scale));
+    }
+
+    if (i < count)
+        unpack12ToFloatScalar(sP, dP + i, count - i);
+}
+
+#undef CRL_UNPACK_SHUFFLE
+
+#elif defined(CRL_UNPACK_NEON)
+
+//
+// vld3 de-interleaves the byte triplets, vst2 re-interleaves the
+// even and odd pixels: 16 pixels from exactly 24 bytes.
+
+inline void unpack16Neon(const uint8_t *sP, uint16x8_t& even, uint16x8_t& odd)
+{
+    const uint8x8x3_t packed = vld3_u8(sP);
+
+    even = vorrq_u16(vmovl_u8(packed.val[0]),
+                     vshlq_n_u16(vmovl_u8(vand_u8(packed.val[1], vdup_n_u8(0x0f))), 8));
+    odd  = vorrq_u16(vmovl_u8(vshr_n_u8(packed.val[1], 4)),
+                     vshlq_n_u16(vmovl_u8(packed.val[2]), 4));
+}
+
+void unpack12To16Neon(const uint8_t *sP, uint16_t *dP, uint32_t count)
+{
+    uint32_t i = 0;
+
+    for(; count - i >= 16; i+=16, sP+=24) {
+
+        uint16x8x2_t pixels;
+
+        unpack16Neon(sP, pixels.val[0], pixels.val[1]);
+        vst2q_u16(dP + i, pixels);
+    }
+
+    if (i < count)
+        unpack12To16Scalar(sP, dP + i, count - i);
+}
+
+void unpack12ToFloatNeon(const uint8_t *sP, float *dP, uint32_t count)
+{
+    const float32x4_t scale = vdupq_n_f32(1.0f / 16.0f);
+
+    uint32_t i = 0;
+
+    for(; count - i >= 16; i+=16, sP+=24) {
+
+        uint16x8_t   even, odd;
+        float32x4x2_t low, high;
+
+        unpack16Neon(sP, even, odd);
+
+        low.val[0]  = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16 (even))), scale);
+        low.val[1]  = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16 (odd))),  scale);
+        high.val[0] = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(even))), scale);
+        high.val[1] = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(odd))),  scale);
+
+        vst2q_f32(dP + i,     low);
+        vst2q_f32(dP + i + 8, high);
+    }
+
+    if (i < count)
+        unpack12ToFloatScalar(sP, dP + i, count - i);
+}
+
+#endif
+
+//
+// Kernel selection, done once at load time
+
+std::vector<UnpackKernel> supportedKernels()
+{
+    std::vector<UnpackKernel> supported;
+
+    const UnpackKernel scalar = { "scalar", unpack12To16Scalar, unpack12ToFloatScalar };
+    supported.push_back(scalar);
+
+#if defined(CRL_UNPACK_X86)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse4.1")) {
+        const UnpackKernel sse = { "sse4.1", unpack12To16Sse, unpack12ToFloatSse };
+        supported.push_back(sse);
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        const UnpackKernel avx2 = { "avx2", unpack12To16Avx2, unpack12ToFloatAvx2 };
+        supported.push_back(avx2);
+    }
+
+#elif defined(CRL_UNPACK_NEON)
+
+    const UnpackKernel neon = { "neon", unpack12To16Neon, unpack12ToFloatNeon };
+    supported.push_back(neon);
+
+#endif
+
+    return supported;
+}
+
+const UnpackKernel kernels = supportedKernels().back();
+
+}; // anonymous
+
+void unpack12To16(const uint8_t *sP, uint16_t *dP, uint32_t count)
+{
+    kernels.to16P(sP, dP, count);
+}
+
+void unpack12ToFloat(const uint8_t *sP, float *dP, uint32_t count)
+{
+    kernels.toFloatP(sP, dP, count);
+}
+
+const char *unpackKernel()
+{
+    return kernels.nameP;
+}
+
+std::vector<UnpackKernel> unpackKernels()
+{
+    return supportedKernels();
+}
+
+}}}} // namespaces
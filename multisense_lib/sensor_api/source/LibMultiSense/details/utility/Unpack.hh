@@ -0,0 +1,76 @@
+/**
+ * @file LibMultiSense/details/utility/Unpack.hh
+ *
+ * Declares the kernels that expand 12-bit packed pixels, as sent by
+ * the sensor for disparity images.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CRL_MULTISENSE_UNPACK_HH
+#define CRL_MULTISENSE_UNPACK_HH
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+namespace utility {
+
+//
+// Every 3 bytes of input hold a pair of pixels, little-endian:
+//
+//    pixel[0] = byte[0]        | (byte[1] & 0x0f) << 8
+//    pixel[1] = byte[1] >> 4   |  byte[2]         << 4
+//
+// 'count' is the number of pixels, and is rounded up to a whole pair.
+// The float variant scales to pixels (the wire carries 1/16th pixels.)
+//
+// The fastest kernel the CPU supports is chosen when the library is
+// loaded; the scalar versions are the reference implementation.
+
+void unpack12To16      (const uint8_t *sP, uint16_t *dP, uint32_t count);
+void unpack12ToFloat   (const uint8_t *sP, float    *dP, uint32_t count);
+
+void unpack12To16Scalar   (const uint8_t *sP, uint16_t *dP, uint32_t count);
+void unpack12ToFloatScalar(const uint8_t *sP, float    *dP, uint32_t count);
+
+//
+// The name of the selected kernel ("scalar", "sse4.1", "avx2", "neon")
+
+const char *unpackKernel();
+
+//
+// The kernels this CPU can run: the scalar versions first, the
+// selected ones last. For checking each against the scalar versions.
+
+class UnpackKernel {
+public:
+    const char *nameP;
+    void      (*to16P)   (const uint8_t*, uint16_t*, uint32_t);
+    void      (*toFloatP)(const uint8_t*, float*,    uint32_t);
+};
+
+std::vector<UnpackKernel> unpackKernels();
+
+}}}} // namespaces
+
+#endif /* #ifndef CRL_MULTISENSE_UNPACK_HH */
@@ -178,6 +178,11 @@ static const IdType ID_DATA_SYS_TEST_MTU_RESPONSE = 0x0117;
 static const IdType ID_DATA_JPEG_IMAGE            = 0x0118;
 static const IdType ID_DATA_SYS_DIRECTED_STREAMS  = 0x0119;
 
+//
+// Every ID above is less than this; it sizes the per-ID tables
+
+static const IdType ID_LIMIT = 0x0200;
+
 //
 // Data sources
 
@@ -0,0 +1,398 @@
+/**
+ * @file LibMultiSense/details/workers.cc
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "details/workers.hh"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace crl {
+namespace multisense {
+namespace details {
+
+namespace {
+
+//
+// The shared pool, and the lock for it and its reference count
+
+utility::Mutex  sharedPoolLock;
+WorkerPool     *sharedPoolP = NULL;
+
+//
+// The strand this worker thread is running, and whether it was
+// detached (and so destroyed) from its own run()
+
+__thread Strand *runningStrandP  = NULL;
+__thread bool    runningDetached = false;
+
+}; // anonymous
+
+//
+// Strands
+
+Strand::Strand(WorkerPool *poolP) :
+    m_poolP(poolP),
+    m_lock(),
+    m_scheduled(false),
+    m_detached(false),
+    m_home(poolP ? poolP->home() : 0) {}
+
+void Strand::schedule()
+{
+    if (NULL == m_poolP)
+        return;
+
+    utility::ScopedLock lock(m_lock);
+
+    if (m_scheduled || m_detached)
+        return;
+
+    m_scheduled = true;
+    m_poolP->push(this);
+}
+
+void Strand::detach()
+{
+    if (NULL == m_poolP)
+        return;
+
+    WorkerPool *poolP = m_poolP;
+
+    {
+        utility::ScopedLock lock(m_lock);
+
+        m_detached = true;
+
+        //
+        // From our own run(): the worker lets go of us, and releases
+        // the pool, once run() returns
+
+        if (this == runningStrandP) {
+            runningDetached = true;
+            m_poolP         = NULL;
+            return;
+        }
+
+        //
+        // Still queued: take us back, so that no worker is needed
+
+        if (m_scheduled && poolP->unqueue(this))
+            m_scheduled = false;
+    }
+
+    //
+    // Else wait for the worker that popped us to let go
+
+    poolP->waitReleased(this);
+
+    WorkerPool::release(poolP);
+    m_poolP = NULL;
+}
+
+//
+// The shared pool
+
+Status WorkerPool::configure(uint32_t            threads,
+                             const ThreadPolicy& policy)
+{
+    utility::ScopedLock lock(sharedPoolLock);
+
+    if (sharedPoolP && sharedPoolP->m_references > 0)
+        return Status_Failed;
+
+    delete sharedPoolP;
+    sharedPoolP = NULL;
+
+    if (threads > 0)
+        sharedPoolP = new WorkerPool(threads, policy);
+
+    return Status_Ok;
+}
+
+WorkerPool *WorkerPool::acquire()
+{
+    utility::ScopedLock lock(sharedPoolLock);
+
+    if (sharedPoolP)
+        sharedPoolP->m_references ++;
+
+    return sharedPoolP;
+}
+
+void WorkerPool::release(WorkerPool *poolP)
+{
+    utility::ScopedLock lock(sharedPoolLock);
+
+    poolP->m_references --;
+}
+
+//
+// Construction/destruction
+
+WorkerPool::WorkerPool(uint32_t            threads,
+                       const ThreadPolicy& policy) :
+    m_workers(),
+    m_scheduled(),
+    m_releaseLock(),
+    m_released(),
+    m_running(true),
+    m_nextHome(0),
+    m_references(0)
+{
+    for(uint32_t i=0; i<threads; i++) {
+        Worker *workerP  = new Worker;
+        workerP->poolP   = this;
+        workerP->index   = i;
+        workerP->threadP = NULL;
+        m_workers.push_back(workerP);
+    }
+
+    for(uint32_t i=0; i<threads; i++) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "ms-pool-%u", i);
+
+        m_workers[i]->threadP = new utility::Thread(workerThread, m_workers[i]);
+        m_workers[i]->threadP->setName(name);
+    }
+
+    //
+    // If this fails, the threads are still usable
+
+    try {
+        for(uint32_t i=0; i<threads; i++)
+            m_workers[i]->threadP->setPolicy(policy.scheduler,
+                                             policy.priority,
+                                             policy.cpus);
+    } catch (const std::exception& e) {
+        CRL_DEBUG("unable to set the callback thread policy: %s\n", e.what());
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    m_running = false;
+
+    for(uint32_t i=0; i<m_workers.size(); i++)
+        m_scheduled.post();
+
+    for(uint32_t i=0; i<m_workers.size(); i++) {
+        delete m_workers[i]->threadP;
+        delete m_workers[i];
+    }
+}
+
+//
+// Spread new strands across the workers
+
+uint32_t WorkerPool::home()
+{
+    return __sync_fetch_and_add(&m_nextHome, 1) % m_workers.size();
+}
+
+//
+// Queue a strand on its home worker. Called with the strand locked.
+
+void WorkerPool::push(Strand *strandP)
+{
+    Worker *workerP = m_workers[strandP->m_home % m_workers.size()];
+
+    {
+        utility::ScopedLock lock(workerP->lock);
+        workerP->queue.push_back(strandP);
+    }
+
+    m_scheduled.post();
+}
+
+//
+// Take a strand back from the queue it was pushed on, if it is still
+// there. Called with the strand locked.
+
+bool WorkerPool::unqueue(Strand *strandP)
+{
+    Worker *workerP = m_workers[strandP->m_home % m_workers.size()];
+
+    utility::ScopedLock lock(workerP->lock);
+
+    std::deque<Strand*>::iterator it = std::find(workerP->queue.begin(),
+                                                 workerP->queue.end(),
+                                                 strandP);
+    if (workerP->queue.end() == it)
+        return false;
+
+    //
+    // Its post is left behind: some worker wakes to an empty queue
+
+    workerP->queue.erase(it);
+
+    return true;
+}
+
+//
+// Take the oldest strand from our own queue, else steal the newest
+// from another worker's
+
+Strand *WorkerPool::pop(uint32_t worker)
+{
+    const uint32_t count = m_workers.size();
+
+    for(uint32_t i=0; i<count; i++) {
+
+        Worker *workerP = m_workers[(worker + i) % count];
+
+        utility::ScopedLock lock(workerP->lock);
+
+        if (workerP->queue.empty())
+            continue;
+
+        Strand *strandP;
+
+        if (0 == i) {
+            strandP = workerP->queue.front();
+            workerP->queue.pop_front();
+        } else {
+            strandP = workerP->queue.back();
+            workerP->queue.pop_back();
+        }
+
+        return strandP;
+    }
+
+    return NULL;
+}
+
+//
+// Run a strand for a while, re-queueing it if it has more to do
+
+void WorkerPool::turn(Strand  *strandP,
+                      uint32_t worker)
+{
+    bool detached;
+
+    {
+        utility::ScopedLock lock(strandP->m_lock);
+
+        detached = strandP->m_detached;
+        if (detached)
+            strandP->m_scheduled = false;
+    }
+
+    if (detached) {
+        notifyReleased();
+        return;
+    }
+
+    runningStrandP  = strandP;
+    runningDetached = false;
+
+    for(uint32_t i=0; i<STRAND_BATCH; i++)
+        if (false == strandP->run() || runningDetached)
+            break;
+
+    runningStrandP = NULL;
+
+    //
+    // Destroyed by its own callback: the reference it held is ours
+
+    if (runningDetached) {
+        release(this);
+        return;
+    }
+
+    //
+    // Anything added after run() found the queue empty is caught
+    // here: schedule() cannot get in until we let go of the lock.
+
+    {
+        utility::ScopedLock lock(strandP->m_lock);
+
+        detached = strandP->m_detached;
+
+        if (false == detached && strandP->pending() > 0) {
+            strandP->m_home = worker;
+            push(strandP);
+            return;
+        }
+
+        strandP->m_scheduled = false;
+    }
+
+    if (detached)
+        notifyReleased();
+}
+
+//
+// Wait for the worker that popped a detached strand to let go of it
+
+void WorkerPool::waitReleased(Strand *strandP)
+{
+    utility::ScopedLock lock(m_releaseLock);
+
+    while(1) {
+        {
+            utility::ScopedLock strandLock(strandP->m_lock);
+            if (false == strandP->m_scheduled)
+                return;
+        }
+        m_released.wait(m_releaseLock);
+    }
+}
+
+//
+// Wake the strands waiting in waitReleased(). Their flags were
+// cleared (under their locks) before we take ours, so none misses it.
+
+void WorkerPool::notifyReleased()
+{
+    utility::ScopedLock lock(m_releaseLock);
+    m_released.broadcast();
+}
+
+//
+// The worker thread
+
+void *WorkerPool::workerThread(void *argumentP)
+{
+    Worker     *workerP = reinterpret_cast<Worker*>(argumentP);
+    WorkerPool *selfP   = workerP->poolP;
+
+    while(1) {
+
+        selfP->m_scheduled.wait();
+
+        if (false == selfP->m_running)
+            break;
+
+        Strand *strandP = selfP->pop(workerP->index);
+
+        if (strandP)
+            selfP->turn(strandP, workerP->index);
+    }
+
+    return NULL;
+}
+
+}; // namespace details
+}; // namespace multisense
+}; // namespace crl
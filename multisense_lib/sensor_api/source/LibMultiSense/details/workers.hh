@@ -0,0 +1,157 @@
+/**
+ * @file LibMultiSense/details/workers.hh
+ *
+ * Declares the shared pool of threads that may run user callbacks in
+ * place of a thread per callback.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LibMultiSense_details_workers_hh
+#define LibMultiSense_details_workers_hh
+
+#include "MultiSenseTypes.hh"
+
+#include "details/utility/Thread.hh"
+
+#include <deque>
+#include <vector>
+
+namespace crl {
+namespace multisense {
+namespace details {
+
+class WorkerPool;
+
+//
+// A serial queue of work, run by a WorkerPool. At most one worker
+// runs a strand at a time, so its work is done in order.
+//
+// Derived classes keep their own queue: they call schedule() after
+// adding to it, and implement run() and pending(). They must call
+// detach() from their destructor, before their queue is destroyed.
+// A strand may be destroyed from its own run(), which must then
+// return without touching it.
+//
+// With a NULL pool, schedule() and detach() do nothing.
+
+class Strand {
+public:
+
+    Strand(WorkerPool *poolP);
+    virtual ~Strand() {};
+
+    WorkerPool *pool() const { return m_poolP; };
+
+protected:
+
+    void schedule();
+    void detach();
+
+    //
+    // Run one item of work, returning false if there was none
+
+    virtual bool     run()     = 0;
+    virtual uint32_t pending() = 0;
+
+private:
+
+    friend class WorkerPool;
+
+    WorkerPool     *m_poolP;
+    utility::Mutex  m_lock;
+    bool            m_scheduled; // queued on, popped or being run by a worker
+    bool            m_detached;
+    uint32_t        m_home;      // the worker that last ran it
+};
+
+//
+// A fixed number of threads running strands
+//
+// Each worker has its own queue of scheduled strands. A strand is
+// scheduled on the worker that last ran it; idle workers steal from
+// the others.
+//
+// There is one pool per process, shared by every Channel. Strands
+// hold a reference to the pool they were created with, so the pool
+// can only be resized while it is unused.
+
+class WorkerPool {
+public:
+
+    //
+    // Set the number of threads in the shared pool, 0 for none, and
+    // their scheduling
+
+    static Status configure(uint32_t            threads,
+                            const ThreadPolicy& policy);
+
+    //
+    // The shared pool for a new strand (NULL if there is none), and
+    // the release of that reference
+
+    static WorkerPool *acquire();
+    static void        release(WorkerPool *poolP);
+
+private:
+
+    friend class Strand;
+
+    //
+    // Items of work run per turn, before others get a look in
+
+    static const uint32_t STRAND_BATCH = 4;
+
+    struct Worker {
+        WorkerPool          *poolP;
+        uint32_t             index;
+        utility::Mutex       lock;
+        std::deque<Strand*>  queue;
+        utility::Thread     *threadP;
+    };
+
+    WorkerPool(uint32_t            threads,
+               const ThreadPolicy& policy);
+    ~WorkerPool();
+
+    uint32_t home();
+    void     push(Strand *strandP);
+    bool     unqueue(Strand *strandP);
+    Strand  *pop (uint32_t worker);
+    void     turn(Strand *strandP,
+                  uint32_t worker);
+    void     waitReleased(Strand *strandP);
+    void     notifyReleased();
+
+    static void *workerThread(void *argumentP);
+
+    std::vector<Worker*> m_workers;
+    utility::Semaphore   m_scheduled; // one post per queued strand
+    utility::Mutex       m_releaseLock;
+    utility::Condition   m_released;  // a detached strand was let go of
+    volatile bool        m_running;
+    uint32_t             m_nextHome;
+    uint32_t             m_references;
+};
+
+}; // namespace details
+}; // namespace multisense
+}; // namespace crl
+
+#endif // LibMultiSense_details_workers_hh
@@ -0,0 +1,915 @@
+/**
+ * @file LoopbackTestUtility/LoopbackTestUtility.cc
+ *
+ * Streams images from a fake sensor over the loopback interface, and
+ * checks that they are received intact however their datagrams are
+ * ordered, and that commands complete, whether asynchronous or made
+ * by several threads at once. With -b, compares the receive backends
+ * instead.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <LibMultiSense/MultiSenseChannel.hh>
+#include <LibMultiSense/details/utility/BufferStream.hh>
+#include <LibMultiSense/details/utility/Thread.hh>
+#include <LibMultiSense/details/utility/TimeStamp.hh>
+#include <LibMultiSense/details/wire/Protocol.h>
+#include <LibMultiSense/details/wire/AckMessage.h>
+#include <LibMultiSense/details/wire/SysMtuMessage.h>
+#include <LibMultiSense/details/wire/VersionResponseMessage.h>
+#include <LibMultiSense/details/wire/StatusResponseMessage.h>
+#include <LibMultiSense/details/wire/CamConfigMessage.h>
+#include <LibMultiSense/details/wire/ImageMessage.h>
+#include <LibMultiSense/details/wire/ImageMetaMessage.h>
+#include <LibMultiSense/details/wire/DisparityMessage.h>
+
+using namespace crl::multisense;
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+//
+// Where the library sends commands to a sensor
+
+const uint16_t SENSOR_PORT = 9001;
+
+//
+// Header bytes in each datagram ahead of the payload: IP, UDP and ours
+
+const uint32_t DATAGRAM_OVERHEAD = 20 + 8 + sizeof(wire::Header);
+
+//
+// How long to wait for the last frame to be delivered
+
+const double DELIVERY_TIMEOUT = 2.0; // seconds
+
+const DataSource SOURCES = Source_Luma_Left | Source_Disparity;
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+void usage(const char *programNameP)
+{
+    fprintf(stderr, "USAGE: %s [<options>]\n", programNameP);
+    fprintf(stderr, "Where <options> are:\n");
+    fprintf(stderr, "\t-b                 : benchmark the receive backends instead of testing\n");
+    fprintf(stderr, "\t-n <frames>        : frames streamed (default=20, benchmark=100)\n");
+    fprintf(stderr, "\t-W <width>         : frame width  (default=512, benchmark=2048)\n");
+    fprintf(stderr, "\t-H <height>        : frame height (default=272, benchmark=1088)\n");
+    fprintf(stderr, "\t-m <mtu>           : sensor MTU (default=7200)\n");
+    fprintf(stderr, "\t-p <milliseconds>  : frame period (default=20, benchmark=33)\n");
+
+    exit(-1);
+}
+
+double threadCpuTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+double processCpuTime()
+{
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return (r.ru_utime.tv_sec + r.ru_stime.tv_sec +
+            1e-6 * (r.ru_utime.tv_usec + r.ru_stime.tv_usec));
+}
+
+//
+// The pixels of each frame
+
+uint8_t lumaPixel(uint32_t i,
+                  int64_t  frameId)
+{
+    return static_cast<uint8_t>(i * 7 + frameId);
+}
+
+uint16_t disparityPixel(uint32_t i,
+                        int64_t  frameId)
+{
+    return static_cast<uint16_t>((i * 13 + frameId) & 0xfff);
+}
+
+//
+// The order datagrams of a message are sent in
+
+typedef enum {
+    Order_InOrder,
+    Order_Reversed,     // all but the first, which leads
+    Order_FirstLate,    // the first in the middle, the rest reversed
+    Order_Duplicated    // the second is sent twice
+} Order;
+
+const char *orderName(Order order)
+{
+    switch(order) {
+    case Order_InOrder:    return "in order";
+    case Order_Reversed:   return "reversed";
+    case Order_FirstLate:  return "first late";
+    case Order_Duplicated: return "duplicated";
+    }
+    return "unknown";
+}
+
+//
+// Answers the library's commands, and streams frames of a luma image
+// and a disparity image to it, as a sensor would
+
+class FakeSensor {
+public:
+
+    FakeSensor(uint32_t width,
+               uint32_t height,
+               uint32_t mtu);
+    ~FakeSensor();
+
+    bool bound() const { return m_socket >= 0; };
+
+    void setOrder(Order order) { m_order = order; };
+    void sendFrame(int64_t frameId);
+
+private:
+
+    static void *serverThread(void *argumentP);
+
+    void serve();
+
+    template<class T> void publish(T&       message,
+                                   uint32_t bytes=1024);
+
+    void sendMessage(const uint8_t *messageP,
+                     uint32_t       length,
+                     bool           disparity);
+
+    int                   m_socket;
+    utility::Mutex        m_peerLock;
+    struct sockaddr_in    m_peer;
+    bool                  m_havePeer;
+    uint16_t              m_sequence;
+    utility::Mutex        m_sendLock;
+
+    const uint32_t        m_width;
+    const uint32_t        m_height;
+    const uint32_t        m_mtu;
+    Order                 m_order;
+    const double          m_start;
+
+    std::vector<uint8_t>  m_luma;
+    std::vector<uint8_t>  m_packed;
+
+    volatile bool         m_running;
+    utility::Thread      *m_serverP;
+};
+
+FakeSensor::FakeSensor(uint32_t width,
+                       uint32_t height,
+                       uint32_t mtu) :
+    m_socket(-1),
+    m_peerLock(),
+    m_havePeer(false),
+    m_sequence(0),
+    m_sendLock(),
+    m_width(width),
+    m_height(height),
+    m_mtu(mtu),
+    m_order(Order_InOrder),
+    m_start(utility::TimeStamp::getMonotonicTime()),
+    m_luma(width * height),
+    m_packed(wire::Disparity::packedLength(width, height)),
+    m_running(false),
+    m_serverP(NULL)
+{
+    memset(&m_peer, 0, sizeof(m_peer));
+
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return;
+    }
+
+    int sendBuffer = 16 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+
+    struct timeval timeout = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(SENSOR_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (0 != bind(fd, (struct sockaddr*) &address, sizeof(address))) {
+        perror("bind");
+        close(fd);
+        return;
+    }
+
+    m_socket  = fd;
+    m_running = true;
+    m_serverP = new utility::Thread(serverThread, this);
+}
+
+FakeSensor::~FakeSensor()
+{
+    if (m_serverP) {
+        m_running = false;
+        delete m_serverP;
+    }
+
+    if (m_socket >= 0)
+        close(m_socket);
+}
+
+//
+// Answer every command with an Ack, and the queries the library makes
+// when connecting with their responses
+
+void *FakeSensor::serverThread(void *argumentP)
+{
+    reinterpret_cast<FakeSensor*>(argumentP)->serve();
+    return NULL;
+}
+
+void FakeSensor::serve()
+{
+    std::vector<uint8_t> datagram(9000);
+
+    while(m_running) {
+
+        struct sockaddr_in peer;
+        socklen_t          length = sizeof(peer);
+
+        const ssize_t bytes = recvfrom(m_socket, &(datagram[0]), datagram.size(), 0,
+                                       (struct sockaddr*) &peer, &length);
+
+        if (bytes < static_cast<ssize_t>(sizeof(wire::Header) + sizeof(wire::IdType)))
+            continue;
+
+        {
+            utility::ScopedLock lock(m_peerLock);
+            m_peer     = peer;
+            m_havePeer = true;
+        }
+
+        const wire::IdType id = *reinterpret_cast<const wire::IdType*>(&(datagram[sizeof(wire::Header)]));
+
+        switch(id) {
+        case wire::ID_CMD_SYS_GET_MTU: {
+            wire::SysMtu mtu(m_mtu);
+            publish(mtu);
+            break;
+        }
+        case wire::ID_CMD_GET_VERSION: {
+            wire::VersionResponse version;
+            version.firmwareVersion   = 0x0300;
+            version.firmwareBuildDate = "loopback";
+            publish(version);
+            break;
+        }
+        case wire::ID_CMD_GET_STATUS: {
+            wire::StatusResponse status;
+            status.uptime = utility::TimeStamp::getMonotonicTime() - m_start;
+            publish(status);
+            break;
+        }
+        case wire::ID_CMD_CAM_GET_CONFIG: {
+            wire::CamConfig config;
+            config.width       = m_width;
+            config.height      = m_height;
+            config.disparities = 128;
+            publish(config);
+            break;
+        }
+        default:
+            break;
+        }
+
+        wire::Ack ack(id, Status_Ok);
+        publish(ack);
+    }
+}
+
+//
+// Serialize a message, as the library's publish() does, and send it
+
+template<class T> void FakeSensor::publish(T&       message,
+                                           uint32_t bytes)
+{
+    utility::BufferStreamWriter stream(bytes);
+
+    const wire::IdType      id      = T::ID;
+    const wire::VersionType version = T::VERSION;
+
+    stream & id;
+    stream & version;
+    message.serialize(stream, version);
+
+    sendMessage(reinterpret_cast<const uint8_t*>(stream.data()), stream.tell(),
+                wire::Disparity::ID == id);
+}
+
+//
+// Split a message into datagrams and send them in the current order.
+// Disparity leads with its meta header alone, as the sensor sends it.
+
+void FakeSensor::sendMessage(const uint8_t *messageP,
+                             uint32_t       length,
+                             bool           disparity)
+{
+    utility::ScopedLock lock(m_sendLock);
+
+    struct sockaddr_in peer;
+    {
+        utility::ScopedLock peerLock(m_peerLock);
+        if (false == m_havePeer)
+            return;
+        peer = m_peer;
+    }
+
+    const uint32_t maxPayload = m_mtu - DATAGRAM_OVERHEAD;
+    const uint16_t sequence   = m_sequence ++;
+
+    std::vector<std::vector<uint8_t> > datagrams;
+
+    for(uint32_t offset=0; offset<length; ) {
+
+        uint32_t bytes = std::min(maxPayload, length - offset);
+
+        if (disparity && 0 == offset)
+            bytes = wire::Disparity::META_LENGTH;
+
+        datagrams.push_back(std::vector<uint8_t>(sizeof(wire::Header) + bytes));
+
+        wire::Header& header = *reinterpret_cast<wire::Header*>(&(datagrams.back()[0]));
+
+        header.magic              = wire::HEADER_MAGIC;
+        header.version            = wire::HEADER_VERSION;
+        header.group              = wire::HEADER_GROUP;
+        header.flags              = 0;
+        header.sequenceIdentifier = sequence;
+        header.messageLength      = length;
+        header.byteOffset         = offset;
+
+        memcpy(&(datagrams.back()[sizeof(wire::Header)]), messageP + offset, bytes);
+
+        offset += bytes;
+    }
+
+    if (datagrams.size() > 2)
+        switch(m_order) {
+        case Order_InOrder:
+            break;
+        case Order_Reversed:
+            std::reverse(datagrams.begin() + 1, datagrams.end());
+            break;
+        case Order_FirstLate: {
+            const std::vector<uint8_t> first = datagrams.front();
+            datagrams.erase(datagrams.begin());
+            std::reverse(datagrams.begin(), datagrams.end());
+            datagrams.insert(datagrams.begin() + datagrams.size() / 2, first);
+            break;
+        }
+        case Order_Duplicated:
+            datagrams.insert(datagrams.begin() + 2, datagrams[1]);
+            break;
+        }
+
+    //
+    // Pause now and then, so as not to overrun the receive buffer
+
+    for(uint32_t i=0; i<datagrams.size(); i++) {
+        sendto(m_socket, &(datagrams[i][0]), datagrams[i].size(), 0,
+               (struct sockaddr*) &peer, sizeof(peer));
+        if (15 == i % 16)
+            usleep(20);
+    }
+}
+
+//
+// A frame: its metadata, then its luma and disparity images
+
+void FakeSensor::sendFrame(int64_t frameId)
+{
+    wire::ImageMeta meta;
+    memset(meta.histogramP, 0, sizeof(meta.histogramP));
+    meta.frameId     = frameId;
+    meta.timeSeconds = 1;
+    publish(meta, sizeof(meta) + 1024);
+
+    for(uint32_t i=0; i<m_luma.size(); i++)
+        m_luma[i] = lumaPixel(i, frameId);
+
+    wire::Image luma;
+    luma.source       = wire::SOURCE_LUMA_LEFT;
+    luma.bitsPerPixel = 8;
+    luma.frameId      = frameId;
+    luma.width        = m_width;
+    luma.height       = m_height;
+    luma.dataP        = &(m_luma[0]);
+    publish(luma, m_luma.size() + 1024);
+
+    const uint32_t pixels = m_width * m_height;
+
+    for(uint32_t i=0; i<pixels; i+=2) {
+        const uint16_t first  = disparityPixel(i, frameId);
+        const uint16_t second = disparityPixel(i + 1, frameId);
+        uint8_t       *packedP = &(m_packed[(i / 2) * 3]);
+
+        packedP[0] = first & 0xff;
+        packedP[1] = (first >> 8) | ((second & 0xf) << 4);
+        packedP[2] = second >> 4;
+    }
+
+    wire::Disparity disparity;
+    disparity.frameId = frameId;
+    disparity.width   = m_width;
+    disparity.height  = m_height;
+    disparity.dataP   = &(m_packed[0]);
+    publish(disparity, m_packed.size() + 1024);
+}
+
+//
+// Counts the images received intact, and otherwise
+
+class Received {
+public:
+
+    Received(uint32_t w, uint32_t h) :
+        lock(), width(w), height(h), luma(0), disparity(0), bad(0) {};
+
+    uint32_t complete() {
+        utility::ScopedLock l(lock);
+        return std::min(luma, disparity);
+    };
+
+    utility::Mutex lock;
+    const uint32_t width;
+    const uint32_t height;
+    uint32_t       luma;
+    uint32_t       disparity;
+    uint32_t       bad;
+};
+
+void imageCallback(const image::Header& header,
+                   void                *userDataP)
+{
+    Received *rP = reinterpret_cast<Received*>(userDataP);
+
+    const uint32_t pixels = rP->width * rP->height;
+    bool           intact = (header.width == rP->width && header.height == rP->height);
+
+    if (Source_Luma_Left == header.source) {
+
+        const uint8_t *lumaP = reinterpret_cast<const uint8_t*>(header.imageDataP);
+
+        for(uint32_t i=0; intact && i<pixels; i++)
+            intact = (lumaPixel(i, header.frameId) == lumaP[i]);
+
+    } else {
+
+        const uint16_t *disparityP = reinterpret_cast<const uint16_t*>(header.imageDataP);
+
+        intact = intact && (16 == header.bitsPerPixel);
+
+        for(uint32_t i=0; intact && i<pixels; i++)
+            intact = (disparityPixel(i, header.frameId) == disparityP[i]);
+    }
+
+    utility::ScopedLock lock(rP->lock);
+
+    if (false == intact)
+        rP->bad ++;
+    else if (Source_Luma_Left == header.source)
+        rP->luma ++;
+    else
+        rP->disparity ++;
+}
+
+//
+// Wait for [frames] frames to have been delivered, or for the timeout
+
+void waitFor(Received& received,
+             uint32_t  frames)
+{
+    const double start = utility::TimeStamp::getMonotonicTime();
+
+    while(received.complete() < frames &&
+          utility::TimeStamp::getMonotonicTime() - start < DELIVERY_TIMEOUT)
+        usleep(1000);
+}
+
+//
+// Every frame arrives intact, however its datagrams are ordered
+
+void testStream(Order    order,
+                uint32_t width,
+                uint32_t height,
+                uint32_t mtu,
+                uint32_t frames,
+                uint32_t period)
+{
+    FakeSensor sensor(width, height, mtu);
+
+    CHECK(sensor.bound());
+    if (false == sensor.bound())
+        return;
+
+    Channel *channelP = Channel::Create("127.0.0.1");
+
+    CHECK(NULL != channelP);
+    if (NULL == channelP)
+        return;
+
+    Received received(width, height);
+
+    CHECK(Status_Ok == channelP->addIsolatedCallback(imageCallback, SOURCES, &received));
+    CHECK(Status_Ok == channelP->startStreams(SOURCES));
+
+    sensor.setOrder(order);
+
+    for(uint32_t f=0; f<frames; f++) {
+        sensor.sendFrame(f);
+        usleep(1000 * period);
+    }
+
+    waitFor(received, frames);
+
+    system::ChannelStatistics statistics;
+    CHECK(Status_Ok == channelP->getChannelStatistics(statistics));
+
+    printf("%-10s: %u/%u luma, %u/%u disparity, %u bad, %llu held back, %llu repeated\n",
+           orderName(order),
+           received.luma, frames, received.disparity, frames, received.bad,
+           static_cast<unsigned long long>(statistics.rxDeferredDatagrams),
+           static_cast<unsigned long long>(statistics.rxDuplicateDatagrams));
+
+    CHECK(frames == received.luma);
+    CHECK(frames == received.disparity);
+    CHECK(0      == received.bad);
+
+    if (Order_FirstLate == order)
+        CHECK(statistics.rxDeferredDatagrams > 0);
+    if (Order_Duplicated == order)
+        CHECK(statistics.rxDuplicateDatagrams > 0);
+
+    channelP->removeIsolatedCallback(imageCallback);
+    Channel::Destroy(channelP);
+}
+
+//
+// Counts the completions of asynchronous commands
+
+class Completions {
+public:
+
+    Completions() : lock(), ok(0), failed(0), width(0) {};
+
+    uint32_t count() {
+        utility::ScopedLock l(lock);
+        return ok + failed;
+    };
+
+    utility::Mutex lock;
+    uint32_t       ok;
+    uint32_t       failed;
+    uint32_t       width;
+};
+
+void completionCallback(Status status,
+                        void  *userDataP)
+{
+    Completions *cP = reinterpret_cast<Completions*>(userDataP);
+
+    utility::ScopedLock lock(cP->lock);
+
+    if (Status_Ok == status)
+        cP->ok ++;
+    else
+        cP->failed ++;
+}
+
+void configCallback(Status               status,
+                    const image::Config& config,
+                    void                *userDataP)
+{
+    Completions *cP = reinterpret_cast<Completions*>(userDataP);
+
+    {
+        utility::ScopedLock lock(cP->lock);
+        if (Status_Ok == status)
+            cP->width = config.width();
+    }
+
+    completionCallback(status, userDataP);
+}
+
+//
+// Queued commands each complete once: with the sensor's answer, or
+// with an error if the channel is destroyed first
+
+void testAsync(uint32_t width,
+               uint32_t height,
+               uint32_t mtu)
+{
+    const uint32_t COMMANDS = 8;
+
+    FakeSensor sensor(width, height, mtu);
+
+    CHECK(sensor.bound());
+    if (false == sensor.bound())
+        return;
+
+    Channel *channelP = Channel::Create("127.0.0.1");
+
+    CHECK(NULL != channelP);
+    if (NULL == channelP)
+        return;
+
+    image::Config config;
+    CHECK(Status_Ok == channelP->getImageConfig(config));
+
+    Completions answered;
+
+    for(uint32_t i=0; i<COMMANDS; i++) {
+        CHECK(Status_Ok == channelP->getImageConfigAsync(configCallback, &answered));
+        CHECK(Status_Ok == channelP->setImageConfigAsync(config, completionCallback, &answered));
+    }
+
+    const double start = utility::TimeStamp::getMonotonicTime();
+
+    while(answered.count() < 2 * COMMANDS &&
+          utility::TimeStamp::getMonotonicTime() - start < DELIVERY_TIMEOUT)
+        usleep(1000);
+
+    CHECK(2 * COMMANDS == answered.ok);
+    CHECK(0            == answered.failed);
+    CHECK(width        == answered.width);
+
+    //
+    // Destroyed with commands still queued
+
+    Completions discarded;
+
+    for(uint32_t i=0; i<COMMANDS; i++)
+        CHECK(Status_Ok == channelP->setImageConfigAsync(config, completionCallback, &discarded));
+
+    Channel::Destroy(channelP);
+
+    printf("async     : %u/%u answered, %u/%u completed at destruction (%u failed)\n",
+           answered.ok, 2 * COMMANDS, discarded.count(), COMMANDS, discarded.failed);
+
+    CHECK(COMMANDS == discarded.count());
+}
+
+//
+// Queries made by each of several threads at once
+
+const uint32_t QUERY_THREADS = 4;
+const uint32_t QUERIES       = 25;
+
+class Querier {
+public:
+
+    Querier() : channelP(NULL), width(0), ok(0), wrong(0), failed(0) {};
+
+    Channel *channelP;
+    uint32_t width;
+    uint32_t ok;
+    uint32_t wrong;
+    uint32_t failed;
+};
+
+void *querierThread(void *argumentP)
+{
+    Querier *qP = reinterpret_cast<Querier*>(argumentP);
+
+    for(uint32_t i=0; i<QUERIES; i++) {
+
+        image::Config       config;
+        system::VersionInfo version;
+
+        if (Status_Ok != qP->channelP->getImageConfig(config))
+            qP->failed ++;
+        else if (qP->width != config.width())
+            qP->wrong ++;
+        else
+            qP->ok ++;
+
+        if (Status_Ok != qP->channelP->getVersionInfo(version))
+            qP->failed ++;
+        else if (0x0300 != version.sensorFirmwareVersion)
+            qP->wrong ++;
+        else
+            qP->ok ++;
+    }
+
+    return NULL;
+}
+
+//
+// Threads querying at once each get an answer of the right kind
+
+void testConcurrent(uint32_t width,
+                    uint32_t height,
+                    uint32_t mtu)
+{
+    FakeSensor sensor(width, height, mtu);
+
+    CHECK(sensor.bound());
+    if (false == sensor.bound())
+        return;
+
+    Channel *channelP = Channel::Create("127.0.0.1");
+
+    CHECK(NULL != channelP);
+    if (NULL == channelP)
+        return;
+
+    Querier          queriers[QUERY_THREADS];
+    utility::Thread *threadsP[QUERY_THREADS];
+
+    for(uint32_t i=0; i<QUERY_THREADS; i++) {
+        queriers[i].channelP = channelP;
+        queriers[i].width    = width;
+        threadsP[i]          = new utility::Thread(querierThread, &(queriers[i]));
+    }
+
+    uint32_t ok=0, wrong=0, failed=0;
+
+    for(uint32_t i=0; i<QUERY_THREADS; i++) {
+        delete threadsP[i];
+        ok     += queriers[i].ok;
+        wrong  += queriers[i].wrong;
+        failed += queriers[i].failed;
+    }
+
+    printf("concurrent: %u/%u answered, %u wrong, %u failed\n",
+           ok, 2 * QUERY_THREADS * QUERIES, wrong, failed);
+
+    CHECK(2 * QUERY_THREADS * QUERIES == ok);
+
+    Channel::Destroy(channelP);
+}
+
+//
+// Stream through one backend, reporting what receiving cost. The CPU
+// time of sending is measured on its own and left out.
+
+void benchmark(RxBackend   backend,
+               const char *nameP,
+               uint32_t    width,
+               uint32_t    height,
+               uint32_t    mtu,
+               uint32_t    frames,
+               uint32_t    period)
+{
+    FakeSensor sensor(width, height, mtu);
+
+    if (false == sensor.bound())
+        return;
+
+    Channel *channelP = Channel::Create("127.0.0.1", backend);
+
+    if (NULL == channelP) {
+        printf("%-7s: unavailable (the packet ring needs CAP_NET_RAW)\n", nameP);
+        return;
+    }
+
+    Received received(width, height);
+
+    channelP->addIsolatedCallback(imageCallback, SOURCES, &received);
+    channelP->startStreams(SOURCES);
+
+    system::ChannelStatistics before;
+    channelP->getChannelStatistics(before);
+
+    const double start   = processCpuTime();
+    double       sending = 0.0;
+
+    for(uint32_t f=0; f<frames; f++) {
+        const double t = threadCpuTime();
+        sensor.sendFrame(f);
+        sending += threadCpuTime() - t;
+        usleep(1000 * period);
+    }
+
+    waitFor(received, frames);
+
+    const double receiving = processCpuTime() - start - sending;
+
+    system::ChannelStatistics after;
+    channelP->getChannelStatistics(after);
+
+    const double calls     = after.rxSystemCalls - before.rxSystemCalls;
+    const double datagrams = after.rxDatagrams   - before.rxDatagrams;
+
+    printf("%-7s: %u/%u frames, per frame %6.2f ms CPU, %6.1f datagrams, "
+           "%6.1f system calls; %llu ring drops\n",
+           nameP, received.complete(), frames,
+           1e3 * receiving / frames,
+           datagrams / frames,
+           calls / frames,
+           static_cast<unsigned long long>(after.rxRingDrops - before.rxRingDrops));
+
+    channelP->removeIsolatedCallback(imageCallback);
+    Channel::Destroy(channelP);
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    bool     bench  = false;
+    uint32_t frames = 0;
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    uint32_t mtu    = 7200;
+    uint32_t period = 0;
+
+    //
+    // Parse args
+
+    int c;
+
+    while(-1 != (c = getopt(argc, argvPP, "bn:W:H:m:p:")))
+        switch(c) {
+        case 'b': bench  = true;                 break;
+        case 'n': frames = atoi(optarg);         break;
+        case 'W': width  = atoi(optarg);         break;
+        case 'H': height = atoi(optarg);         break;
+        case 'm': mtu    = atoi(optarg);         break;
+        case 'p': period = atoi(optarg);         break;
+        default: usage(*argvPP);                 break;
+        }
+
+    if (0 == frames) frames = bench ? 100  : 20;
+    if (0 == width)  width  = bench ? 2048 : 512;
+    if (0 == height) height = bench ? 1088 : 272;
+    if (0 == period) period = bench ? 33   : 20;
+
+    if (width % 2 || mtu <= DATAGRAM_OVERHEAD + wire::Disparity::META_LENGTH)
+        usage(*argvPP);
+
+    if (bench) {
+        benchmark(RxBackend_Socket,     "socket", width, height, mtu, frames, period);
+        benchmark(RxBackend_PacketRing, "ring",   width, height, mtu, frames, period);
+        return 0;
+    }
+
+    const Order orders[] = { Order_InOrder, Order_Reversed,
+                             Order_FirstLate, Order_Duplicated };
+
+    for(uint32_t i=0; i<sizeof(orders) / sizeof(orders[0]); i++)
+        testStream(orders[i], width, height, mtu, frames, period);
+
+    testAsync(width, height, mtu);
+    testConcurrent(width, height, mtu);
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
@@ -0,0 +1,404 @@
+/**
+ * @file QueueTestUtility/QueueTestUtility.cc
+ *
+ * Checks BoundedQueue and BoundedWaitQueue, including a capacity of
+ * one and each overflow policy. With -b, times them against WaitQueue.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <vector>
+
+#include <LibMultiSense/details/utility/BoundedQueue.hh>
+#include <LibMultiSense/details/utility/Thread.hh>
+#include <LibMultiSense/details/utility/TimeStamp.hh>
+
+using namespace crl::multisense::details::utility;
+
+namespace {  // anonymous
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+void usage(const char *programNameP)
+{
+    fprintf(stderr, "USAGE: %s [<options>]\n", programNameP);
+    fprintf(stderr, "Where <options> are:\n");
+    fprintf(stderr, "\t-b                 : benchmark instead of testing\n");
+    fprintf(stderr, "\t-n <messages>      : messages per benchmark run (default=200000)\n");
+
+    exit(-1);
+}
+
+double now()
+{
+    return TimeStamp::getMonotonicTime();
+}
+
+//
+// Counts live instances, to check entries are destroyed exactly once
+
+struct Counted {
+    static int32_t live;
+
+    Counted()                  : value(0)       { live ++; };
+    Counted(int32_t v)         : value(v)       { live ++; };
+    Counted(const Counted& c)  : value(c.value) { live ++; };
+    ~Counted()                                  { live --; };
+
+    int32_t value;
+};
+
+int32_t Counted::live = 0;
+
+void testCapacityOne()
+{
+    BoundedQueue<int32_t> queue(1);
+    int32_t               value = 0;
+
+    CHECK(1 == queue.capacity());
+    CHECK(queue.push(1));
+    CHECK(false == queue.push(2));
+    CHECK(1 == queue.size());
+    CHECK(queue.pop(value) && 1 == value);
+    CHECK(false == queue.pop(value));
+
+    //
+    // Around the two slots several times
+
+    for(int32_t i=0; i<5; i++) {
+        CHECK(queue.push(i));
+        CHECK(false == queue.push(-1));
+        CHECK(queue.pop(value) && i == value);
+    }
+
+    BoundedQueue<int32_t> zero(0);
+
+    CHECK(1 == zero.capacity());
+    CHECK(zero.push(1));
+    CHECK(false == zero.push(2));
+}
+
+void testOrder()
+{
+    BoundedQueue<int32_t> queue(4);
+    int32_t               next  = 0;
+    int32_t               value = 0;
+
+    for(int32_t i=0; i<4; i++)
+        CHECK(queue.push(i));
+    CHECK(false == queue.push(4));
+    CHECK(4 == queue.size());
+
+    //
+    // Interleaved, wrapping many times
+
+    for(int32_t i=4; i<100; i++) {
+        CHECK(queue.pop(value) && next ++ == value);
+        CHECK(queue.push(i));
+    }
+
+    while(queue.pop(value))
+        CHECK(next ++ == value);
+
+    CHECK(100 == next);
+    CHECK(0 == queue.size());
+}
+
+void testDestruction()
+{
+    {
+        BoundedQueue<Counted> queue(3);
+        Counted               value;
+
+        CHECK(queue.push(1));
+        CHECK(queue.push(2));
+        CHECK(queue.push(3));
+        CHECK(4 == Counted::live);
+
+        CHECK(queue.drop());
+        CHECK(queue.pop(value) && 2 == value.value);
+        CHECK(2 == Counted::live);
+
+        CHECK(queue.push(4));
+    }
+
+    CHECK(0 == Counted::live);
+}
+
+void testDropOldest()
+{
+    BoundedWaitQueue<int32_t> queue(2, Overflow_DropOldest);
+    int32_t                   value = 0;
+
+    CHECK(queue.post(1));
+    CHECK(queue.post(2));
+    CHECK(queue.post(3));
+    CHECK(1 == queue.drops());
+    CHECK(queue.wait(value) && 2 == value);
+    CHECK(queue.wait(value) && 3 == value);
+    CHECK(false == queue.tryWait(value));
+}
+
+void testDropNewest()
+{
+    BoundedWaitQueue<int32_t> queue(2, Overflow_DropNewest);
+    int32_t                   value = 0;
+
+    CHECK(queue.post(1));
+    CHECK(queue.post(2));
+    CHECK(false == queue.post(3));
+    CHECK(1 == queue.drops());
+    CHECK(queue.wait(value) && 1 == value);
+    CHECK(queue.wait(value) && 2 == value);
+}
+
+//
+// Pops one entry after a delay
+
+struct Delayed {
+    BoundedWaitQueue<int32_t> *queueP;
+    useconds_t                 delay;
+    int32_t                    value;
+};
+
+void *delayedPop(void *argumentP)
+{
+    Delayed *dP = reinterpret_cast<Delayed*>(argumentP);
+
+    usleep(dP->delay);
+    dP->queueP->wait(dP->value);
+
+    return NULL;
+}
+
+void testBlock()
+{
+    BoundedWaitQueue<int32_t> queue(1, Overflow_Block, 0.05);
+
+    CHECK(queue.post(1));
+
+    //
+    // No consumer: gives up after the timeout
+
+    const double start = now();
+
+    CHECK(false == queue.post(2));
+    CHECK(now() - start >= 0.04);
+    CHECK(1 == queue.drops());
+
+    //
+    // Room is made while blocked
+
+    BoundedWaitQueue<int32_t> slow(1, Overflow_Block, 5.0);
+    Delayed                   d = { &slow, 20000, 0 };
+
+    CHECK(slow.post(1));
+
+    {
+        Thread consumer(delayedPop, &d);
+        CHECK(slow.post(2));
+    }
+
+    int32_t value = 0;
+
+    CHECK(1 == d.value);
+    CHECK(0 == slow.drops());
+    CHECK(slow.wait(value) && 2 == value);
+}
+
+void testKick()
+{
+    BoundedWaitQueue<int32_t> queue(4);
+    int32_t                   value = 0;
+
+    queue.kick();
+    CHECK(false == queue.wait(value));
+
+    CHECK(queue.post(7));
+    CHECK(queue.wait(value) && 7 == value);
+}
+
+//
+// Producers each post their own ascending sequence
+
+struct Producer {
+    BoundedWaitQueue<int32_t> *boundedP;
+    WaitQueue<int32_t>        *unboundedP;
+    int32_t                    id;
+    int32_t                    count;
+};
+
+const int32_t PRODUCER_SHIFT = 24;
+
+void *produce(void *argumentP)
+{
+    const Producer *pP = reinterpret_cast<Producer*>(argumentP);
+
+    for(int32_t i=0; i<pP->count; i++) {
+        const int32_t value = (pP->id << PRODUCER_SHIFT) | i;
+
+        if (pP->boundedP)
+            pP->boundedP->post(value);
+        else
+            pP->unboundedP->post(value);
+    }
+
+    return NULL;
+}
+
+//
+// Runs [producers] producers against one consumer (this thread),
+// returning the seconds taken. Checks that every entry arrives once,
+// in order per producer.
+
+template<class QUEUE>
+double run(QUEUE&   queue,
+           Producer prototype,
+           int32_t  producers,
+           int32_t  messages)
+{
+    const int32_t perProducer = messages / producers;
+
+    std::vector<Producer> context(producers, prototype);
+    std::vector<Thread*>  threads(producers);
+    std::vector<int32_t>  next(producers, 0);
+
+    const double start = now();
+
+    for(int32_t i=0; i<producers; i++) {
+        context[i].id    = i;
+        context[i].count = perProducer;
+        threads[i]       = new Thread(produce, &context[i]);
+    }
+
+    for(int32_t i=0; i<perProducer * producers; i++) {
+        int32_t value = 0;
+
+        if (false == queue.wait(value)) {
+            CHECK(false);
+            break;
+        }
+
+        const int32_t id = value >> PRODUCER_SHIFT;
+
+        CHECK(id >= 0 && id < producers);
+        CHECK((value & ((1 << PRODUCER_SHIFT) - 1)) == next[id]);
+        next[id] ++;
+    }
+
+    const double elapsed = now() - start;
+
+    for(int32_t i=0; i<producers; i++)
+        delete threads[i];
+
+    return elapsed;
+}
+
+void testProducers()
+{
+    const int32_t counts[] = { 1, 4, 16 };
+
+    for(uint32_t i=0; i<sizeof(counts) / sizeof(counts[0]); i++) {
+        BoundedWaitQueue<int32_t> queue(8, Overflow_Block, 60.0);
+        Producer                  prototype = { &queue, NULL, 0, 0 };
+
+        run(queue, prototype, counts[i], 20000);
+        CHECK(0 == queue.drops());
+    }
+}
+
+//
+// Each queue is either deep enough never to fill, timing post/wait
+// alone, or 64 deep and blocking, timing the hand-off when
+// producers outrun the consumer
+
+void benchmark(int32_t messages)
+{
+    const int32_t counts[] = { 1, 4, 16 };
+
+    printf("%-10s %14s %14s %14s\n", "producers", "Bounded", "WaitQueue", "Bounded(64)");
+
+    for(uint32_t i=0; i<sizeof(counts) / sizeof(counts[0]); i++) {
+
+        BoundedWaitQueue<int32_t> bounded(messages);
+        WaitQueue<int32_t>        unbounded;
+        BoundedWaitQueue<int32_t> blocking(64, Overflow_Block, 60.0);
+        Producer                  boundedPrototype   = { &bounded,  NULL,       0, 0 };
+        Producer                  unboundedPrototype = { NULL,      &unbounded, 0, 0 };
+        Producer                  blockingPrototype  = { &blocking, NULL,       0, 0 };
+
+        const double b = run(bounded,   boundedPrototype,   counts[i], messages);
+        const double u = run(unbounded, unboundedPrototype, counts[i], messages);
+        const double k = run(blocking,  blockingPrototype,  counts[i], messages);
+
+        printf("%-10d %11.1f ns %11.1f ns %11.1f ns\n", counts[i],
+               1e9 * b / messages, 1e9 * u / messages, 1e9 * k / messages);
+    }
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    bool    bench    = false;
+    int32_t messages = 200000;
+
+    //
+    // Parse args
+
+    int c;
+
+    while(-1 != (c = getopt(argc, argvPP, "bn:")))
+        switch(c) {
+        case 'b': bench    = true;         break;
+        case 'n': messages = atoi(optarg); break;
+        default: usage(*argvPP);           break;
+        }
+
+    if (bench)
+        benchmark(messages);
+    else {
+        testCapacityOne();
+        testOrder();
+        testDestruction();
+        testDropOldest();
+        testDropNewest();
+        testBlock();
+        testKick();
+        testProducers();
+    }
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+/**
+ * @file StorageTestUtility/StorageTestUtility.cc
+ *
+ * Checks RingCache, the cache of UDP trackers and image metadata.
+ * With -b, times it against DepthCache, which it replaced.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <vector>
+
+#include <LibMultiSense/details/storage.hh>
+#include <LibMultiSense/details/utility/TimeStamp.hh>
+
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+void usage(const char *programNameP)
+{
+    fprintf(stderr, "USAGE: %s [<options>]\n", programNameP);
+    fprintf(stderr, "Where <options> are:\n");
+    fprintf(stderr, "\t-b                 : benchmark instead of testing\n");
+    fprintf(stderr, "\t-n <messages>      : messages per benchmark run (default=1000000)\n");
+
+    exit(-1);
+}
+
+//
+// Stands in for a UDP tracker: a bitmap sized by the message, kept
+// across evictions by its own resetEntry()
+
+struct Tracked {
+    Tracked() : value(0), resets(0), bitmap() {};
+
+    void fill(int64_t v) {
+        value = v;
+        bitmap.resize(64, 0);
+    };
+
+    friend void resetEntry(Tracked& t) {
+        t.value = 0;
+        t.resets ++;
+        t.bitmap.clear();
+    };
+
+    int64_t               value;
+    uint32_t              resets;
+    std::vector<uint32_t> bitmap;
+};
+
+void testInsertFind()
+{
+    RingCache<int64_t, int64_t> cache(4);
+
+    CHECK(NULL == cache.find(0));
+
+    for(int64_t k=10; k<14; k++) {
+        int64_t *dataP = cache.insert(k);
+        CHECK(NULL != dataP && 0 == *dataP);
+        *dataP = k * 100;
+    }
+
+    for(int64_t k=10; k<14; k++)
+        CHECK(NULL != cache.find(k) && k * 100 == *cache.find(k));
+
+    //
+    // Inserting a held key returns its entry unchanged
+
+    CHECK(1100 == *cache.insert(11));
+
+    cache.remove(11);
+    CHECK(NULL == cache.find(11));
+    CHECK(NULL != cache.find(12));
+
+    //
+    // A key may be inserted again after removal, reset
+
+    CHECK(0 == *cache.insert(11));
+}
+
+void testWindow()
+{
+    RingCache<int64_t, int64_t> cache(4);
+    int64_t                     newest = -1;
+
+    CHECK(4 == cache.capacity());
+    CHECK(false == cache.newest_nolock(newest));
+
+    for(int64_t k=0; k<4; k++)
+        *cache.insert(k) = k + 1;
+
+    CHECK(cache.newest_nolock(newest) && 3 == newest);
+
+    //
+    // Advancing by one evicts the oldest
+
+    *cache.insert(4) = 5;
+
+    CHECK(NULL == cache.find(0));
+    CHECK(NULL != cache.find(1));
+    CHECK(NULL != cache.find(4));
+
+    //
+    // Keys that fell out of the window are refused
+
+    CHECK(NULL == cache.insert(0));
+    CHECK(NULL != cache.insert(2));
+
+    //
+    // A gap in the keys evicts everything it passes over, including
+    // slots that a key far ahead would alias
+
+    *cache.insert(6) = 7;
+
+    CHECK(NULL == cache.find(1));
+    CHECK(NULL == cache.find(2));
+    CHECK(NULL != cache.find(3));
+    CHECK(NULL != cache.find(4));
+    CHECK(NULL == cache.find(5));
+
+    *cache.insert(1000) = 1;
+
+    for(int64_t k=0; k<8; k++)
+        CHECK(NULL == cache.find(k));
+    CHECK(NULL != cache.find(1000));
+    CHECK(NULL == cache.insert(996));
+    CHECK(NULL != cache.insert(997));
+
+    CHECK(cache.newest_nolock(newest) && 1000 == newest);
+
+    cache.clear();
+
+    CHECK(NULL == cache.find(1000));
+    CHECK(false == cache.newest_nolock(newest));
+
+    //
+    // After clear() any key is accepted, as from a restarted sensor
+
+    CHECK(NULL != cache.insert(0));
+}
+
+void testReset()
+{
+    RingCache<int64_t, Tracked> cache(2);
+
+    Tracked *tP = cache.insert(0);
+    tP->fill(0);
+
+    const uint32_t *storageP = &(tP->bitmap[0]);
+
+    cache.remove(0);
+
+    //
+    // The slot's storage outlives the entry
+
+    tP = cache.insert(2);
+
+    CHECK(1 == tP->resets);
+    CHECK(0 == tP->value);
+    CHECK(tP->bitmap.empty() && tP->bitmap.capacity() >= 64);
+
+    tP->fill(2);
+    CHECK(storageP == &(tP->bitmap[0]));
+
+    //
+    // Eviction by the window uses the same reset
+
+    cache.insert(4);
+    CHECK(2 == cache.find(4)->resets);
+
+    //
+    // Plain data is reset to its default
+
+    RingCache<int64_t, int64_t> plain(2);
+
+    *plain.insert(0) = 5;
+    plain.insert(2);
+    CHECK(0 == *plain.insert(2));
+}
+
+//
+// Trackers come and go in sequence order, a few in flight at once,
+// each looked up once per datagram
+
+const int64_t IN_FLIGHT = 4;
+const int64_t LOOKUPS   = 8;
+
+double benchmarkRing(int64_t messages)
+{
+    RingCache<int64_t, Tracked> cache(64);
+
+    const double start = utility::TimeStamp::getMonotonicTime();
+
+    for(int64_t k=0; k<messages; k++) {
+
+        utility::ScopedLock lock(cache.mutex());
+
+        cache.insert_nolock(k)->fill(k);
+
+        for(int64_t i=0; i<LOOKUPS; i++)
+            if (NULL == cache.find_nolock(k - (i % IN_FLIGHT)) && k >= IN_FLIGHT)
+                failures ++;
+
+        cache.remove_nolock(k - IN_FLIGHT + 1);
+    }
+
+    return utility::TimeStamp::getMonotonicTime() - start;
+}
+
+double benchmarkDepth(int64_t messages)
+{
+    DepthCache<int64_t, Tracked> cache(64, 0);
+
+    const double start = utility::TimeStamp::getMonotonicTime();
+
+    for(int64_t k=0; k<messages; k++) {
+
+        utility::ScopedLock lock(cache.mutex());
+
+        Tracked *tP = new Tracked();
+        tP->fill(k);
+        cache.insert_nolock(k, tP);
+
+        for(int64_t i=0; i<LOOKUPS; i++)
+            if (NULL == cache.find_nolock(k - (i % IN_FLIGHT)) && k >= IN_FLIGHT)
+                failures ++;
+
+        cache.remove_nolock(k - IN_FLIGHT + 1);
+    }
+
+    return utility::TimeStamp::getMonotonicTime() - start;
+}
+
+void benchmark(int64_t messages)
+{
+    const double ring  = benchmarkRing(messages);
+    const double depth = benchmarkDepth(messages);
+
+    printf("%lld messages, %lld in flight, %lld lookups each\n",
+           static_cast<long long>(messages),
+           static_cast<long long>(IN_FLIGHT),
+           static_cast<long long>(LOOKUPS));
+    printf("RingCache  : %8.1f ns per message\n", 1e9 * ring  / messages);
+    printf("DepthCache : %8.1f ns per message\n", 1e9 * depth / messages);
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    bool    bench    = false;
+    int64_t messages = 1000000;
+
+    //
+    // Parse args
+
+    int c;
+
+    while(-1 != (c = getopt(argc, argvPP, "bn:")))
+        switch(c) {
+        case 'b': bench    = true;          break;
+        case 'n': messages = atoll(optarg); break;
+        default: usage(*argvPP);            break;
+        }
+
+    if (bench)
+        benchmark(messages);
+    else {
+        testInsertFind();
+        testWindow();
+        testReset();
+    }
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
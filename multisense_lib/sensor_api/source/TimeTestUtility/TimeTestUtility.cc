@@ -0,0 +1,278 @@
+/**
+ * @file TimeTestUtility/TimeTestUtility.cc
+ *
+ * Checks ClockModel, the fit of the sensor clock's offset and skew
+ * from the local clock, and SeqLock, which publishes the fit.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <math.h>
+
+#include <LibMultiSense/details/utility/ClockModel.hh>
+#include <LibMultiSense/details/utility/SeqLock.hh>
+#include <LibMultiSense/details/utility/Thread.hh>
+#include <LibMultiSense/details/utility/TimeStamp.hh>
+
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+const double TOLERANCE = 1e-9; // seconds, or seconds per second
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+bool near(double a,
+          double b)
+{
+    return fabs(a - b) <= TOLERANCE;
+}
+
+//
+// A fixed offset, probed exactly
+
+void testOffset()
+{
+    utility::ClockModel model(16);
+
+    CHECK(false == model.valid());
+
+    for(uint32_t i=0; i<16; i++)
+        model.add(100.0 + 0.1 * i, 105.0 + 0.1 * i, 0.001);
+
+    CHECK(model.valid());
+    CHECK(near(5.0, model.offset()));
+    CHECK(0.0 == model.skew());
+    CHECK(near(0.0, model.residual()));
+    CHECK(near(205.0, model.toLocal(200.0)));
+}
+
+//
+// A drifting clock, probed over long enough to measure the drift
+
+void testSkew()
+{
+    const double SKEW = 100e-6;
+
+    utility::ClockModel model(100);
+
+    for(uint32_t i=0; i<100; i++) {
+        const double remote = 0.1 * i;
+        model.add(remote, remote + 2.0 + SKEW * remote, 0.001);
+    }
+
+    CHECK(near(SKEW, model.skew()));
+    CHECK(near(0.0,  model.residual()));
+    CHECK(near(2.0 + (1.0 + SKEW) * 50.0, model.toLocal(50.0)));
+
+    //
+    // Too short a span to measure it, so none is fit
+
+    utility::ClockModel shortModel(100);
+
+    for(uint32_t i=0; i<10; i++) {
+        const double remote = 0.1 * i;
+        shortModel.add(remote, remote + 2.0 + SKEW * remote, 0.001);
+    }
+
+    CHECK(0.0 == shortModel.skew());
+
+    //
+    // Nor is a skew no crystal would have
+
+    utility::ClockModel wildModel(100);
+
+    for(uint32_t i=0; i<100; i++) {
+        const double remote = 0.1 * i;
+        wildModel.add(remote, remote + 2.0 + 0.01 * remote, 0.001);
+    }
+
+    CHECK(0.0 == wildModel.skew());
+}
+
+//
+// Probes delayed on one leg are left out of the fit
+
+void testRoundTrip()
+{
+    utility::ClockModel model(40);
+
+    for(uint32_t i=0; i<40; i++) {
+        const double remote = 0.01 * i;
+
+        if (0 == i % 4)
+            model.add(remote, remote + 3.0, 0.001);
+        else
+            model.add(remote, remote + 3.0 + 0.010, 0.020);
+    }
+
+    CHECK(10 == model.fitted());
+    CHECK(near(3.0, model.offset()));
+    CHECK(near(0.0, model.residual()));
+}
+
+//
+// The residual is the RMS distance of the fitted probes from the fit
+
+void testResidual()
+{
+    utility::ClockModel model(20);
+
+    for(uint32_t i=0; i<20; i++) {
+        const double remote = 0.05 * i;
+        model.add(remote, remote + 1.0 + (i % 2 ? 0.001 : -0.001), 0.001);
+    }
+
+    CHECK(20 == model.fitted());
+    CHECK(near(1.0,   model.offset()));
+    CHECK(near(0.001, model.residual()));
+}
+
+//
+// A remote clock going backwards has restarted
+
+void testRestart()
+{
+    utility::ClockModel model(16);
+
+    for(uint32_t i=0; i<16; i++)
+        model.add(100.0 + i, 105.0 + i, 0.001);
+
+    model.add(1.0, 8.0, 0.001);
+
+    CHECK(1 == model.fitted());
+    CHECK(near(7.0, model.offset()));
+
+    model.reset();
+
+    CHECK(false == model.valid());
+    CHECK(0.0 == model.offset());
+}
+
+//
+// Stored whole, so a reader never sees parts of two stores
+
+class Triple {
+public:
+    Triple(uint64_t v=0) : a(v), b(v), c(v) {};
+
+    bool whole() const { return a == b && b == c; };
+
+    uint64_t a;
+    uint64_t b;
+    uint64_t c;
+};
+
+//
+// Loads the reader makes while the writer stores, unless it runs out
+// of time
+
+const uint64_t LOADS      = 10000000;
+const double   RACE_LIMIT = 5.0; // seconds
+
+class Shared {
+public:
+    Shared() : lock(), done(false), loads(0), torn(0), backwards(0) {};
+
+    utility::SeqLock<Triple> lock;
+    volatile bool            done;
+    volatile uint64_t        loads;
+    uint64_t                 torn;
+    uint64_t                 backwards;
+};
+
+void *readerThread(void *argumentP)
+{
+    Shared  *sharedP = reinterpret_cast<Shared*>(argumentP);
+    uint64_t last    = 0;
+
+    while(false == sharedP->done) {
+
+        const Triple t = sharedP->lock.load();
+
+        if (false == t.whole())
+            sharedP->torn ++;
+        if (t.a < last)
+            sharedP->backwards ++;
+
+        last = t.a;
+        sharedP->loads ++;
+    }
+
+    return NULL;
+}
+
+void testSeqLock()
+{
+    utility::SeqLock<Triple> lock(Triple(7));
+
+    CHECK(7 == lock.load().a);
+
+    lock.store(Triple(8));
+    CHECK(lock.load().whole() && 8 == lock.load().a);
+
+    //
+    // A reader racing a writer
+
+    Shared shared;
+
+    utility::Thread *readerP = new utility::Thread(readerThread, &shared);
+
+    const double start  = utility::TimeStamp::getMonotonicTime();
+    uint64_t     stores = 0;
+
+    while(shared.loads < LOADS &&
+          utility::TimeStamp::getMonotonicTime() - start < RACE_LIMIT)
+        for(uint32_t i=0; i<1024; i++)
+            shared.lock.store(Triple(++ stores));
+
+    shared.done = true;
+    delete readerP;
+
+    CHECK(shared.loads > 0);
+    CHECK(0 == shared.torn);
+    CHECK(0 == shared.backwards);
+    CHECK(stores == shared.lock.load().a);
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    testOffset();
+    testSkew();
+    testRoundTrip();
+    testResidual();
+    testRestart();
+    testSeqLock();
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
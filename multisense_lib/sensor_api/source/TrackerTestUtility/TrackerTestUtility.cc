@@ -0,0 +1,288 @@
+/**
+ * @file TrackerTestUtility/TrackerTestUtility.cc
+ *
+ * Checks how UdpTracker reassembles a message from datagrams that
+ * arrive out of order, repeated, or of mixed sizes.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <LibMultiSense/details/tracker.hh>
+
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+const uint32_t MESSAGE_BYTES = 1000;
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+//
+// A datagram of the message: [bytes] at [offset]
+
+struct Datagram {
+    Datagram(uint32_t o, uint32_t b) : offset(o), bytes(b) {};
+    uint32_t offset;
+    uint32_t bytes;
+};
+
+//
+// Copies each datagram into place, as the default assembler does
+
+void copyAssembler(utility::BufferStreamWriter& stream,
+                   const uint8_t               *dataP,
+                   uint32_t                     offset,
+                   uint32_t                     length)
+{
+    stream.seek(offset);
+    stream.write(dataP, length);
+}
+
+//
+// Feeds the datagrams to a tracker in the given order, checking that
+// only the last new one completes the message, and that the message
+// was reassembled intact
+
+class Message {
+public:
+
+    Message() :
+        m_source(MESSAGE_BYTES),
+        m_stream(MESSAGE_BYTES),
+        m_tracker(MESSAGE_BYTES),
+        m_completions(0)
+    {
+        for(uint32_t i=0; i<MESSAGE_BYTES; i++)
+            m_source[i] = static_cast<uint8_t>(i * 7 + 3);
+        memset(m_stream.data(), 0, MESSAGE_BYTES);
+    };
+
+    bool receive(const Datagram& d) {
+
+        const uint8_t *dataP    = &(m_source[d.offset]);
+        bool           complete = false;
+
+        if (0 == d.offset && false == m_tracker.started())
+            complete = m_tracker.start(copyAssembler, m_stream, d.bytes, dataP);
+        else
+            complete = m_tracker.assemble(d.bytes, d.offset, dataP);
+
+        if (complete)
+            m_completions ++;
+
+        return complete;
+    };
+
+    void receive(const std::vector<Datagram>& datagrams) {
+        for(uint32_t i=0; i<datagrams.size(); i++)
+            CHECK(receive(datagrams[i]) == (datagrams.size() - 1 == i));
+    };
+
+    bool intact() {
+        return 1 == m_completions &&
+            MESSAGE_BYTES == m_tracker.bytesAssembled() &&
+            0 == memcmp(m_stream.data(), &(m_source[0]), MESSAGE_BYTES);
+    };
+
+    UdpTracker& tracker() { return m_tracker; };
+
+private:
+
+    std::vector<uint8_t>        m_source;
+    utility::BufferStreamWriter m_stream;
+    UdpTracker                  m_tracker;
+    uint32_t                    m_completions;
+};
+
+//
+// A short first datagram (as disparity's meta header), then equal
+// ones, then a short last one
+
+std::vector<Datagram> fragments()
+{
+    std::vector<Datagram> d;
+
+    d.push_back(Datagram(0, 100));
+    for(uint32_t offset=100; offset<MESSAGE_BYTES; offset += 300)
+        d.push_back(Datagram(offset, std::min(300u, MESSAGE_BYTES - offset)));
+
+    return d;
+}
+
+void testInOrder()
+{
+    Message m;
+
+    m.receive(fragments());
+
+    CHECK(m.intact());
+    CHECK(4 == m.tracker().packets());
+}
+
+void testReordered()
+{
+    const std::vector<Datagram> d = fragments();
+
+    //
+    // Last first, and the first datagram after others, which are
+    // held back until it arrives
+
+    const uint32_t orders[][4] = { { 3, 2, 1, 0 },
+                                   { 1, 3, 0, 2 },
+                                   { 2, 0, 3, 1 } };
+
+    for(uint32_t o=0; o<sizeof(orders) / sizeof(orders[0]); o++) {
+
+        std::vector<Datagram> shuffled;
+        for(uint32_t i=0; i<d.size(); i++)
+            shuffled.push_back(d[orders[o][i]]);
+
+        Message m;
+
+        m.receive(shuffled);
+
+        CHECK(m.intact());
+        CHECK(4 == m.tracker().packets());
+    }
+}
+
+void testDuplicates()
+{
+    const std::vector<Datagram> d = fragments();
+
+    Message m;
+
+    //
+    // Held back twice before the first datagram, then repeated after
+
+    CHECK(false == m.receive(d[2]));
+    CHECK(false == m.receive(d[2]));
+    CHECK(false == m.receive(d[0]));
+    CHECK(false == m.receive(d[0]));
+    CHECK(false == m.receive(d[2]));
+    CHECK(400 == m.tracker().bytesAssembled());
+    CHECK(2 == m.tracker().packets());
+
+    CHECK(false == m.receive(d[1]));
+    CHECK(false == m.receive(d[1]));
+    CHECK(true  == m.receive(d[3]));
+
+    CHECK(m.intact());
+    CHECK(4 == m.tracker().packets());
+
+    //
+    // Repeats after completion change nothing
+
+    CHECK(false == m.receive(d[3]));
+    CHECK(m.intact());
+}
+
+void testMixedSizes()
+{
+    //
+    // No stride at all, and datagrams partly covering others
+
+    std::vector<Datagram> d;
+
+    d.push_back(Datagram(600, 150));
+    d.push_back(Datagram(0,   10));
+    d.push_back(Datagram(10,  90));
+    d.push_back(Datagram(750, 250));
+    d.push_back(Datagram(300, 300));
+    d.push_back(Datagram(250, 100)); // overlaps 300..350
+    d.push_back(Datagram(90,  170)); // overlaps 90..100 and 250..260
+
+    Message m;
+
+    m.receive(d);
+
+    CHECK(m.intact());
+    CHECK(7 == m.tracker().packets());
+
+    //
+    // Covered by what has been received, so a duplicate
+
+    Message c;
+
+    CHECK(false == c.receive(Datagram(0,   500)));
+    CHECK(false == c.receive(Datagram(100, 200)));
+    CHECK(1 == c.tracker().packets());
+    CHECK(false == c.receive(Datagram(400, 200)));
+    CHECK(true  == c.receive(Datagram(600, 400)));
+    CHECK(c.intact());
+}
+
+void testReset()
+{
+    Message m;
+
+    m.receive(fragments());
+    CHECK(m.intact());
+
+    m.tracker().reset(MESSAGE_BYTES);
+
+    CHECK(false == m.tracker().started());
+    CHECK(0 == m.tracker().bytesAssembled());
+    CHECK(0 == m.tracker().packets());
+}
+
+void testMalformed()
+{
+    Message m;
+    bool    thrown = false;
+
+    try {
+        m.receive(Datagram(900, 200));
+    } catch (...) {
+        thrown = true;
+    }
+
+    CHECK(thrown);
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    testInOrder();
+    testReordered();
+    testDuplicates();
+    testMixedSizes();
+    testReset();
+    testMalformed();
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
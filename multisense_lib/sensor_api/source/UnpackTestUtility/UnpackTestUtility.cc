@@ -0,0 +1,248 @@
+/**
+ * @file UnpackTestUtility/UnpackTestUtility.cc
+ *
+ * Checks every disparity unpacking kernel the CPU supports against
+ * the scalar reference, bit for bit. With -b, times each kernel over
+ * full frames instead.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <sys/time.h>
+
+#include <LibMultiSense/details/utility/Unpack.hh>
+
+using namespace crl::multisense::details::utility;
+
+namespace {  // anonymous
+
+//
+// Pixels written past the (pair-rounded) count are caught by these
+
+const uint32_t GUARD_PIXELS = 32;
+const uint16_t GUARD_16     = 0xdead;
+
+void usage(const char *programNameP)
+{
+    fprintf(stderr, "USAGE: %s [<options>]\n", programNameP);
+    fprintf(stderr, "Where <options> are:\n");
+    fprintf(stderr, "\t-n <max_pixels>    : largest pixel count checked (default=512)\n");
+    fprintf(stderr, "\t-s <seed>          : seed for the packed data  (default=1)\n");
+    fprintf(stderr, "\t-b                 : benchmark instead of checking\n");
+    fprintf(stderr, "\t-W <width>         : benchmark frame width    (default=2048)\n");
+    fprintf(stderr, "\t-H <height>        : benchmark frame height   (default=1088)\n");
+    fprintf(stderr, "\t-i <iterations>    : benchmark frames per kernel (default=100)\n");
+
+    exit(-1);
+}
+
+//
+// A small LCG, so runs are repeatable everywhere
+
+uint32_t nextRandom(uint32_t& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+//
+// Check one kernel at one count and alignment, returning the number
+// of mismatches
+
+template<typename T>
+uint32_t check(void          (*kernelP)(const uint8_t*, T*, uint32_t),
+               void          (*scalarP)(const uint8_t*, T*, uint32_t),
+               const uint8_t  *packedP,
+               uint32_t        count,
+               uint32_t        offset)
+{
+    const uint32_t pixels = ((count + 1) / 2) * 2;
+
+    std::vector<T> expected(offset + pixels + GUARD_PIXELS);
+    std::vector<T> actual  (offset + pixels + GUARD_PIXELS);
+
+    //
+    // Fill both with the same guard bytes
+
+    memset(&expected[0], GUARD_16 & 0xff, expected.size() * sizeof(T));
+    memset(&actual[0],   GUARD_16 & 0xff, actual.size()   * sizeof(T));
+
+    scalarP(packedP, &expected[offset], count);
+    kernelP(packedP, &actual[offset],   count);
+
+    uint32_t errors = 0;
+
+    for(uint32_t i=0; i<actual.size(); i++)
+        if (0 != memcmp(&expected[i], &actual[i], sizeof(T)))
+            errors ++;
+
+    return errors;
+}
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+//
+// Time one kernel over [iterations] frames, returning milliseconds
+// per frame. Rows are unpacked one at a time, as
+// Channel::unpackDisparity() does.
+
+template<typename T>
+double timeKernel(void          (*kernelP)(const uint8_t*, T*, uint32_t),
+                  const uint8_t  *packedP,
+                  T              *outputP,
+                  uint32_t        width,
+                  uint32_t        height,
+                  uint32_t        iterations)
+{
+    const uint32_t rowBytes = (width / 2) * 3;
+
+    kernelP(packedP, outputP, width * height); // warm up
+
+    const double start = now();
+
+    for(uint32_t i=0; i<iterations; i++)
+        for(uint32_t y=0; y<height; y++)
+            kernelP(packedP + y * rowBytes, outputP + y * width, width);
+
+    return 1e3 * (now() - start) / iterations;
+}
+
+void benchmark(uint32_t width,
+               uint32_t height,
+               uint32_t iterations,
+               uint32_t seed)
+{
+    const std::vector<UnpackKernel> kernels = unpackKernels();
+    const uint32_t                  pixels  = width * height;
+
+    std::vector<uint8_t>  packed((pixels / 2) * 3);
+    std::vector<uint16_t> output16(pixels);
+    std::vector<float>    outputFloat(pixels);
+
+    for(uint32_t i=0; i<packed.size(); i++)
+        packed[i] = nextRandom(seed) & 0xff;
+
+    printf("%ux%u, %u frames per kernel\n", width, height, iterations);
+    printf("%-8s %12s %12s\n", "kernel", "uint16 ms", "float ms");
+
+    for(uint32_t k=0; k<kernels.size(); k++) {
+
+        const UnpackKernel& kernel = kernels[k];
+
+        const double ms16    = timeKernel<uint16_t>(kernel.to16P, &packed[0], &output16[0],
+                                                    width, height, iterations);
+        const double msFloat = timeKernel<float>(kernel.toFloatP, &packed[0], &outputFloat[0],
+                                                 width, height, iterations);
+
+        printf("%-8s %12.3f %12.3f\n", kernel.nameP, ms16, msFloat);
+    }
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    uint32_t maxPixels  = 512;
+    uint32_t seed       = 1;
+    bool     bench      = false;
+    uint32_t width      = 2048;
+    uint32_t height     = 1088;
+    uint32_t iterations = 100;
+
+    //
+    // Parse args
+
+    int c;
+
+    while(-1 != (c = getopt(argc, argvPP, "n:s:bW:H:i:")))
+        switch(c) {
+        case 'n': maxPixels  = atoi(optarg); break;
+        case 's': seed       = atoi(optarg); break;
+        case 'b': bench      = true;         break;
+        case 'W': width      = atoi(optarg); break;
+        case 'H': height     = atoi(optarg); break;
+        case 'i': iterations = atoi(optarg); break;
+        default: usage(*argvPP);             break;
+        }
+
+    if (bench) {
+        if (0 == width || 0 != (width % 2) || 0 == iterations)
+            usage(*argvPP);
+        benchmark(width, height, iterations, seed);
+        return 0;
+    }
+
+    const std::vector<UnpackKernel> kernels = unpackKernels();
+
+    printf("selected kernel: %s\n", unpackKernel());
+
+    uint32_t failures = 0;
+
+    for(uint32_t k=0; k<kernels.size(); k++) {
+
+        const UnpackKernel& kernel = kernels[k];
+        uint32_t            errors = 0;
+
+        for(uint32_t count=0; count<=maxPixels; count++) {
+
+            //
+            // Exactly the packed bytes the count needs, so reads past
+            // the end are not hidden by slack, at every source
+            // alignment
+
+            for(uint32_t offset=0; offset<4; offset++) {
+
+                const uint32_t       bytes = ((count + 1) / 2) * 3;
+                std::vector<uint8_t> packed(std::max(offset + bytes, 1u));
+
+                for(uint32_t i=0; i<packed.size(); i++)
+                    packed[i] = nextRandom(seed) & 0xff;
+
+                const uint8_t *packedP = &packed[offset];
+
+                errors += check<uint16_t>(kernel.to16P,    unpack12To16Scalar,
+                                          packedP, count, offset);
+                errors += check<float>   (kernel.toFloatP, unpack12ToFloatScalar,
+                                          packedP, count, offset);
+            }
+        }
+
+        printf("%-8s: %s (%u mismatched pixels, counts 0-%u)\n",
+               kernel.nameP, 0 == errors ? "ok" : "FAILED", errors, maxPixels);
+
+        if (errors)
+            failures ++;
+    }
+
+    return 0 == failures ? 0 : 1;
+}
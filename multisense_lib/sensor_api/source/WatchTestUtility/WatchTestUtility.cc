@@ -0,0 +1,210 @@
+/**
+ * @file WatchTestUtility/WatchTestUtility.cc
+ *
+ * Checks how MessageWatch hands sensor responses to the commands
+ * waiting on them, including re-sent and abandoned commands.
+ *
+ * Copyright 2013
+ * Carnegie Robotics, LLC
+ * Ten 40th Street, Pittsburgh, PA 15201
+ * http://www.carnegierobotics.com
+ *
+ * This software is free: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <LibMultiSense/details/signal.hh>
+
+using namespace crl::multisense;
+using namespace crl::multisense::details;
+
+namespace {  // anonymous
+
+const wire::IdType ID            = 1;
+const double       STALE_TIMEOUT = 10.0; // seconds
+
+uint32_t failures = 0;
+
+#define CHECK(cond) do {                                          \
+        if (!(cond)) {                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n",          \
+                    __FILE__, __LINE__, #cond);                   \
+            failures ++;                                          \
+        }                                                         \
+    } while(0)
+
+//
+// True if the watch has been signaled, without blocking
+
+bool signaled(ScopedWatch& watch)
+{
+    Status status;
+    return watch.wait(status, 0.0);
+}
+
+//
+// Responses go to watches oldest first
+
+void testOrder()
+{
+    MessageWatch map(STALE_TIMEOUT);
+    ScopedWatch  a(ID, map);
+    ScopedWatch  b(ID, map);
+
+    a.sent();
+    b.sent();
+
+    CHECK(a.queuedBehind());
+    CHECK(false == b.queuedBehind());
+
+    map.signal(ID, Status_Failed);
+    CHECK(false == signaled(b));
+
+    Status status = Status_Ok;
+    CHECK(a.wait(status, 0.0) && Status_Failed == status);
+
+    map.signal(ID);
+    CHECK(signaled(b));
+}
+
+//
+// A watch that sent twice swallows the second response, even after
+// it has been removed
+
+void testResend()
+{
+    MessageWatch map(STALE_TIMEOUT);
+
+    {
+        ScopedWatch a(ID, map);
+
+        a.sent();
+        a.sent();
+
+        map.signal(ID);
+        CHECK(signaled(a));
+    }
+
+    ScopedWatch b(ID, map);
+    b.sent();
+
+    map.signal(ID);          // late reply to a's re-send
+    CHECK(false == signaled(b));
+
+    map.signal(ID);
+    CHECK(signaled(b));
+}
+
+//
+// Responses owed to a removed watch stay behind the older watches
+// still waiting, and ahead of newer ones
+
+void testAbandoned()
+{
+    MessageWatch map(STALE_TIMEOUT);
+    ScopedWatch  a(ID, map);
+
+    a.sent();
+
+    {
+        ScopedWatch b(ID, map);
+
+        b.sent();
+        b.sent();
+    }
+
+    ScopedWatch c(ID, map);
+    c.sent();
+
+    map.signal(ID);
+    CHECK(signaled(a));
+
+    map.signal(ID);
+    map.signal(ID);
+    CHECK(false == signaled(c));
+
+    map.signal(ID);
+    CHECK(signaled(c));
+}
+
+//
+// Owed responses that never arrive are forgotten after the timeout
+
+void testExpiry()
+{
+    MessageWatch map(0.05);
+
+    {
+        ScopedWatch a(ID, map);
+
+        a.sent();
+        a.sent();
+
+        map.signal(ID);
+        CHECK(signaled(a));
+    }
+
+    usleep(100000);
+
+    ScopedWatch b(ID, map);
+    b.sent();
+
+    map.signal(ID);
+    CHECK(signaled(b));
+}
+
+//
+// A watch that does not count its transmissions takes one response,
+// and leaves nothing owed behind
+
+void testUncounted()
+{
+    MessageWatch map(STALE_TIMEOUT);
+
+    {
+        ScopedWatch a(ID, map);
+
+        map.signal(ID);
+        map.signal(ID);
+        CHECK(signaled(a));
+    }
+
+    ScopedWatch b(ID, map);
+    ScopedWatch c(ID, map, false);
+
+    map.signal(ID);
+    CHECK(signaled(b));
+
+    c.arm();
+    map.signal(ID);
+    CHECK(signaled(c));
+}
+
+}; // anonymous
+
+int main(int    argc,
+         char **argvPP)
+{
+    testOrder();
+    testResend();
+    testAbandoned();
+    testExpiry();
+    testUncounted();
+
+    printf("%s (%u failed checks)\n", 0 == failures ? "ok" : "FAILED", failures);
+
+    return 0 == failures ? 0 : 1;
+}
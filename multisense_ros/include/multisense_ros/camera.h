@@ -48,9 +48,9 @@ public:
     void monoCallback(const crl::multisense::image::Header& header);
     void rectCallback(const crl::multisense::image::Header& header);
     void depthCallback(const crl::multisense::image::Header& header);
-    void pointCloudCallback(const crl::multisense::image::Header& header);
-    void rawCamDataCallback(const crl::multisense::image::Header& header);
-    void colorImageCallback(const crl::multisense::image::Header& header);
+    void pointCloudCallback(const crl::multisense::image::FrameSet& set);
+    void rawCamDataCallback(const crl::multisense::image::FrameSet& set);
+    void colorImageCallback(const crl::multisense::image::FrameSet& set);
     void disparityImageCallback(const crl::multisense::image::Header& header);
     void jpegImageCallback(const crl::multisense::image::Header& header);
     void histogramCallback(const crl::multisense::image::Header& header);
@@ -69,6 +69,18 @@ private:
 
     void queryConfig();
 
+    //
+    // Color conversion and rectification, shared by the color image
+    // and point cloud callbacks
+
+    void convertColor(const crl::multisense::image::Header& luma,
+                      const crl::multisense::image::Header& chroma,
+                      std::vector<uint8_t>&                 rgb);
+    bool rectifyColor(uint32_t                    width,
+                      uint32_t                    height,
+                      const std::vector<uint8_t>& rgb,
+                      std::vector<uint8_t>&       rgbRect);
+
     //
     // CRL sensor API
 
@@ -137,7 +149,6 @@ private:
     sensor_msgs::PointCloud2   luma_point_cloud_;
     sensor_msgs::PointCloud2   color_point_cloud_;
 
-    sensor_msgs::Image         left_luma_image_;
     sensor_msgs::Image         left_rgb_image_;
     sensor_msgs::Image         left_rgb_rect_image_;
 
@@ -145,13 +156,6 @@ private:
     sensor_msgs::Image         left_disparity_cost_image_;
     sensor_msgs::Image         right_disparity_image_;
 
-    bool                       got_raw_cam_left_;
-    bool                       got_left_luma_;
-    int64_t                    left_luma_frame_id_;
-    int64_t                    left_rect_frame_id_;
-    int64_t                    left_rgb_rect_frame_id_;
-    int64_t                    luma_point_cloud_frame_id_;
-    int64_t                    color_point_cloud_frame_id_;
     multisense_ros::RawCamData raw_cam_data_;
 
     //
@@ -180,7 +184,8 @@ private:
 
     std::vector<float>            disparity_buff_;
     std::vector<cv::Vec3f>        points_buff_;
-    int64_t                       points_buff_frame_id_;
+    std::vector<uint8_t>          points_rgb_buff_;
+    std::vector<uint8_t>          points_rgb_rect_buff_;
     cv::Mat_<double>              q_matrix_;
     uint32_t                      pc_border_clip_;
     float                         pc_max_range_;
@@ -68,12 +68,12 @@ void rectCB(const image::Header& header, void* userDataP)
 { reinterpret_cast<Camera*>(userDataP)->rectCallback(header); }
 void depthCB(const image::Header& header, void* userDataP)
 { reinterpret_cast<Camera*>(userDataP)->depthCallback(header); }
-void pointCB(const image::Header& header, void* userDataP)
-{ reinterpret_cast<Camera*>(userDataP)->pointCloudCallback(header); }
-void rawCB(const image::Header& header, void* userDataP)
-{ reinterpret_cast<Camera*>(userDataP)->rawCamDataCallback(header); }
-void colorCB(const image::Header& header, void* userDataP)
-{ reinterpret_cast<Camera*>(userDataP)->colorImageCallback(header); }
+void pointCB(const image::FrameSet& set, void* userDataP)
+{ reinterpret_cast<Camera*>(userDataP)->pointCloudCallback(set); }
+void rawCB(const image::FrameSet& set, void* userDataP)
+{ reinterpret_cast<Camera*>(userDataP)->rawCamDataCallback(set); }
+void colorCB(const image::FrameSet& set, void* userDataP)
+{ reinterpret_cast<Camera*>(userDataP)->colorImageCallback(set); }
 void dispCB(const image::Header& header, void* userDataP)
 { reinterpret_cast<Camera*>(userDataP)->disparityImageCallback(header); }
 void jpegCB(const image::Header& header, void* userDataP)
@@ -110,19 +110,10 @@ bool isValidPoint(const cv::Vec3f& pt,
 // Publish a point cloud, using the given storage, filtering the points,
 // and colorizing the cloud with all available color channels.
 //
-// Note that the dependencies for the point cloud will be generated in
-// different threads.  This function is called each time a dependency 
-// becomes ready.
-//
-// The published frame ID for this point cloud type is tracked and
-// publishing is serialized here via a mutex to prevent race conditions.
-
-boost::mutex point_cloud_mutex;
+// The points and the image are of the same frame, both taken from
+// one frame set by the point cloud callback.
 
-bool publishPointCloud(int64_t                       imageFrameId,
-                       int64_t                       pointsFrameId,
-                       int64_t&                      cloudFrameId,
-                       ros::Publisher&               pub,
+bool publishPointCloud(ros::Publisher&               pub,
                        sensor_msgs::PointCloud2&     cloud,
                        const uint32_t                width,
                        const uint32_t                height,
@@ -135,20 +126,15 @@ bool publishPointCloud(int64_t                       imageFrameId,
                        const uint32_t                borderClip,
                        const float                   maxRange)
 {
-    boost::mutex::scoped_lock lock(point_cloud_mutex);
-
-    if (0            == pub.getNumSubscribers()  ||
-        imageFrameId != pointsFrameId            ||
-        cloudFrameId >= imageFrameId)
+    if (0 == pub.getNumSubscribers())
         return false;
 
-    cloudFrameId = imageFrameId;
     const uint32_t imageSize = height * width;
 
     if (points.size() != imageSize)
         return false;
 
-    cloud.data.reserve(imageSize * cloudStep);
+    cloud.data.resize(imageSize * cloudStep);
     
     uint8_t       *cloudP      = reinterpret_cast<uint8_t*>(&cloud.data[0]);
     const uint32_t pointSize   = 3 * sizeof(float); // x, y, z
@@ -279,19 +265,11 @@ Camera::Camera(Channel* driver,
     depth_image_(),
     luma_point_cloud_(),
     color_point_cloud_(),
-    left_luma_image_(),
     left_rgb_image_(),
     left_rgb_rect_image_(),
     left_disparity_image_(),
     left_disparity_cost_image_(),
     right_disparity_image_(),
-    got_raw_cam_left_(false),
-    got_left_luma_(false),
-    left_luma_frame_id_(0),
-    left_rect_frame_id_(0),
-    left_rgb_rect_frame_id_(-1),
-    luma_point_cloud_frame_id_(-1),
-    color_point_cloud_frame_id_(-1),
     raw_cam_data_(),
     version_info_(),
     device_info_(),
@@ -304,7 +282,8 @@ Camera::Camera(Channel* driver,
     frame_id_right_(),
     disparity_buff_(),
     points_buff_(),
-    points_buff_frame_id_(-1),
+    points_rgb_buff_(),
+    points_rgb_rect_buff_(),
     q_matrix_(4, 4, 0.0),
     pc_border_clip_(10),
     pc_max_range_(15.0f),
@@ -577,16 +556,18 @@ Camera::Camera(Channel* driver,
         driver_->addIsolatedCallback(monoCB,  Source_Luma_Left | Source_Luma_Right, this);
         driver_->addIsolatedCallback(rectCB,  Source_Luma_Rectified_Left | Source_Luma_Rectified_Right, this);
         driver_->addIsolatedCallback(depthCB, Source_Disparity, this);
-        driver_->addIsolatedCallback(pointCB, Source_Disparity, this);
+        driver_->addIsolatedCallback(pointCB, (Source_Disparity | Source_Luma_Rectified_Left |
+                                               Source_Luma_Left | Source_Chroma_Left), this);
         driver_->addIsolatedCallback(rawCB,   Source_Disparity | Source_Luma_Rectified_Left, this);
         driver_->addIsolatedCallback(colorCB, Source_Luma_Left | Source_Chroma_Left, this);
         driver_->addIsolatedCallback(dispCB,  Source_Disparity | Source_Disparity_Right | Source_Disparity_Cost, this);
     }
 
     //
-    // A common callback to publish histograms
+    // A common callback to publish histograms. It does not read the
+    // pixels, so disparity is left packed for it.
 
-    driver_->addIsolatedCallback(histCB, allImageSources, this);
+    driver_->addIsolatedCallback(histCB, allImageSources, this, Callback_PackedDisparity);
 
     //
     // Get the border clip, if any
@@ -738,7 +719,6 @@ void Camera::jpegImageCallback(const image::Header& header)
             left_rgb_rect_image_.is_bigendian    = false;
             left_rgb_rect_image_.step            = 3 * width;            
             left_rgb_rect_cam_info_.header       = left_rgb_rect_image_.header;
-            left_rgb_rect_frame_id_              = header.frameId;
             left_rgb_rect_cam_pub_.publish(left_rgb_rect_image_, left_rgb_rect_cam_info_);
         }
     }
@@ -891,8 +871,6 @@ void Camera::rectCallback(const image::Header& header)
         left_rect_image_.height          = header.height;
         left_rect_image_.width           = header.width;
 
-        left_rect_frame_id_              = header.frameId;
-        
         left_rect_image_.encoding        = "mono8";
         left_rect_image_.is_bigendian    = false;
         left_rect_image_.step            = header.width;
@@ -901,21 +879,6 @@ void Camera::rectCallback(const image::Header& header)
 
         left_rect_cam_pub_.publish(left_rect_image_, left_rect_cam_info_);
 
-        publishPointCloud(left_rect_frame_id_,
-                          points_buff_frame_id_,
-                          luma_point_cloud_frame_id_,
-                          luma_point_cloud_pub_,
-                          luma_point_cloud_,
-                          header.width,
-                          header.height,
-                          header.timeSeconds,
-                          header.timeMicroSeconds,
-                          luma_cloud_step,
-                          points_buff_,
-                          &(left_rect_image_.data[0]), 1,
-                          pc_border_clip_,
-                          pc_max_range_);
-
         break;
     case Source_Luma_Rectified_Right:
 
@@ -1024,18 +987,28 @@ void Camera::depthCallback(const image::Header& header)
     depth_cam_pub_.publish(depth_image_, left_rect_cam_info_);
 }
 
-void Camera::pointCloudCallback(const image::Header& header)
+void Camera::pointCloudCallback(const image::FrameSet& set)
 {    
-    if (Source_Disparity != header.source) {
-     
-        ROS_ERROR("Camera: unexpected image source: 0x%x", header.source);
+    const bool wantLuma  = (0 != luma_point_cloud_pub_.getNumSubscribers());
+    const bool wantColor = (0 != color_point_cloud_pub_.getNumSubscribers());
+
+    if (false == wantLuma && false == wantColor)
         return;
-    }
 
-    if (0 == luma_point_cloud_pub_.getNumSubscribers() &&
-        0 == color_point_cloud_pub_.getNumSubscribers())
+    //
+    // The disparity image and the images that colorize it are of the
+    // same frame, so no pairing is needed here
+
+    const image::Header *headerP = set.image(Source_Disparity);
+    const image::Header *rectP   = set.image(Source_Luma_Rectified_Left);
+    const image::Header *lumaP   = set.image(Source_Luma_Left);
+    const image::Header *chromaP = set.image(Source_Chroma_Left);
+
+    if (NULL == headerP)
         return;
-       
+
+    const image::Header& header = *headerP;
+
     const bool      handle_missing = true;
     const uint32_t  imageSize      = header.height * header.width;
 
@@ -1078,255 +1051,227 @@ void Camera::pointCloudCallback(const image::Header& header)
     }
 
     //
-    // Store the disparity frame ID
+    // Publish the point clouds if desired/possible
 
-    points_buff_frame_id_ = header.frameId;
+    if (wantLuma && NULL != rectP &&
+        rectP->width == header.width && rectP->height == header.height)
+        publishPointCloud(luma_point_cloud_pub_,
+                          luma_point_cloud_,
+                          header.width,
+                          header.height,
+                          header.timeSeconds,
+                          header.timeMicroSeconds,
+                          luma_cloud_step,
+                          points_buff_,
+                          reinterpret_cast<const uint8_t*>(rectP->imageDataP), 1,
+                          pc_border_clip_,
+                          pc_max_range_);
 
     //
-    // Publish the point clouds if desired/possible
-
-    publishPointCloud(left_rect_frame_id_,
-                      points_buff_frame_id_,
-                      luma_point_cloud_frame_id_,
-                      luma_point_cloud_pub_,
-                      luma_point_cloud_,
-                      header.width,
-                      header.height,
-                      header.timeSeconds,
-                      header.timeMicroSeconds,
-                      luma_cloud_step,
-                      points_buff_,
-                      &(left_rect_image_.data[0]), 1,
-                      pc_border_clip_,
-                      pc_max_range_);
-
-    publishPointCloud(left_rgb_rect_frame_id_,
-                      points_buff_frame_id_,
-                      color_point_cloud_frame_id_,
-                      color_point_cloud_pub_,
-                      color_point_cloud_,
-                      header.width,
-                      header.height,
-                      header.timeSeconds,
-                      header.timeMicroSeconds,
-                      color_cloud_step,
-                      points_buff_,
-                      &(left_rgb_rect_image_.data[0]), 3,
-                      pc_border_clip_,
-                      pc_max_range_);
+    // The color image of this frame is converted and rectified here,
+    // rather than shared with the color image callback, which runs on
+    // its own thread
+
+    if (wantColor && NULL != lumaP && NULL != chromaP &&
+        lumaP->width == header.width && lumaP->height == header.height) {
+
+        convertColor(*lumaP, *chromaP, points_rgb_buff_);
+
+        if (rectifyColor(header.width, header.height,
+                         points_rgb_buff_, points_rgb_rect_buff_))
+            publishPointCloud(color_point_cloud_pub_,
+                              color_point_cloud_,
+                              header.width,
+                              header.height,
+                              header.timeSeconds,
+                              header.timeMicroSeconds,
+                              color_cloud_step,
+                              points_buff_,
+                              &(points_rgb_rect_buff_[0]), 3,
+                              pc_border_clip_,
+                              pc_max_range_);
+    }
 }
 
-void Camera::rawCamDataCallback(const image::Header& header)
+void Camera::rawCamDataCallback(const image::FrameSet& set)
 {
-    if (0 == raw_cam_data_pub_.getNumSubscribers()) {
-        got_raw_cam_left_ = false;
+    if (0 == raw_cam_data_pub_.getNumSubscribers())
         return;
-    }
 
-    const uint32_t imageSize = header.width * header.height;
+    const image::Header *rectP      = set.image(Source_Luma_Rectified_Left);
+    const image::Header *disparityP = set.image(Source_Disparity);
 
-    //
-    // The left-rectified image is currently published before
-    // the matching disparity image. 
-
-    if (false == got_raw_cam_left_) {
-
-        if (Source_Luma_Rectified_Left == header.source) {
-
-            raw_cam_data_.gray_scale_image.resize(imageSize);
-            memcpy(&(raw_cam_data_.gray_scale_image[0]), 
-                   header.imageDataP,
-                   imageSize * sizeof(uint8_t));
-
-            raw_cam_data_.frames_per_second = header.framesPerSecond;
-            raw_cam_data_.gain              = header.gain;
-            raw_cam_data_.exposure_time     = header.exposure;
-            raw_cam_data_.frame_count       = header.frameId;
-            raw_cam_data_.time_stamp        = ros::Time(header.timeSeconds,
-                                                        1000 * header.timeMicroSeconds);
-            raw_cam_data_.width             = header.width;
-            raw_cam_data_.height            = header.height;
-            
-            got_raw_cam_left_ = true;
-        }
-        
-    } else if (Source_Disparity == header.source) {
+    if (NULL == rectP || NULL == disparityP)
+        return;
 
-        const uint32_t imageSize = header.width * header.height;
+    const uint32_t imageSize = rectP->width * rectP->height;
 
-        if (header.frameId == raw_cam_data_.frame_count) {
+    raw_cam_data_.gray_scale_image.resize(imageSize);
+    memcpy(&(raw_cam_data_.gray_scale_image[0]), 
+           rectP->imageDataP,
+           imageSize * sizeof(uint8_t));
 
-            raw_cam_data_.disparity_image.resize(imageSize);
-            memcpy(&(raw_cam_data_.disparity_image[0]), 
-                   header.imageDataP, imageSize * sizeof(uint16_t));
+    raw_cam_data_.frames_per_second = rectP->framesPerSecond;
+    raw_cam_data_.gain              = rectP->gain;
+    raw_cam_data_.exposure_time     = rectP->exposure;
+    raw_cam_data_.frame_count       = rectP->frameId;
+    raw_cam_data_.time_stamp        = ros::Time(rectP->timeSeconds,
+                                                1000 * rectP->timeMicroSeconds);
+    raw_cam_data_.width             = rectP->width;
+    raw_cam_data_.height            = rectP->height;
 
-            raw_cam_data_pub_.publish(raw_cam_data_);
-        }
+    raw_cam_data_.disparity_image.resize(imageSize);
+    memcpy(&(raw_cam_data_.disparity_image[0]), 
+           disparityP->imageDataP, imageSize * sizeof(uint16_t));
 
-        got_raw_cam_left_ = false;
-    }
+    raw_cam_data_pub_.publish(raw_cam_data_);
 }
 
-void Camera::colorImageCallback(const image::Header& header)
+void Camera::colorImageCallback(const image::FrameSet& set)
 {
     if (0 == left_rgb_cam_pub_.getNumSubscribers() &&
-        0 == left_rgb_rect_cam_pub_.getNumSubscribers() &&
-        0 == color_point_cloud_pub_.getNumSubscribers()) {
-        got_left_luma_ = false;
+        0 == left_rgb_rect_cam_pub_.getNumSubscribers())
         return;
-    }
 
     //
-    // The left-luma image is currently published before
-    // the matching chroma image. 
+    // The luma and chroma images of a frame arrive together
 
-    if (false == got_left_luma_) {
+    const image::Header *lumaHeaderP = set.image(Source_Luma_Left);
+    const image::Header *headerP     = set.image(Source_Chroma_Left);
 
-        if (Source_Luma_Left == header.source) {
+    if (NULL == lumaHeaderP || NULL == headerP)
+        return;
 
-            const uint32_t imageSize = header.width * header.height;
+    const image::Header& header = *headerP;
 
-            left_luma_image_.data.resize(imageSize);
-            memcpy(&left_luma_image_.data[0], header.imageDataP, imageSize);
+    const uint32_t height    = lumaHeaderP->height;
+    const uint32_t width     = lumaHeaderP->width;
 
-            left_luma_image_.height = header.height;
-            left_luma_image_.width  = header.width;
+    left_rgb_image_.header.frame_id = frame_id_left_;
+    left_rgb_image_.header.stamp    = ros::Time(header.timeSeconds,
+                                                1000 * header.timeMicroSeconds);
+    left_rgb_image_.height          = height;
+    left_rgb_image_.width           = width;
+     
+    left_rgb_image_.encoding        = "rgb8";
+    left_rgb_image_.is_bigendian    = false;
+    left_rgb_image_.step            = 3 * width;
 
-            left_luma_frame_id_ = header.frameId;
-            got_left_luma_      = true;
-        }
-        
-    } else if (Source_Chroma_Left == header.source) {
+    convertColor(*lumaHeaderP, header, left_rgb_image_.data);
 
-        if (header.frameId == left_luma_frame_id_) {
+    if (0 != left_rgb_cam_pub_.getNumSubscribers())
+        left_rgb_cam_pub_.publish(left_rgb_image_);
 
-            const uint32_t height    = left_luma_image_.height;
-            const uint32_t width     = left_luma_image_.width;
-            const uint32_t imageSize = 3 * height * width;
+    if (left_rgb_rect_cam_pub_.getNumSubscribers() > 0 &&
+        rectifyColor(width, height, left_rgb_image_.data, left_rgb_rect_image_.data)) {
+
+        left_rgb_rect_image_.header.frame_id = frame_id_left_;
+        left_rgb_rect_image_.header.stamp    = ros::Time(header.timeSeconds,
+                                                         1000 * header.timeMicroSeconds);
+        left_rgb_rect_image_.height          = height;
+        left_rgb_rect_image_.width           = width;
+            
+        left_rgb_rect_image_.encoding        = "rgb8";
+        left_rgb_rect_image_.is_bigendian    = false;
+        left_rgb_rect_image_.step            = 3 * width;
+            
+        left_rgb_rect_cam_info_.header = left_rgb_rect_image_.header;
             
-            left_rgb_image_.data.resize(imageSize);
-
-            left_rgb_image_.header.frame_id = frame_id_left_;
-            left_rgb_image_.header.stamp    = ros::Time(header.timeSeconds,
-                                                        1000 * header.timeMicroSeconds);
-            left_rgb_image_.height          = height;
-            left_rgb_image_.width           = width;
-             
-            left_rgb_image_.encoding        = "rgb8";
-            left_rgb_image_.is_bigendian    = false;
-            left_rgb_image_.step            = 3 * width;
+        left_rgb_rect_cam_pub_.publish(left_rgb_rect_image_, left_rgb_rect_cam_info_);
+    }
+}
 
-            //
-            // Convert YCbCr 4:2:0 to RGB
-            // TODO: speed this up
-
-            const uint8_t *lumaP     = reinterpret_cast<const uint8_t*>(&(left_luma_image_.data[0]));
-            const uint8_t *chromaP   = reinterpret_cast<const uint8_t*>(header.imageDataP);
-            uint8_t       *rgbP      = reinterpret_cast<uint8_t*>(&(left_rgb_image_.data[0]));
-            const uint32_t rgbStride = width * 3;
-
-            for(uint32_t y=0; y<height; y++) {
-                for(uint32_t x=0; x<width; x++) {
-
-                    const uint32_t lumaOffset   = (y * width) + x;
-                    const uint32_t chromaOffset = 2 * (((y/2) * (width/2)) + (x/2));
-                    
-                    const float px_y  = static_cast<float>(lumaP[lumaOffset]);
-                    const float px_cb = static_cast<float>(chromaP[chromaOffset+0]) - 128.0f;
-                    const float px_cr = static_cast<float>(chromaP[chromaOffset+1]) - 128.0f;
-
-                    float px_r  = px_y +                    1.402f   * px_cr;
-                    float px_g  = px_y - 0.34414f * px_cb - 0.71414f * px_cr;
-                    float px_b  = px_y + 1.772f   * px_cb;
-
-                    if (px_r < 0.0f)        px_r = 0.0f;
-                    else if (px_r > 255.0f) px_r = 255.0f;
-                    if (px_g < 0.0f)        px_g = 0.0f;
-                    else if (px_g > 255.0f) px_g = 255.0f;
-                    if (px_b < 0.0f)        px_b = 0.0f;
-                    else if (px_b > 255.0f) px_b = 255.0f;
-
-                    const uint32_t rgbOffset = (y * rgbStride) + (3 * x);
-
-                    rgbP[rgbOffset + 0] = static_cast<uint8_t>(px_r);
-                    rgbP[rgbOffset + 1] = static_cast<uint8_t>(px_g);
-                    rgbP[rgbOffset + 2] = static_cast<uint8_t>(px_b);
-                }
-            }
+//
+// Convert a YCbCr 4:2:0 luma/chroma pair to RGB
 
-            if (0 != left_rgb_cam_pub_.getNumSubscribers())
-                left_rgb_cam_pub_.publish(left_rgb_image_);
-
-            if (left_rgb_rect_cam_pub_.getNumSubscribers() > 0 ||
-                color_point_cloud_pub_.getNumSubscribers() > 0) {
-                boost::mutex::scoped_lock lock(cal_lock_);
-
-                if (width  != image_config_.width() ||
-                    height != image_config_.height())
-                    //ROS_ERROR("calibration/image size mismatch: image=%dx%d, calibration=%dx%d",
-                    //width, height, image_config_.width(), image_config_.height());
-                    ;
-                else if (NULL == calibration_map_left_1_ || NULL == calibration_map_left_2_)
-                    ROS_ERROR("Camera: undistort maps not initialized");
-                else {
-
-                    const CvScalar outlierColor = {{0.0}};
-
-                    left_rgb_rect_image_.data.resize(imageSize);
-
-                    IplImage *sourceImageP  = cvCreateImageHeader(cvSize(width, height), IPL_DEPTH_8U, 3);
-                    sourceImageP->imageData = reinterpret_cast<char*>(&(left_rgb_image_.data[0]));
-                    IplImage *destImageP    = cvCreateImageHeader(cvSize(width, height), IPL_DEPTH_8U, 3);
-                    destImageP->imageData   = reinterpret_cast<char*>(&(left_rgb_rect_image_.data[0]));
-
-                    cvRemap(sourceImageP, destImageP, 
-                            calibration_map_left_1_, 
-                            calibration_map_left_2_,
-                            CV_INTER_LINEAR+CV_WARP_FILL_OUTLIERS, 
-                            outlierColor);
-
-                    cvReleaseImageHeader(&sourceImageP);
-                    cvReleaseImageHeader(&destImageP);
-
-                    left_rgb_rect_image_.header.frame_id = frame_id_left_;
-                    left_rgb_rect_image_.header.stamp    = ros::Time(header.timeSeconds,
-                                                                     1000 * header.timeMicroSeconds);
-                    left_rgb_rect_image_.height          = height;
-                    left_rgb_rect_image_.width           = width;
-                    
-                    left_rgb_rect_image_.encoding        = "rgb8";
-                    left_rgb_rect_image_.is_bigendian    = false;
-                    left_rgb_rect_image_.step            = 3 * width;
-                    
-                    left_rgb_rect_cam_info_.header = left_rgb_rect_image_.header;
-                    left_rgb_rect_frame_id_              = header.frameId;
-                    
-                    if (left_rgb_rect_cam_pub_.getNumSubscribers() > 0)
-                        left_rgb_rect_cam_pub_.publish(left_rgb_rect_image_, left_rgb_rect_cam_info_);
-                    
-                    //
-                    // Publish the color point cloud if desired/possible
-
-                    publishPointCloud(left_rgb_rect_frame_id_,
-                                      points_buff_frame_id_,
-                                      color_point_cloud_frame_id_,
-                                      color_point_cloud_pub_,
-                                      color_point_cloud_,
-                                      left_luma_image_.width,
-                                      left_luma_image_.height,
-                                      header.timeSeconds,
-                                      header.timeMicroSeconds,
-                                      color_cloud_step,
-                                      points_buff_,
-                                      &(left_rgb_rect_image_.data[0]), 3,
-                                      pc_border_clip_,
-                                      pc_max_range_);
-                }
-            }
+void Camera::convertColor(const image::Header& luma,
+                          const image::Header& chroma,
+                          std::vector<uint8_t>& rgb)
+{
+    const uint32_t height = luma.height;
+    const uint32_t width  = luma.width;
+
+    rgb.resize(3 * height * width);
+
+    //
+    // TODO: speed this up
+
+    const uint8_t *lumaP     = reinterpret_cast<const uint8_t*>(luma.imageDataP);
+    const uint8_t *chromaP   = reinterpret_cast<const uint8_t*>(chroma.imageDataP);
+    uint8_t       *rgbP      = reinterpret_cast<uint8_t*>(&(rgb[0]));
+    const uint32_t rgbStride = width * 3;
+
+    for(uint32_t y=0; y<height; y++) {
+        for(uint32_t x=0; x<width; x++) {
+
+            const uint32_t lumaOffset   = (y * width) + x;
+            const uint32_t chromaOffset = 2 * (((y/2) * (width/2)) + (x/2));
+            
+            const float px_y  = static_cast<float>(lumaP[lumaOffset]);
+            const float px_cb = static_cast<float>(chromaP[chromaOffset+0]) - 128.0f;
+            const float px_cr = static_cast<float>(chromaP[chromaOffset+1]) - 128.0f;
+
+            float px_r  = px_y +                    1.402f   * px_cr;
+            float px_g  = px_y - 0.34414f * px_cb - 0.71414f * px_cr;
+            float px_b  = px_y + 1.772f   * px_cb;
+
+            if (px_r < 0.0f)        px_r = 0.0f;
+            else if (px_r > 255.0f) px_r = 255.0f;
+            if (px_g < 0.0f)        px_g = 0.0f;
+            else if (px_g > 255.0f) px_g = 255.0f;
+            if (px_b < 0.0f)        px_b = 0.0f;
+            else if (px_b > 255.0f) px_b = 255.0f;
+
+            const uint32_t rgbOffset = (y * rgbStride) + (3 * x);
+
+            rgbP[rgbOffset + 0] = static_cast<uint8_t>(px_r);
+            rgbP[rgbOffset + 1] = static_cast<uint8_t>(px_g);
+            rgbP[rgbOffset + 2] = static_cast<uint8_t>(px_b);
         }
+    }
+}
+
+//
+// Rectify an RGB image of the left camera, if the calibration
+// matches its size
 
-        got_left_luma_ = false;
+bool Camera::rectifyColor(uint32_t                    width,
+                          uint32_t                    height,
+                          const std::vector<uint8_t>& rgb,
+                          std::vector<uint8_t>&       rgbRect)
+{
+    boost::mutex::scoped_lock lock(cal_lock_);
+
+    if (width  != image_config_.width() ||
+        height != image_config_.height())
+        //ROS_ERROR("calibration/image size mismatch: image=%dx%d, calibration=%dx%d",
+        //width, height, image_config_.width(), image_config_.height());
+        return false;
+
+    if (NULL == calibration_map_left_1_ || NULL == calibration_map_left_2_) {
+        ROS_ERROR("Camera: undistort maps not initialized");
+        return false;
     }
+
+    const CvScalar outlierColor = {{0.0}};
+
+    rgbRect.resize(3 * width * height);
+
+    IplImage *sourceImageP  = cvCreateImageHeader(cvSize(width, height), IPL_DEPTH_8U, 3);
+    sourceImageP->imageData = const_cast<char*>(reinterpret_cast<const char*>(&(rgb[0])));
+    IplImage *destImageP    = cvCreateImageHeader(cvSize(width, height), IPL_DEPTH_8U, 3);
+    destImageP->imageData   = reinterpret_cast<char*>(&(rgbRect[0]));
+
+    cvRemap(sourceImageP, destImageP, 
+            calibration_map_left_1_, 
+            calibration_map_left_2_,
+            CV_INTER_LINEAR+CV_WARP_FILL_OUTLIERS, 
+            outlierColor);
+
+    cvReleaseImageHeader(&sourceImageP);
+    cvReleaseImageHeader(&destImageP);
+
+    return true;
 }
 
 void Camera::queryConfig()